@@ -0,0 +1,14 @@
+; naive non-tail append of a million element list, a million frames deep
+(define (iota n acc)
+	(if (= n 0)
+	    acc
+	    (iota (- n 1) (cons n acc))))
+(define (app a b)
+	(if (null? a)
+	    b
+	    (cons (car a) (app (cdr a) b))))
+(define (len l n)
+	(if (null? l)
+	    n
+	    (len (cdr l) (+ n 1))))
+(len (app (iota 1000000 '()) '()) 0)
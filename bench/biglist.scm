@@ -0,0 +1,15 @@
+; accumulates a 10 million element list get-primes style, drops it and
+; builds another so the collector has to release the first one. neither
+; marking, sweeping nor displaying a list may recurse once per cell
+(define (iter i result)
+	(if (= i 0)
+	    result
+	    (iter (- i 1) (cons i result))))
+(define (len l n)
+	(if (null? l) n (len (cdr l) (+ n 1))))
+(define big (iter 10000000 '()))
+(len big 0)
+(define big '())
+(define big (iter 10000000 '()))
+(len big 0)
+(define big '())
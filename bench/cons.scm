@@ -0,0 +1,14 @@
+; builds and walks many short lists, dominated by pair allocation
+(define (build n)
+	(if (= n 1)
+	    (list 1)
+	    (cons n (build (- n 1)))))
+(define (len l)
+	(if (null? l)
+	    0
+	    (+ 1 (len (cdr l)))))
+(define (repeat k)
+	(if (= k 0)
+	    0
+	    (+ (len (build 200)) (repeat (- k 1)))))
+(repeat 2000)
@@ -0,0 +1,18 @@
+; 10000! twice, the plain recursion multiplying a bignum by a fixnum at
+; each step and a product tree whose halves grow to the same size, so
+; most of its time goes to multiplying bignums with each other. then the
+; 35660 digits are printed
+(define (fact n)
+	(if (= n 0) 1 (* n (fact (- n 1)))))
+
+(define (product a b)
+	(if (> (- b a) 8)
+		(let ((mid (quotient (+ a b) 2)))
+			(* (product a mid) (product (+ mid 1) b)))
+		(if (> a b) 1 (* a (product (+ a 1) b)))))
+
+(define f (fact 10000))
+(display (= f (product 1 10000)))
+(newline)
+(display f)
+(newline)
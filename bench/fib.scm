@@ -0,0 +1,6 @@
+; doubly recursive fibonacci, dominated by small integer arithmetic
+(define (fib n)
+	(if (< n 2)
+	    n
+	    (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 25)
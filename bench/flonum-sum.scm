@@ -0,0 +1,10 @@
+; 0.5 + 1.5 + ... + 3999999.5 with the generic + and <. every site only
+; ever sees flonums, which a JIT build learns while the loop is profiled
+; and tries first once it is compiled (see profile.h)
+(define (sum-halves n)
+	(define (iter x sum)
+		(if (< x n)
+			(iter (+ x 1.0) (+ sum x))
+			sum))
+	(iter 0.5 0.0))
+(sum-halves 4000000.0)
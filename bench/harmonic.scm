@@ -0,0 +1,12 @@
+; the 10000th harmonic number, 1 + 1/2 + ... + 1/10000, exactly. the sum
+; outgrows long longs after 46 terms, from then on its denominator is a
+; bignum of thousands of digits reduced against each small 1/k
+(define (harmonic n)
+	(define (iter k sum)
+		(if (> k n)
+			sum
+			(iter (+ k 1) (+ sum (/ 1 k)))))
+	(iter 1 0))
+
+(display (harmonic 10000))
+(newline)
@@ -0,0 +1,26 @@
+; the points of a 201 by 201 grid over [-2, 0.5] x [-1.25, 1.25] that stay
+; in the Mandelbrot set for 100 iterations. flonum arithmetic only, every
+; double along the way fits in a tagged pointer and none is allocated
+(define (escapes? cr ci)
+	(define (iter zr zi i)
+		(cond ((= i 100) #f)
+		      ((fl< 4.0 (fl+ (fl* zr zr) (fl* zi zi))) #t)
+		      (else (iter (fl+ (fl- (fl* zr zr) (fl* zi zi)) cr)
+		                  (fl+ (fl* 2.0 (fl* zr zi)) ci)
+		                  (+ i 1)))))
+	(iter 0.0 0.0 0))
+
+(define (row ci)
+	(define (iter cr count)
+		(cond ((fl< 0.5 cr) count)
+		      ((escapes? cr ci) (iter (fl+ cr 0.0125) count))
+		      (else (iter (fl+ cr 0.0125) (+ count 1)))))
+	(iter -2.0 0))
+
+(define (mandelbrot)
+	(define (iter ci count)
+		(if (fl< 1.25 ci)
+			count
+			(iter (fl+ ci 0.0125) (+ count (row ci)))))
+	(iter -1.25 0))
+(mandelbrot)
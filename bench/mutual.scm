@@ -0,0 +1,10 @@
+; a hundred million tail calls between two procedures, in constant space
+(define (ev? n)
+	(if (= n 0)
+	    #t
+	    (od? (- n 1))))
+(define (od? n)
+	(if (= n 0)
+	    #f
+	    (ev? (- n 1))))
+(ev? 100000000)
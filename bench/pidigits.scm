@@ -0,0 +1,22 @@
+; the first 3000 digits of pi from Gibbons' unbounded spigot: each digit
+; takes bignum products and a quotient of two bignums that keep growing
+(define (reverse-list l result)
+	(if (null? l) result (reverse-list (cdr l) (cons (car l) result))))
+
+(define (pi-digits count)
+	(define (next q r t k n l digits count)
+		(cond ((= count 0) (reverse-list digits '()))
+		      ((< (- (+ (* 4 q) r) t) (* n t))
+		       (next (* 10 q) (* 10 (- r (* n t))) t k
+		             (- (quotient (* 10 (+ (* 3 q) r)) t) (* 10 n)) l
+		             (cons n digits) (- count 1)))
+		      (else
+		       (next (* q k) (* (+ (* 2 q) r) l) (* t l) (+ k 1)
+		             (quotient (+ (* q (+ (* 7 k) 2)) (* r l)) (* t l)) (+ l 2)
+		             digits count))))
+	(next 1 0 1 1 3 3 '() count))
+
+(define (display-all digits)
+	(cond ((null? digits) (newline))
+	      (else (display (car digits)) (display-all (cdr digits)))))
+(display-all (pi-digits 3000))
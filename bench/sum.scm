@@ -0,0 +1,10 @@
+; deep non-tail recursion summing integers
+(define (sum n)
+	(if (= n 0)
+	    0
+	    (+ n (sum (- n 1)))))
+(sum 5000)
+(sum 5000)
+(sum 5000)
+(sum 5000)
+(sum 5000)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "object.h"
+
+/*
+ * bignums
+ * an exact integer out of the range of a long long is a NUMBER_BIGINT:
+ * its magnitude in 32 bit limbs, least significant first, and its sign.
+ * an integer that fits is always made a fixnum or a boxed NUMBER_INTEGER
+ * instead, so the two never overlap and a bignum is never 0.
+ *
+ * the scheme_bigint is malloc'd and belongs to the number object, whose
+ * finalizer frees it. a scheme_number read out of the object with
+ * Scheme_GetNumberValue shares it, the object has to stay alive for as
+ * long as that is used.
+ *
+ * the numerator and denominator of a NUMBER_BIGRATIONAL are scheme_bigints
+ * too, but either of them may be small (not both), even 1.
+ *
+ * multiplication switches from schoolbook to Karatsuba at
+ * BIGINT_KARATSUBA_LIMBS, division from Knuth's algorithm D to Burnikel
+ * and Ziegler's recursive division at BIGINT_BZ_LIMBS, and printing splits
+ * the number on powers of 10^9 down to BIGINT_PRINT_LIMBS
+ */
+
+#define BIGINT_KARATSUBA_LIMBS 32
+#define BIGINT_BZ_LIMBS        48
+#define BIGINT_PRINT_LIMBS     32
+
+typedef uint32_t bigint_limb;
+
+struct scheme_bigint {
+	int size;       // limbs, the most significant one is never 0
+	char negative;
+	bigint_limb limbs[];
+};
+
+// what the collector counts for big, see gc.h
+#define Bigint_Bytes(big) (sizeof(scheme_bigint) + sizeof(bigint_limb) * (big)->size)
+
+// exact arithmetic on any two exact numbers, integers or rationals of
+// either size. the result is a new number in its smallest representation.
+// NULL on error, dividing by 0 is one
+scheme_object * Bigint_Add(scheme_number * a, scheme_number * b);
+scheme_object * Bigint_Sub(scheme_number * a, scheme_number * b);
+scheme_object * Bigint_Mul(scheme_number * a, scheme_number * b);
+scheme_object * Bigint_Div(scheme_number * a, scheme_number * b);
+// truncating division of two exact integers, the quotient has the sign of
+// a / b and the remainder that of a. either result may be left out with
+// NULL. 1 for success, 0 for error (dividing by 0)
+int Bigint_DivMod(scheme_number * a, scheme_number * b,
+	scheme_object ** quotient, scheme_object ** remainder);
+
+// -1, 0 or 1 as exact a is less than, equal to or greater than exact b,
+// 2 if that could not be worked out for lack of memory
+int Bigint_Compare(scheme_number * a, scheme_number * b);
+
+double Bigint_ToDouble(scheme_bigint * big);
+double Bigint_RatioToDouble(scheme_bigint * numerator, scheme_bigint * denominator);
+scheme_bigint * Bigint_Copy(scheme_bigint * big);
+
+// an integer from its decimal digits, with an optional sign
+scheme_object * Bigint_Parse(const char * str);
+// prints big in base 10
+void Bigint_Display(scheme_bigint * big);
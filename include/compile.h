@@ -0,0 +1,88 @@
+#pragma once
+
+#include "object.h"
+#include "vm.h"
+
+/*
+ * compiler
+ * a resolved form (see resolve.h) is compiled once into bytecode for the
+ * VM (see vm.h), so running code never looks at list structure again.
+ * whether a form is special, how many operands it has and where its
+ * variables live are all settled here.
+ *
+ * a lambda expression is compiled into a SCHEME_CODE object, shared by
+ * every closure made from it, and a top level form into one that runs in
+ * a frame of its own. the heap objects code refers to (quoted data,
+ * literals, the code of nested lambdas) are kept alive by its constant
+ * table, globals are referred to by their cells. like the parser's output
+ * they are pretenured.
+ *
+ * code in tail position returns its value from the frame itself, through
+ * OP_RETURN or a tail call.
+ */
+
+// a lambda or let frame in scope, the compiler's view of a scheme_scope
+typedef struct scheme_block scheme_block;
+struct scheme_block {
+	char lambda;
+	char captured; // in a heap environment, otherwise on the value stack
+	int base;      // frame slot of its first variable when on the stack
+	scheme_block * parent;
+};
+
+typedef struct scheme_compiler scheme_compiler;
+struct scheme_compiler {
+	scheme_env * global;
+	scheme_block * block; // innermost frame, NULL at top level
+
+	scheme_op * ops;
+	int op_count, op_size;
+	int last;             // where the last instruction starts, -1 for none
+	scheme_object ** consts;
+	int const_count, const_size;
+	scheme_define ** cells;
+	int cell_count, cell_size;
+
+	int slot_count, frame_size; // frame slots in use, the most ever in use
+	int depth, max_depth;       // operands on the stack, the most ever
+	char overflow;              // an operand did not fit in a scheme_op
+
+	scheme_compiler * parent;
+};
+
+// innermost compiler at work, its constants are roots
+extern scheme_compiler * scheme_compilers;
+
+// code for a top level form, NULL on error
+scheme_object * Scheme_Compile(scheme_object * expr, scheme_object * env);
+
+// 1 for success, 0 for error
+int Scheme_CompileExpr(scheme_object * expr, scheme_compiler * c, char tail);
+// the forms are evaluated in order, the value of the last is kept
+int Scheme_CompileBody(scheme_object ** exprs, int count, scheme_compiler * c, char tail);
+// code for a lambda with the frame layout from Scheme_Resolve, returns
+// its index in the constants of c or -1 on error
+int Scheme_CompileLambda(scheme_object * args, int frame_size, char captured,
+	scheme_object ** body, int body_count, scheme_compiler * c);
+
+// keeps track of the operands on the stack from scheme_ops
+void Scheme_Emit(scheme_compiler * c, scheme_op op);
+void Scheme_EmitOperand(scheme_compiler * c, int operand);
+// for the instructions that pop a variable number of operands
+void Scheme_EmitStack(scheme_compiler * c, int delta);
+// OP_RETURN if tail is set
+void Scheme_EmitReturn(scheme_compiler * c, char tail);
+// a jump whose target is filled in by Scheme_PatchJump, returns the
+// position of the target
+int  Scheme_EmitJump(scheme_compiler * c, scheme_op op);
+// points the jump at the next instruction emitted
+void Scheme_PatchJump(scheme_compiler * c, int at);
+
+int Scheme_AddConstant(scheme_compiler * c, scheme_object * obj);
+int Scheme_AddCell(scheme_compiler * c, scheme_define * cell);
+
+// frames of lets, the frame of a lambda is entered by Scheme_CompileLambda
+void Scheme_EnterBlock(scheme_compiler * c, scheme_block * block, int size, char captured);
+void Scheme_LeaveBlock(scheme_compiler * c);
+// pops a value into the variable ref names in the innermost frame
+void Scheme_CompileSetLocal(scheme_compiler * c, scheme_ref * ref);
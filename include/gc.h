@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "object.h"
+#include "slab.h"
+
+/*
+ * generational garbage collector
+ * new objects are bump allocated in the nursery. when it fills up a
+ * minor collection copies the live ones out: into a survivor space, or,
+ * once they have survived GC_PROMOTE_AGE minor collections (or the
+ * survivor space is full), into the old generation slabs. the nursery
+ * is then reused from the start.
+ *
+ * the old generation is collected by mark and sweep once GC_MIN_THRESHOLD
+ * objects, or as many as survived the last major collection, have been
+ * promoted into it. a major collection first promotes the whole nursery.
+ *
+ * the roots are
+ *   SYSTEM_GLOBAL_ENVIRONMENT_OBJ and USER_INITIAL_ENVIRONMENT_OBJ
+ *   the procedure and environment of each call_stack entry
+ *   the VM's value stack below vm_sp, and below top in earlier segments
+ *   (see vm.h)
+ *   the constants of code still being compiled (see compile.h)
+ *   C variables registered on the root stack with GC_PROTECT
+ *   for a minor collection, old objects in cards dirtied by GC_WRITE_BARRIER
+ *
+ * a collection can start inside any Scheme_AllocateObject and may move
+ * every nursery object. a C variable holding an object across anything
+ * that may allocate has to be registered with GC_PROTECT (and dropped
+ * with GC_UNPROTECT on every path out of the function), and payload
+ * pointers taken from such an object have to be fetched again afterwards.
+ * objects allocated while gc_pretenure is set go straight to the old
+ * generation and never move, the parser does this for code.
+ *
+ * memory an object mallocs outside the heap, the limbs of a bignum, is
+ * counted in gc_stats.external from when the object is made until it is
+ * finalized. the collector does not otherwise see it, so once it passes
+ * gc_stats.external_threshold the next allocation runs a minor
+ * collection, and a major one if that did not bring it back under. the
+ * threshold is then twice what is left, and at least GC_EXTERNAL_MIN.
+ */
+
+#define GC_NURSERY_SIZE  (256 * 1024)
+#define GC_SURVIVOR_SIZE (64 * 1024)
+#define GC_PROMOTE_AGE   2
+
+#define GC_MIN_THRESHOLD 16384
+#define GC_EXTERNAL_MIN  (4 * 1024 * 1024)
+#define GC_ROOT_STACK_INIT_SIZE 1024
+
+extern scheme_object *** gc_root_stack;
+extern size_t gc_root_count;
+extern size_t gc_root_size;
+
+#define GC_PROTECT(var) do { \
+	if (gc_root_count == gc_root_size) Scheme_GCGrowRoots(); \
+	gc_root_stack[gc_root_count++] = &(var); \
+} while (0)
+#define GC_UNPROTECT(n) (gc_root_count -= (n))
+
+// nursery and both survivor spaces are one contiguous block
+extern char * gc_young_start, * gc_young_end;
+extern char * gc_nursery_top, * gc_nursery_end;
+extern int gc_pretenure;
+
+#define Scheme_GCIsYoung(obj) (!Scheme_IsImmediate(obj) && \
+	(char *)(obj) >= gc_young_start && (char *)(obj) < gc_young_end)
+
+// has to follow every store of val into a field of obj, unless obj
+// was just allocated
+#define GC_WRITE_BARRIER(obj, val) do { \
+	if (Scheme_GCIsYoung(val) && !Scheme_GCIsYoung(obj)) \
+		Slab_MarkCard(obj); \
+} while (0)
+
+typedef struct scheme_gc_stats {
+	size_t collections;       // major
+	size_t minor_collections;
+	size_t allocated;         // objects added to the old generation since the last major
+	size_t threshold;
+	size_t live;              // objects that survived the last major collection
+	size_t freed;             // old objects swept over the whole run
+	size_t freed_bytes;       // bytes handed back by both collectors
+	size_t promoted;          // objects moved into the old generation
+	size_t survived;          // objects copied into a survivor space
+	size_t external;          // bytes malloc'd outside the heap by live objects
+	size_t external_threshold;
+
+	// minor collection pauses
+	unsigned long long pause_total_ns, pause_max_ns;
+} scheme_gc_stats;
+
+extern scheme_gc_stats gc_stats;
+
+// 1 for success, 0 for error
+int  Scheme_InitGC(void);
+void Scheme_GCGrowRoots(void);
+
+void Scheme_GCMark(scheme_object * obj);
+void Scheme_GCMinor(void);
+void Scheme_GCCollect(void);
+// run when gc_stats.external has passed its threshold
+void Scheme_GCCollectExternal(void);
+
+// finalizes every object still on the heap, used on shutdown
+void Scheme_GCFreeAll(void);
+
+void Scheme_DisplayGCStats(void);
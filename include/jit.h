@@ -0,0 +1,58 @@
+#pragma once
+
+#include "object.h"
+#include "scheme.h"
+
+/*
+ * JIT compiler
+ * make JIT=1 builds in a baseline compiler from bytecode to x86-64 machine
+ * code. the code of a lambda is compiled once it is promoted (see
+ * profile.h), each instruction into a fixed template of machine code
+ * working on the same value stack and frame as the VM. so the VM and the
+ * machine code can hand a frame to each other at any instruction:
+ *   - fixnum arithmetic (with overflow checks) and comparisons, car, cdr,
+ *     null? and the guards of the other inlined primitives run in machine
+ *     code. flonums go straight to the flonum primitives where the site
+ *     has seen them, other numbers to the C functions the VM calls. the
+ *     fixnum path is left out where a site has only seen other numbers
+ *   - a primitive with a fixed entry point (OP_PRIM0 .. 3) is called
+ *     directly, as are the allocating instructions
+ *   - a lambda tail calling itself loops without leaving the machine code
+ *   - any other call, a return, an unbound variable or a redefined
+ *     primitive hands the frame back to the VM at that instruction
+ * the VM carries on in the machine code whenever a frame of compiled code
+ * is entered or resumes after a call, so Scheme_Execute stays the only way
+ * in and the call stack stays the VM's.
+ *
+ * the environment variable SCHEME_JIT overrides scheme_tier_threshold: 0
+ * compiles every lambda on its first call, before it has any feedback,
+ * off never promotes anything. make jit-diff runs the tests all three
+ * ways and compares them
+ */
+
+#ifdef SCHEME_JIT
+
+#ifndef __x86_64__
+#error "the JIT only generates x86-64 code"
+#endif
+
+// runs the machine code from entry with the frame of call, whose operands
+// end at sp. the instruction to carry on from in the VM is returned, with
+// the top of the stack in vm_sp, NULL on error
+typedef const scheme_op * (*scheme_jit_func)(scheme_call * call, scheme_object ** sp,
+	void * entry);
+
+typedef struct scheme_jit_code {
+	scheme_jit_func func;
+	size_t size;     // bytes mapped
+	void ** entries; // machine code of each instruction, by its position in ops
+} scheme_jit_code;
+
+// reads SCHEME_JIT
+void Scheme_InitJIT(void);
+
+// compiles code, 1 for success, 0 if it is left to the VM
+int  Scheme_JitCompile(scheme_code * code);
+void Scheme_JitFree(scheme_jit_code * jit);
+
+#endif
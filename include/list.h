@@ -7,12 +7,15 @@
 // lists are defined using scheme_object pairs as nodes
 
 int Scheme_IsPair(scheme_object * obj);
-int Scheme_IsNull(scheme_object * obj);
+// () is a single immediate, the empty list is never a C NULL or a pair
+#define Scheme_IsNull(obj) ((obj) == SCHEME_NULL_OBJ)
 
 int Scheme_ListLength(scheme_object * obj);
 
 scheme_object * Scheme_Car(scheme_object * obj);
 scheme_object * Scheme_Cdr(scheme_object * obj);
+void Scheme_SetCar(scheme_object * pair, scheme_object * obj);
+void Scheme_SetCdr(scheme_object * pair, scheme_object * obj);
 
 scheme_object * Scheme_Cons(scheme_object * a, scheme_object * b);
 scheme_object * Scheme_ListFromArray(scheme_object ** array, int count);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "symbol.h"
@@ -18,37 +20,147 @@ enum {
 	SCHEME_SYMBOL,
 	SCHEME_LAMBDA,
 	SCHEME_ENV,
-	SCHEME_CFUNC
+	SCHEME_CFUNC,
+	SCHEME_REF,
+	SCHEME_CODE,
+	SCHEME_UNSPECIFIED
 };
 
+// type of a cell the garbage collector has swept back onto a free list
+#define SCHEME_FREED 0xff
+// type of a nursery object that has been copied out, the first word of
+// its payload holds the new address
+#define SCHEME_FORWARD 0xfe
+
+// the payload struct for the object's type (scheme_pair, scheme_number, ...)
+// is stored inline directly after the header in the same allocation
 typedef struct scheme_object {
 	unsigned char type;	
-	void * payload;
-	int ref_count;
+	unsigned char mark;
+	unsigned char age; // minor collections survived in the nursery
+	_Alignas(void *) char payload[];
 } scheme_object;
 
+// object owning a payload pointer obtained from one of the Scheme_Get functions
+#define Scheme_PayloadObject(p) ((scheme_object *)((char *)(p) - offsetof(scheme_object, payload)))
+
+/* Tagged immediates
+ * small integers, booleans, the empty list and the unspecified value are
+ * encoded in the scheme_object pointer itself and never touch the heap.
+ * heap objects are malloc'd and therefore aligned, leaving the low bits free
+ *   ...xxx1 fixnum, the integer is stored in the upper bits
+ *   ...xx10 immediate constant (#f, #t, (), unspecified)
+ *   ...x100 flonum, see below
+ *   ...x000 pointer to a heap allocated scheme_object
+ */
+#define SCHEME_FIXNUM_TAG    0x1
+#define SCHEME_IMMEDIATE_TAG 0x2
+#if UINTPTR_MAX > 0xffffffffu
+#define SCHEME_FLONUM_TAG    0x4
+#else
+// 32 bit pointers leave no bit for flonums, every double is boxed
+#define SCHEME_FLONUM_TAG    0x0
+#endif
+#define SCHEME_TAG_MASK      (0x3 | SCHEME_FLONUM_TAG)
+
+#define SCHEME_IMMEDIATE(n) ((scheme_object *)(((uintptr_t)(n) << 2) | SCHEME_IMMEDIATE_TAG))
+#define SCHEME_FALSE_OBJ       SCHEME_IMMEDIATE(0)
+#define SCHEME_TRUE_OBJ        SCHEME_IMMEDIATE(1)
+#define SCHEME_NULL_OBJ        SCHEME_IMMEDIATE(2)
+#define SCHEME_UNSPECIFIED_OBJ SCHEME_IMMEDIATE(3)
+
+#define SCHEME_FIXNUM_MAX ((long long)(INTPTR_MAX >> 1))
+#define SCHEME_FIXNUM_MIN ((long long)(INTPTR_MIN >> 1))
+
+#define Scheme_IsImmediate(obj) (((uintptr_t)(obj) & SCHEME_TAG_MASK) != 0)
+#define Scheme_IsFixnum(obj)    (((uintptr_t)(obj) & SCHEME_FIXNUM_TAG) != 0)
+#define Scheme_FixnumFits(val)  ((val) >= SCHEME_FIXNUM_MIN && (val) <= SCHEME_FIXNUM_MAX)
+#define Scheme_FixnumValue(obj) ((long long)((intptr_t)(obj) >> 1))
+#define Scheme_MakeFixnum(val)  ((scheme_object *)(((uintptr_t)(intptr_t)(val) << 1) | SCHEME_FIXNUM_TAG))
+#define Scheme_MakeBoolean(val) ((val) ? SCHEME_TRUE_OBJ : SCHEME_FALSE_OBJ)
+
+/* Flonums
+ * on 64 bit targets heap objects are 8 byte aligned, which frees a third
+ * tag bit: ...x100 is a double held in the pointer, so flonum arithmetic
+ * does not allocate. a double has all 64 bits in use though, only 0.0
+ * and those with one of the middle 255 exponents (magnitudes 2^-126 up
+ * to 2^129, about the range of a float) fit. the sign is rotated down to
+ * bit 0 and SCHEME_FLONUM_BIAS taken off the exponent, which leaves the
+ * top 3 bits 0 to shift out. any other double is a boxed NUMBER_DOUBLE
+ */
+#define SCHEME_FLONUM_BIAS  ((uint64_t)896 << 53)
+#define SCHEME_FLONUM_RANGE ((uint64_t)255 << 53)
+
+#define Scheme_IsFlonum(obj) (SCHEME_FLONUM_TAG && ((uintptr_t)(obj) & 0x7) == SCHEME_FLONUM_TAG)
+
+// the bits of val with the sign rotated down to bit 0
+static inline uint64_t Scheme_DoubleBits(double val) {
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	return (bits << 1) | (bits >> 63);
+}
+
+static inline int Scheme_FlonumFits(double val) {
+	uint64_t bits = Scheme_DoubleBits(val);
+	return SCHEME_FLONUM_TAG && (bits <= 1
+		|| bits - SCHEME_FLONUM_BIAS - ((uint64_t)1 << 53) < SCHEME_FLONUM_RANGE);
+}
+
+static inline scheme_object * Scheme_MakeFlonum(double val) {
+	uint64_t bits = Scheme_DoubleBits(val);
+	if (bits > 1)
+		bits -= SCHEME_FLONUM_BIAS;
+	return (scheme_object *)(uintptr_t)((bits << 3) | SCHEME_FLONUM_TAG);
+}
+
+static inline double Scheme_FlonumValue(scheme_object * obj) {
+	uint64_t bits = (uint64_t)(uintptr_t)obj >> 3;
+	if (bits > 1)
+		bits += SCHEME_FLONUM_BIAS;
+	bits = (bits >> 1) | (bits << 63);
+	double val;
+	memcpy(&val, &bits, sizeof(val));
+	return val;
+}
+
+// type of any object, immediate or not. a C NULL is an error result,
+// not a list, it only reads as SCHEME_NULL so type checks fail safely
+static inline int Scheme_Type(scheme_object * obj) {
+	uintptr_t bits = (uintptr_t)obj;
+	if (bits & SCHEME_FIXNUM_TAG)
+		return SCHEME_NUMBER;
+	if (bits & SCHEME_IMMEDIATE_TAG) {
+		if (obj == SCHEME_NULL_OBJ) return SCHEME_NULL;
+		if (obj == SCHEME_UNSPECIFIED_OBJ) return SCHEME_UNSPECIFIED;
+		return SCHEME_BOOLEAN;
+	}
+	if (bits & SCHEME_FLONUM_TAG)
+		return SCHEME_NUMBER;
+	return obj ? obj->type : SCHEME_NULL;
+}
+
 // 1 for success, 0 for error
-int  Scheme_AllocateObject(scheme_object ** object, int type);
-void Scheme_FreeObject(scheme_object * object);
+size_t Scheme_PayloadSize(int type);
+int    Scheme_ObjectSlab(int type);
+size_t Scheme_ObjectSize(int type); // header and payload
+int    Scheme_AllocateObject(scheme_object ** object, int type);
 
-// required for changing ref_count
-void Scheme_ReferenceObject(scheme_object ** pointer, scheme_object * object);
-void Scheme_DereferenceObject(scheme_object ** pointer);
-void Scheme_DereferenceEnv(scheme_env * env);
+// releases everything the object's payload owns outside the heap,
+// called by the garbage collector on objects it sweeps
+void   Scheme_FinalizeObject(scheme_object * object);
 
-#include "scope.h"
+#ifdef SCHEME_ALLOC_STATS
+// heap objects allocated per type, immediates are never counted
+extern size_t scheme_alloc_count[SCHEME_UNSPECIFIED + 1];
+// calls to malloc(), calloc() and realloc() made by the interpreter
+// itself, the linker points them at counting wrappers
+extern size_t scheme_malloc_count;
+// procedures the VM called
+extern size_t scheme_call_count;
+void Scheme_DisplayAllocStats(void);
+#endif
 
-#define SCHEME_FREED_MEMORY_START_SIZE 8
-// memory of what objects have been freed
-// when freeing a list to avoid a cycle
-struct scheme_freed_memory {
-	int size, pos;
-	scheme_object ** objects;
-};
-struct scheme_freed_memory * Scheme_InitFreedMemory();
-int  Scheme_CheckIfFreed(struct scheme_freed_memory * mem, scheme_object * address);
-void Scheme_AddFreed(struct scheme_freed_memory * mem, scheme_object * address);
-void Scheme_FreeFreedMemory(struct scheme_freed_memory * mem);
+#include "scope.h"
 
 typedef struct scheme_pair {
 	scheme_object * car,
@@ -58,13 +170,18 @@ typedef struct scheme_pair {
 enum {
 	NUMBER_INTEGER,
 	NUMBER_RATIONAL,
-	NUMBER_DOUBLE
+	NUMBER_DOUBLE,
+	NUMBER_BIGINT,
+	NUMBER_BIGRATIONAL
 };
 
-typedef struct scheme_boolean {
-	char val;
-} scheme_boolean;
+// see bigint.h
+typedef struct scheme_bigint scheme_bigint;
 
+// integers outside the fixnum range are boxed as NUMBER_INTEGER, those
+// outside the range of a long long as NUMBER_BIGINT. a rational is kept
+// in lowest terms with a positive denominator, as a NUMBER_RATIONAL as
+// long as both fit a long long and a NUMBER_BIGRATIONAL otherwise
 typedef struct scheme_number {
 	unsigned char type;
 
@@ -72,6 +189,8 @@ typedef struct scheme_number {
 		long long integer_val;
 		double double_val;
 		struct { long long numerator, denominator; };
+		scheme_bigint * bigint_val;
+		struct { scheme_bigint * big_numerator, * big_denominator; };
 	};
 } scheme_number;
 
@@ -83,64 +202,137 @@ typedef struct scheme_symbol {
 	symbol * sym;
 } scheme_symbol;
 
-typedef struct scheme_lambda {
+// one unit of bytecode, an opcode or one of its operands
+typedef uint16_t scheme_op;
+
+// a compiled lambda expression or top level form, see compile.h
+typedef struct scheme_code {
 	int arg_count;
 	char dot_args;
 	symbol ** arg_ids;
 
-	int body_count;
-	scheme_object ** body;
+	// a captured frame moves its arguments into a heap environment of
+	// env_size slots (arguments followed by internal defines) on entry
+	char captured;
+	int env_size;
+
+	int frame_size; // value stack slots of a frame, arguments first
+	int stack_size; // frame_size and the most operands pushed above it
+
+	scheme_op * ops;
+	int op_count;
+
+	scheme_object ** consts; // operands of OP_CONST and OP_CLOSURE
+	int const_count;
+	scheme_define ** cells;  // operands of OP_GLOBAL and OP_DEFINE_GLOBAL
+	int cell_count;
 
+	unsigned int epoch;      // scheme_global_epoch when it was compiled
+
+	// its profile, see profile.h
+	unsigned long long calls; // frames of it entered, loops aside
+	unsigned long long loops; // tail calls it made to itself
+	unsigned char tier;
+	uint16_t * feedback;      // a slot for each position in ops and one past them
+
+#ifdef SCHEME_JIT
+	struct scheme_jit_code * jit; // its machine code once hot, see jit.h
+#endif
+} scheme_code;
+
+typedef struct scheme_lambda {
+	scheme_object * code;
 	scheme_object * closure;
 } scheme_lambda;
 
 // scheme_object * func(scheme_object ** objects, size_t object_count);
+typedef scheme_object * (*scheme_func0)(void);
+typedef scheme_object * (*scheme_func1)(scheme_object *);
+typedef scheme_object * (*scheme_func2)(scheme_object *, scheme_object *);
+typedef scheme_object * (*scheme_func3)(scheme_object *, scheme_object *, scheme_object *);
+
 typedef struct scheme_cfunc {
+	// takes the arguments as an array, NULL for a primitive with a fixed
+	// number of them, which is called through the func0 .. func3 entry
+	// point for arg_count instead
 	scheme_object* (*func)(scheme_object **, scheme_object*, size_t);
+	union {
+		scheme_func0 func0;
+		scheme_func1 func1;
+		scheme_func2 func2;
+		scheme_func3 func3;
+	};
 	
 	int arg_count;
 	char dot_args;
-	char special_form;
+	char special_form; // one of SPECIAL_*, func is NULL for those
+	// the opcode the VM runs the primitive inline with, 0 for none (see vm.h)
+	unsigned char inline_op;
 } scheme_cfunc;
 
-void Scheme_FreePair(scheme_pair * pair);
+// the most arguments a primitive takes with a fixed entry point
+#define SCHEME_CFUNC_FIXED_MAX 3
+
+// a variable reference in resolved code, see resolve.h
+typedef struct scheme_ref {
+	symbol * sym;
+	scheme_define * cell; // the binding of a global, NULL for a local
+	int depth, slot;      // frames up from the current one, slot in it
+} scheme_ref;
+
+// release what a payload owns outside the heap, see Scheme_FinalizeObject
 void Scheme_FreeNumber(scheme_number * number);
-void Scheme_FreeBoolean(scheme_boolean * boolean);
 void Scheme_FreeString(scheme_string * string);
 void Scheme_FreeSymbol(scheme_symbol * symbol);
 void Scheme_FreeLambda(scheme_lambda * lambda);
 void Scheme_FreeEnvObj(scheme_env * env);
-void Scheme_FreeCFunc(scheme_cfunc * cfunc);
+void Scheme_FreeRef(scheme_ref * ref);
+void Scheme_FreeCode(scheme_code * code);
 
 scheme_pair    * Scheme_GetPair  (scheme_object * obj);
 scheme_number  * Scheme_GetNumber(scheme_object * obj);
-scheme_boolean * Scheme_GetBoolean(scheme_object * obj);
 scheme_string  * Scheme_GetString(scheme_object * obj);
 scheme_symbol  * Scheme_GetSymbol(scheme_object * obj);
 scheme_lambda  * Scheme_GetLambda(scheme_object * obj);
 scheme_env     * Scheme_GetEnvObj(scheme_object * obj);
 scheme_cfunc   * Scheme_GetCFunc (scheme_object * obj);
+scheme_ref     * Scheme_GetRef   (scheme_object * obj);
+scheme_code    * Scheme_GetCode  (scheme_object * obj);
+
+// works on fixnums, flonums and boxed numbers
+scheme_number Scheme_GetNumberValue(scheme_object * obj);
 
 /* Object constructors
  * CreateSymbol and CreateString assume
  * string given as argument is allocated on the heap
+ * object arguments are kept alive by the constructor while it allocates
  */
 scheme_object * Scheme_CreateNull( void );
 scheme_object * Scheme_CreateSymbol(char * symbol);
 scheme_object * Scheme_CreateSymbolFromSymbol(symbol * symbol);
 scheme_object * Scheme_CreatePair(scheme_object * car, scheme_object * cdr);
-scheme_object * Scheme_CreatePairWithoutRef(scheme_object * car, scheme_object * cdr);
 scheme_object * Scheme_CreateBoolean(char val);
 scheme_object * Scheme_CreateInteger(long long integer);
 scheme_object * Scheme_CreateRational(long long numerator, long long denominator);
 scheme_object * Scheme_CreateDouble(double value);
+// takes over big, which is freed if the object cannot be made
+scheme_object * Scheme_CreateBigint(scheme_bigint * big);
+scheme_object * Scheme_CreateBigRational(scheme_bigint * numerator, scheme_bigint * denominator);
+scheme_object * Scheme_CreateNumber(scheme_number * num);
 scheme_object * Scheme_CreateString(char * string);
-scheme_object * Scheme_CreateEnvObj(scheme_object * parent, int init_size);
-scheme_object * Scheme_CreateEnvObjWithoutRef(scheme_object * parent, int init_size);
-scheme_object * Scheme_CreateLambda(int argc, char dot_args, symbol ** args, int body_count,
-	scheme_object ** body, scheme_object * closure);
+scheme_object * Scheme_CreateEnvObj(scheme_object * parent, int size);
+scheme_object * Scheme_CreateGlobalEnvObj(scheme_object * parent, int init_size);
+scheme_object * Scheme_CreateLambda(scheme_object * code, scheme_object * closure);
+// empty code, filled in by the compiler
+scheme_object * Scheme_CreateCode(void);
 scheme_object * Scheme_CreateCFunc(int argc, char dot_args, char special_form,
 	scheme_object* (*func)(scheme_object**,scheme_object*,size_t));
+scheme_object * Scheme_CreateCFunc0(scheme_func0 func);
+scheme_object * Scheme_CreateCFunc1(scheme_func1 func);
+scheme_object * Scheme_CreateCFunc2(scheme_func2 func);
+scheme_object * Scheme_CreateCFunc3(scheme_func3 func);
+
+scheme_object * Scheme_CreateRef(symbol * sym, scheme_define * cell, int depth, int slot);
 
 scheme_object * Scheme_CreateSymbolLiteral(const char * symbol);
 scheme_object * Scheme_CreateStringLiteral(const char * string);
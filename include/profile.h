@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "object.h"
+
+/*
+ * profiling and tiers
+ * the code of every lambda starts out interpreted and profiled: the VM
+ * counts the frames of it entered by calls (calls) and by the tail calls
+ * it makes to itself, the loops of scheme (loops), and each call site
+ * records the kinds of the arguments it has been given in a feedback slot.
+ * once calls and loops together pass scheme_tier_threshold the code is
+ * promoted. it stops collecting feedback and, in a JIT build (see jit.h),
+ * is compiled to machine code whose arithmetic is laid out for the kinds
+ * of numbers its sites have seen. the counts go on for good.
+ *
+ * the call sites are the calls, OP_PRIM0 .. 3 and the inlined arithmetic
+ * (OP_ADD .. OP_GT). the slot of a site is the one at the position in ops
+ * right after its instruction, which is where pc is once the operands
+ * have been read. it holds the kinds of each of the first
+ * SCHEME_FEEDBACK_ARGS arguments, SCHEME_KIND_BITS bits to an argument.
+ *
+ * (procedure-stats f) shows the counts, tier and feedback of a lambda
+ */
+
+#define SCHEME_TIER_THRESHOLD 16
+
+enum {
+	SCHEME_TIER_PROFILED, // interpreted, collecting feedback
+	SCHEME_TIER_HOT,      // promoted, interpreted
+	SCHEME_TIER_COMPILED  // promoted, machine code
+};
+
+enum {
+	SCHEME_KIND_FIXNUM = 1,
+	SCHEME_KIND_FLONUM = 2, // any double, in the pointer or boxed
+	SCHEME_KIND_PAIR   = 4,
+	SCHEME_KIND_OTHER  = 8
+};
+
+#define SCHEME_KIND_BITS     4
+#define SCHEME_FEEDBACK_ARGS 4
+
+typedef uint16_t scheme_feedback;
+
+// the kinds argument i has been seen with
+#define Scheme_FeedbackKinds(slot, i) (((slot) >> ((i) * SCHEME_KIND_BITS)) & 0xf)
+// what a site given two fixnums or two flonums records
+#define SCHEME_FEEDBACK_FIXNUMS (SCHEME_KIND_FIXNUM | SCHEME_KIND_FIXNUM << SCHEME_KIND_BITS)
+#define SCHEME_FEEDBACK_FLONUMS (SCHEME_KIND_FLONUM | SCHEME_KIND_FLONUM << SCHEME_KIND_BITS)
+
+static inline int Scheme_Kind(scheme_object * obj) {
+	if (Scheme_IsFixnum(obj))
+		return SCHEME_KIND_FIXNUM;
+	if (Scheme_IsFlonum(obj))
+		return SCHEME_KIND_FLONUM;
+	switch (Scheme_Type(obj)) {
+	case SCHEME_PAIR:
+		return SCHEME_KIND_PAIR;
+	case SCHEME_NUMBER:
+		return ((scheme_number *)obj->payload)->type == NUMBER_DOUBLE ?
+			SCHEME_KIND_FLONUM : SCHEME_KIND_OTHER;
+	default:
+		return SCHEME_KIND_OTHER;
+	}
+}
+
+// the feedback a site given the n arguments at args records
+static inline scheme_feedback Scheme_ArgumentKinds(scheme_object ** args, int n) {
+	scheme_feedback slot = 0;
+	int i;
+	for (i = 0; i < n && i < SCHEME_FEEDBACK_ARGS; ++i)
+		slot |= Scheme_Kind(args[i]) << (i * SCHEME_KIND_BITS);
+	return slot;
+}
+
+// calls and loops before code is promoted, -1 for never
+extern int scheme_tier_threshold;
+
+// code stops collecting feedback, and is compiled in a JIT build
+void Scheme_Promote(scheme_code * code);
+
+// arguments recorded by the site whose instruction is at op, -1 if it is
+// not a call site
+int Scheme_SiteArgs(scheme_code * code, int op);
+
+// the profile of code as an association list:
+//   ((calls . n) (loops . n) (tier . profiled, hot or compiled)
+//    (sites (position name kinds ...) ...))
+// name is the global a site calls, or the instruction for a call of
+// whatever is on the stack, and kinds a list of the kinds of each
+// argument. NULL on error
+scheme_object * Scheme_ProfileStats(scheme_code * code);
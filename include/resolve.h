@@ -0,0 +1,33 @@
+#pragma once
+
+#include "object.h"
+
+/*
+ * lexical addressing
+ * each top level form is resolved once, before it is evaluated, so every
+ * lambda body is resolved exactly once however many closures are made
+ * from it. evaluated symbols are replaced in place by SCHEME_REF objects:
+ * a variable bound by an enclosing lambda or let becomes the (depth, slot)
+ * of its frame, anything else the cell of its global binding, which is
+ * made unbound if nothing defines it yet.
+ *
+ * a frame holds the arguments or let variables in order, followed by the
+ * internal defines of its body. lambda and let forms get their frame size
+ * as a fixnum and whether the frame is captured as a boolean put in front
+ * of their variable list: (lambda size captured (args ...) body ...).
+ * a frame is captured when a lambda nested in it refers to one of its
+ * variables, only those have to be kept on the heap (see vm.h).
+ * (define (f ...) ...) is rewritten to (define f (lambda ...)).
+ */
+
+typedef struct scheme_scope scheme_scope;
+struct scheme_scope {
+	symbol ** names; // by slot
+	int count, size;
+	char lambda;     // the frame of a lambda call rather than a let
+	char captured;
+	scheme_scope * parent;
+};
+
+// expr is changed in place, its resolved form is returned
+scheme_object * Scheme_Resolve(scheme_object * expr, scheme_object * env);
@@ -6,8 +6,16 @@
 #include "scope.h"
 #include "std.h"
 #include "spec-form.h"
+#include "vm.h"
 
-#define SCHEME_STACK_SIZE 65536
+// calls in each segment of the call stack
+#define SCHEME_STACK_SIZE 4096
+
+// the bytes the call stack and the VM's value stack may take together,
+// recursing any deeper is a stack overflow. make STACK_LIMIT=n sets it
+#ifndef SCHEME_STACK_LIMIT
+#define SCHEME_STACK_LIMIT (1024 * 1024 * 1024)
+#endif
 
 extern scheme_object * SYSTEM_GLOBAL_ENVIRONMENT_OBJ;
 extern scheme_object * USER_INITIAL_ENVIRONMENT_OBJ;
@@ -23,42 +31,55 @@ void Scheme_DefineStartupEnv( void );
 void Scheme_FreeStartupEnv( void );
 
 void Scheme_Display(scheme_object * obj);
+void Scheme_DisplayLambda(scheme_lambda * lambda);
 void Scheme_Newline( void );
 
+// a frame running on the VM, see vm.h
 typedef struct scheme_call {
-	char is_cfunc_call;
-	union {
-		scheme_lambda * proc;
-
-		struct {
-			scheme_cfunc  * cfunc;
-			scheme_object ** args;
-			int arg_count;
-		};
-	};
-
+	scheme_object * proc; // the lambda called, NULL for top level code
+	scheme_code * code;
 	scheme_object * env;
+	scheme_object ** fp;
+	const scheme_op * pc; // where the frame carries on once its callee returns
 } scheme_call;
 
+// the stacks grow in segments allocated as they are needed, so their
+// depth is only limited by scheme_stack_limit. a segment that is left
+// is kept for the next time the stack grows past it
+typedef struct scheme_call_segment scheme_call_segment;
+struct scheme_call_segment {
+	scheme_call_segment * prev;
+	scheme_call_segment * next;
+	scheme_call * end;
+	scheme_call calls[];
+};
+
+extern size_t scheme_stack_limit;
+extern size_t scheme_stack_bytes;
+// counts against scheme_stack_limit, NULL with a stack overflow error
+// once it is reached
+void * Scheme_AllocStack(size_t size);
+void Scheme_FreeStack(void * ptr, size_t size);
+
+// the segment in use, its first call and the top of the stack. segments
+// before it are full
+extern scheme_call_segment * call_segment;
 extern scheme_call * call_stack;
 extern scheme_call * call_stack_end;
-void Scheme_InitCallStack(int stack_size);
+// stack_size calls to a segment, 1 for success, 0 for error
+int  Scheme_InitCallStack(int stack_size);
 void Scheme_FreeCallStack(void);
-int  Scheme_PushCallStack(scheme_call call); // returns 1 if tail call push
-scheme_object * Scheme_PopCallStack(void);
-char Scheme_CanTailCallLambda(scheme_lambda * lambda);
+// returns 1 if a tail call replaced the top frame, -1 on overflow
+int  Scheme_PushCallStack(scheme_call call, char tail);
+// goes back to the segment before once the first call in this one has
+// returned, the call on top of the stack is returned
+scheme_call * Scheme_PopCallSegment(void);
+// drops the calls pushed since call_stack_end was end in segment
+void Scheme_UnwindCallStack(scheme_call_segment * segment, scheme_call * end);
 
 void Scheme_DisplayCallStack(void);
 
-//scheme_call Scheme_GetLambdaCall(scheme_lambda * lambda, scheme_object * obj, scheme_object * env);
-
-scheme_object * Scheme_EvalSExpr(scheme_object * obj, scheme_object * env);
+// resolves, compiles and runs a top level form in a global environment
 scheme_object * Scheme_Eval(scheme_object * obj, scheme_object * env);
-scheme_object * Scheme_Apply(scheme_object * func, scheme_object ** args, int arg_count, scheme_object * env);
-scheme_object * Scheme_ApplyCFunc(scheme_cfunc * cfunc, scheme_object ** args, int arg_count, scheme_object * env);
-scheme_object * Scheme_ApplyCFuncSpecial(scheme_cfunc * cfunc, scheme_object ** args, int arg_count, scheme_object * env);
-scheme_object * Scheme_ApplyLambda(scheme_lambda * lambda, scheme_object ** args, int arg_count, scheme_object * env);
-
-scheme_object * Scheme_CallStack(void);
 
 char Scheme_BoolTest(scheme_object * obj);
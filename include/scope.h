@@ -12,10 +12,27 @@ typedef struct scheme_define {
 	scheme_object * object;
 } scheme_define;
 
+/* Environments
+ * frames made by a lambda call or a let hold only values. code is
+ * resolved before it runs (see resolve.h), so every local reference is
+ * already a (depth, slot) pair and frames never need their names.
+ *
+ * global environments are looked up by symbol. each binding lives in a
+ * cell of its own that never moves, resolved references to a global
+ * point straight at it. a cell whose object is NULL is unbound. cells
+ * is kept in definition order, index is an open addressing hash table
+ * of positions in it keyed on the symbol's cached hash. index is probed
+ * linearly, its size is a power of two and it is at most half full, so
+ * defining and looking up a global costs the same however many there are
+ */
 typedef struct scheme_env scheme_env;
 struct scheme_env {
-	int size, count;
-	scheme_define * defs;
+	int size, count;         // index has size entries, cells room for size/2
+	union {
+		scheme_object ** slots; // frames
+		int * index;            // global environments, -1 where empty
+	};
+	scheme_define ** cells;  // global environments only
 
 	// pointer to parent env
 	scheme_object * parent;
@@ -28,19 +45,25 @@ scheme_define Scheme_CreateDefineString(char * string, scheme_object * obj);
 void Scheme_FreeDefine(scheme_define * scheme_def);
 void Scheme_OverwriteDefine(scheme_define * def, scheme_object * obj);
 
-// definitions in a scheme_environment are sorted by integer values of each
-// definitions sym->str pointer
+// counts the times a global holding a primitive the compiler inlines
+// (see scheme_cfunc) was given another value. code compiled before the
+// last time runs those primitives as ordinary calls again
+extern unsigned int scheme_global_epoch;
 
-scheme_env Scheme_CreateEnv(scheme_object * parent, int init_size);
-scheme_env Scheme_CreateEnvWithoutRef(scheme_object * parent, int init_size);
+scheme_env Scheme_CreateEnv(scheme_object * parent, int size);
+scheme_env Scheme_CreateGlobalEnv(scheme_object * parent, int init_size);
 void Scheme_FreeEnv(scheme_env * env);
 void Scheme_ResizeEnv(scheme_env * env, int new_size);
 
-void Scheme_EraseEnv(scheme_env * env, size_t index);
+#define Scheme_EnvIsGlobal(env) ((env)->cells != NULL)
 
+// global environments only
 void Scheme_DefineEnv(scheme_env * env, scheme_define def);
 scheme_define * Scheme_GetEnv(scheme_env * env, symbol * sym);
 
-int Scheme_EnvIsIndependent(scheme_env * env);
+// the cell sym is bound in by env, made unbound if env has none. a
+// binding env inherits from a parent global environment is copied
+// down, so a later define in env is seen by every reference to it
+scheme_define * Scheme_GetGlobalCell(scheme_env * env, symbol * sym);
 
 void Scheme_DisplayEnv(scheme_env * env);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * slab allocator
+ * fixed size cells for the interpreter's most common allocations are
+ * carved out of large pages instead of going through malloc. each class
+ * keeps its freed cells on a LIFO free list, so the most recently freed
+ * (and most likely cache-hot) cell is handed out next.
+ */
+
+#define SLAB_PAGE_SIZE (64 * 1024)
+
+// pages are aligned to their size so the page, and the card, holding
+// any cell can be found from its address alone. a card is dirtied when
+// an object starting in it is made to point into the nursery
+#define SLAB_CARD_SHIFT 9
+#define SLAB_PAGE_CARDS (SLAB_PAGE_SIZE >> SLAB_CARD_SHIFT)
+
+// a frame with at most this many slots
+// takes its array from the SLAB_FRAME class
+#define SLAB_FRAME_SLOTS 8
+
+enum {
+	// cells of these classes are heap scheme_objects
+	SLAB_PAIR,
+	SLAB_NUMBER,
+	SLAB_ENV,
+	SLAB_LAMBDA,
+	SLAB_STRING,
+	SLAB_SYMBOL,
+	SLAB_CFUNC,
+	SLAB_REF,
+	SLAB_CODE,
+	SLAB_OBJECT_CLASSES,
+
+	SLAB_FRAME = SLAB_OBJECT_CLASSES,
+	SLAB_SYMTAB,
+	SLAB_BINDING,
+
+	SLAB_CLASS_COUNT
+};
+
+typedef struct slab_page slab_page;
+struct slab_page {
+	slab_page * next;
+
+	unsigned char class_id;
+	unsigned char dirty; // any card set, the page is on slab_dirty_pages
+	unsigned char cards[SLAB_PAGE_CARDS];
+};
+
+#define Slab_PageOf(cell) ((slab_page *)((uintptr_t)(cell) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1)))
+#define Slab_CardOf(cell) (((uintptr_t)(cell) & (SLAB_PAGE_SIZE - 1)) >> SLAB_CARD_SHIFT)
+#define Slab_MarkCard(cell) do { \
+	slab_page * card_page = Slab_PageOf(cell); \
+	card_page->cards[Slab_CardOf(cell)] = 1; \
+	if (!card_page->dirty) Slab_AddDirty(card_page); \
+} while (0)
+
+// pages with dirty cards, so finding them costs nothing for clean pages
+extern slab_page ** slab_dirty_pages;
+extern size_t slab_dirty_count;
+void Slab_AddDirty(slab_page * page);
+
+// the free list link is kept in the second word of a free cell so an
+// object's header (and its type) stays readable while it sits on the list
+typedef struct slab_cell slab_cell;
+struct slab_cell {
+	void * header;
+	slab_cell * next;
+};
+
+typedef struct slab_class {
+	const char * name;
+	size_t cell_size;
+
+	slab_cell * free_list;
+	char * bump, * bump_end; // uncarved space in the newest page
+
+	slab_page * pages;
+	size_t page_count;
+	size_t live_count, peak_count;
+} slab_class;
+
+extern slab_class slab_classes[SLAB_CLASS_COUNT];
+
+void Slab_FreeAll(void);
+
+void * Slab_Alloc(int class_id);
+void   Slab_Free(int class_id, void * cell);
+
+// calls func on every cell carved so far, allocated or free
+void   Slab_ForEach(int class_id, void (*func)(void * cell));
+// calls func on the cells starting in a dirty card of any class. the
+// cards are cleared before func is called, which may dirty them again
+void   Slab_ForEachDirty(void (*func)(void * cell));
+
+size_t Slab_Capacity(int class_id);
+void   Slab_DisplayStats(void);
@@ -1,27 +1,44 @@
 #pragma once
 
 #include "object.h"
+#include "compile.h"
+
+// the special_form of a scheme_cfunc, which is only a name the compiler
+// recognises. special forms are never called at run time
+enum {
+	SPECIAL_NONE,
+	SPECIAL_DEFINE,
+	SPECIAL_LAMBDA,
+	SPECIAL_IF,
+	SPECIAL_QUOTE,
+	SPECIAL_COND,
+	SPECIAL_LET
+};
+
+// the operands of the form are objs[0..count), tail is set when the
+// form is in tail position of a lambda body. each compiles the form
+// into c, 1 for success, 0 for error
 
 #define SPEC_DEFINE_ARGC 2
 #define SPEC_DEFINE_DOT 1
-scheme_object * Scheme_Special_Define(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_Define(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
 
-#define SPEC_LAMBDA_ARGC 2
+#define SPEC_LAMBDA_ARGC 4
 #define SPEC_LAMBDA_DOT 1
-scheme_object * Scheme_Special_Lambda(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_Lambda(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
 
 #define SPEC_IF_ARGC 3
 #define SPEC_IF_DOT 0
-scheme_object * Scheme_Special_If(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_If(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
 
 #define SPEC_QUOTE_ARGC 1
 #define SPEC_QUOTE_DOT 0
-scheme_object * Scheme_Special_Quote(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_Quote(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
 
 #define SPEC_COND_ARGC 0
 #define SPEC_COND_DOT 1
-scheme_object * Scheme_Special_Cond(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_Cond(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
 
-#define SPEC_LET_ARGC 2
+#define SPEC_LET_ARGC 4
 #define SPEC_LET_DOT 1
-scheme_object * Scheme_Special_Let(scheme_object ** objs, scheme_object* env, size_t count);
+int Scheme_Special_Let(scheme_object ** objs, size_t count, scheme_compiler * c, char tail);
@@ -2,53 +2,66 @@
 
 #include "object.h"
 
-scheme_object * __Exit__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Exit__(void);
 
-scheme_object * __Scheme_cons__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_car__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_cdr__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Scheme_cons__(scheme_object * car, scheme_object * cdr);
+scheme_object * __Scheme_car__(scheme_object * pair);
+scheme_object * __Scheme_cdr__(scheme_object * pair);
+scheme_object * __Scheme_SetCar__(scheme_object * pair, scheme_object * obj);
+scheme_object * __Scheme_SetCdr__(scheme_object * pair, scheme_object * obj);
 //scheme_object * __Scheme_caar__(scheme_object ** objs, scheme_object * env, size_t count);
 //scheme_object * __Scheme_cddr__(scheme_object ** objs, scheme_object * env, size_t count);
 
 scheme_object * __Scheme_List__(scheme_object ** objs, scheme_object * env, size_t count);
 
-scheme_object * __Pred_eq__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Pred_null__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Pred_eq__(scheme_object * a, scheme_object * b);
+scheme_object * __Pred_null__(scheme_object * obj);
 
 void __Math_Complement__(scheme_number * left, scheme_number * right);
 
-long long gcd(long long a, long long b);
+unsigned long long gcd(unsigned long long a, unsigned long long b);
 
 void __IntToRational__(scheme_number * num);
 void __IntToDouble__(scheme_number * num);
 void __RationalToDouble__(scheme_number * num);
-void __NormaliseRational__(scheme_number * num);
+void __BigintToDouble__(scheme_number * num);
+void __BigRationalToDouble__(scheme_number * num);
+// any number as a double
+void __ToDouble__(scheme_number * num);
 
 scheme_object * __Scheme_CallAdd__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallSub__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallMul__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallDiv__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_Add__(scheme_number * nums, int count);
-scheme_object * __Scheme_Sub__(scheme_number * nums, int count);
-scheme_object * __Scheme_Mul__(scheme_number * nums, int count);
-scheme_object * __Scheme_Div__(scheme_number * nums, int count);
+scheme_object * __Scheme_Add__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Sub__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Mul__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Div__(scheme_object ** objs, int count);
 
 scheme_object * __Scheme_CallAEqual__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallALessThan__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallALessThanEqual__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallAGreaterThan__(scheme_object ** objs, scheme_object * env, size_t count);
 scheme_object * __Scheme_CallAGreaterThanEqual__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_Arithmetic_Equal__(scheme_number * nums, int count);
-scheme_object * __Scheme_Arithmetic_LessThan__(scheme_number * nums, int count);
-scheme_object * __Scheme_Arithmetic_LessThanEqual__(scheme_number * nums, int count);
-scheme_object * __Scheme_Arithmetic_GreaterThan__(scheme_number * nums, int count);
-scheme_object * __Scheme_Arithmetic_GreaterThanEqual__(scheme_number * nums, int count);
+scheme_object * __Scheme_Arithmetic_Equal__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Arithmetic_LessThan__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Arithmetic_LessThanEqual__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Arithmetic_GreaterThan__(scheme_object ** objs, int count);
+scheme_object * __Scheme_Arithmetic_GreaterThanEqual__(scheme_object ** objs, int count);
 
-scheme_object * __Scheme_Quotient__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_Modulo(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_Remainder__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Flonum_Add__(scheme_object * a, scheme_object * b);
+scheme_object * __Flonum_Sub__(scheme_object * a, scheme_object * b);
+scheme_object * __Flonum_Mul__(scheme_object * a, scheme_object * b);
+scheme_object * __Flonum_LessThan__(scheme_object * a, scheme_object * b);
 
-scheme_object * __Scheme_CallDisplay__(scheme_object ** objs, scheme_object * env, size_t count);
-scheme_object * __Scheme_CallNewline__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Scheme_Quotient__(scheme_object * dividend, scheme_object * divisor);
+scheme_object * __Scheme_Modulo(scheme_object * dividend, scheme_object * divisor);
+scheme_object * __Scheme_Remainder__(scheme_object * dividend, scheme_object * divisor);
 
-scheme_object * __Scheme_Load__(scheme_object ** objs, scheme_object * env, size_t count);
+scheme_object * __Scheme_CallDisplay__(scheme_object * obj);
+scheme_object * __Scheme_CallNewline__(void);
+
+scheme_object * __Scheme_Load__(scheme_object * path);
+scheme_object * __Scheme_CollectCycles__(void);
+scheme_object * __Scheme_Disassemble__(scheme_object * proc);
+scheme_object * __Scheme_ProcedureStats__(scheme_object * proc);
@@ -8,13 +8,18 @@
 // once a symbol has been made, it will live on
 // until it has no more references
 
-// sym_table is sorted by char* string pointers integer values
+// sym_table is an open addressing hash table keyed on the string
+// contents, probed linearly. its size is always a power of two and
+// it is kept at most half full
 
 typedef struct symbol {
 	char * str;
+	size_t hash; // SymbolHash(str), cached for probing and resizing
 	int ref_count;
 } symbol;
 
+size_t SymbolHash(const char * str);
+
 symbol* CreateSymbol(char * str);
 void    FreeSymbol(symbol * sym);
 
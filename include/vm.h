@@ -0,0 +1,152 @@
+#pragma once
+
+#include "object.h"
+
+/*
+ * virtual machine
+ * compiled code (see compile.h) runs on a stack machine. every value it
+ * works on lives on the value stack, each call owns a frame there
+ * holding, from fp up:
+ *   fp[0 .. arg_count)      the arguments
+ *   fp[.. frame_size)       internal defines and let variables, which
+ *                           start out NULL (unbound)
+ *   fp[frame_size ..)       operands of the expressions being evaluated
+ * fp[-1] holds the procedure being called, popped together with the
+ * frame when it returns. only a frame captured by a nested lambda (see
+ * resolve.h) is moved to a heap environment, as is a captured let.
+ *
+ * a call_stack entry describes each running frame: its procedure, its
+ * environment (innermost heap frame, or the closure's), fp, and where to
+ * carry on once the frame it called returns. lambdas call each other
+ * without recursing in C, the VM only returns to C once the frame
+ * Scheme_Execute pushed returns, so recursion is only as deep as the
+ * memory the stacks are allowed.
+ *
+ * each instruction is an opcode followed by its operands, all scheme_op
+ */
+
+enum {
+	OP_CONST,          // k         push consts[k]
+	OP_LOCAL,          // n         push fp[n]
+	OP_SET_LOCAL,      // n         pop into fp[n]
+	OP_UNBIND,         // n         fp[n] = NULL
+	OP_ENV,            // d s       push slot s of the heap frame d up from env
+	OP_SET_ENV,        // s         pop into slot s of env
+	OP_GLOBAL,         // c         push the value of cells[c]
+	OP_DEFINE_GLOBAL,  // c         pop into cells[c]
+	OP_POP,
+	OP_DUP,
+	OP_JUMP,           // pc
+	OP_JUMP_IF_FALSE,  // pc        pop, jump if false
+	OP_CLOSURE,        // k         push a lambda of consts[k] closing over env
+	OP_MAKE_ENV,       // n size    pop n values into a new heap frame, make it env
+	OP_POP_ENV,        //           env = its parent
+	OP_CALL,           // n         call the procedure below n arguments
+	OP_TAIL_CALL,      // n         same, replacing the frame making the call,
+	                   //           a primitive's value is returned from it
+	OP_RETURN,         //           pop the frame, push the value on top
+
+	// superinstructions, picked from the pairs make VMSTATS=1 found most
+	// often in the benchmarks. a call to a global whose arguments are all
+	// locals (L) or constants (K) is one instruction:
+	OP_CALL_GLOBAL_L,  // c a       (cells[c] fp[a])
+	OP_CALL_GLOBAL_LL, // c a b     (cells[c] fp[a] fp[b])
+	OP_CALL_GLOBAL_LK, // c a k     (cells[c] fp[a] consts[k])
+	OP_CALL_GLOBAL_KL, // c k a     (cells[c] consts[k] fp[a])
+	// and a call followed by OP_JUMP_IF_FALSE gets a /jif variant. the
+	// jump is left in place after it: a primitive's value is tested and
+	// the jump skipped or taken right away, a lambda returns to the jump
+	OP_CALL_JIF,
+	OP_CALL_GLOBAL_L_JIF,
+	OP_CALL_GLOBAL_LL_JIF,
+	OP_CALL_GLOBAL_LK_JIF,
+	OP_CALL_GLOBAL_KL_JIF,
+
+	// a call to a global holding a primitive with a fixed entry point (see
+	// scheme_cfunc) that takes as many arguments as it is given. the
+	// arguments are on the stack without the procedure below them, which
+	// is called directly as long as cells[c] still holds consts[k]
+	OP_PRIM0,          // c k
+	OP_PRIM1,          // c k
+	OP_PRIM2,          // c k
+	OP_PRIM3,          // c k
+
+	// primitives run inline, each taking its arguments from the stack in
+	// place of a call to the global in cells[c] (see scheme_cfunc). this
+	// is only done in code compiled since scheme_global_epoch last changed,
+	// otherwise the global is called with room left below the arguments.
+	// fixnums and flonums are handled without a call, other numbers by
+	// the primitive
+	OP_ADD,            // c         (+ a b)
+	OP_SUB,            // c         (- a b)
+	OP_NUM_EQ,         // c         (= a b)
+	OP_LT,             // c         (< a b)
+	OP_GT,             // c         (> a b)
+	OP_CONS,           // c         (cons a b)
+	OP_CAR,            // c         (car a)
+	OP_CDR,            // c         (cdr a)
+	OP_NULLP,          // c         (null? a)
+	// the flonum primitives, doubles held in the pointer (see object.h)
+	// are worked on without a call
+	OP_FL_ADD,         // c         (fl+ a b)
+	OP_FL_SUB,         // c         (fl- a b)
+	OP_FL_MUL,         // c         (fl* a b)
+	OP_FL_LT,          // c         (fl< a b)
+	// tests followed by OP_JUMP_IF_FALSE jump straight away, like /jif calls
+	OP_NUM_EQ_JIF,
+	OP_LT_JIF,
+	OP_GT_JIF,
+	OP_NULLP_JIF,
+	OP_FL_LT_JIF,
+	OP_COUNT
+};
+
+typedef struct scheme_op_info {
+	const char * name;
+	int operands;
+	int stack;         // values pushed less values popped, calls excepted
+} scheme_op_info;
+
+extern const scheme_op_info scheme_ops[OP_COUNT];
+
+// slots in each segment of the value stack
+#define VM_STACK_SIZE 65536
+
+// the value stack grows in segments like the call stack (see scheme.h).
+// a frame never straddles two: when one has no room left for a frame
+// the procedure and arguments are moved to the start of the next, the
+// values below them stay where they are, up to top
+typedef struct scheme_stack_segment scheme_stack_segment;
+struct scheme_stack_segment {
+	scheme_stack_segment * prev;
+	scheme_stack_segment * next;
+	scheme_object ** end;
+	scheme_object ** top; // where the values stop while a later segment is in use
+	scheme_object * slots[];
+};
+
+// the segment in use, and its first slot and end
+extern scheme_stack_segment * vm_segment;
+extern scheme_object ** vm_stack;
+extern scheme_object ** vm_stack_end;
+// top of the value stack, everything below it is a root
+extern scheme_object ** vm_sp;
+
+// stack_size slots to a segment, 1 for success, 0 for error
+int  Scheme_InitVM(int stack_size);
+void Scheme_FreeVM(void);
+
+// runs code (made by Scheme_Compile) with env as its environment, the
+// value of its last form is returned, NULL on error. both stacks are
+// left as they were either way
+scheme_object * Scheme_Execute(scheme_object * code, scheme_object * env);
+
+#ifdef SCHEME_VM_STATS
+// instructions run per opcode and per pair of adjacent opcodes
+extern unsigned long long vm_op_counts[OP_COUNT];
+extern unsigned long long vm_pair_counts[OP_COUNT][OP_COUNT];
+void Scheme_DisplayVMStats(void);
+#endif
+
+// prints code and the code of the lambdas in it
+void Scheme_Disassemble(scheme_code * code);
@@ -0,0 +1,1042 @@
+#include <math.h>
+#include <limits.h>
+
+#include "bigint.h"
+#include "scheme.h"
+#include "gc.h"
+#include "std.h"
+
+typedef uint64_t bigint_dlimb;
+
+#define BIGINT_BASE ((bigint_dlimb)1 << 32)
+
+/* Limbs
+ * the arithmetic below works on magnitudes, arrays of limbs with a size
+ * kept apart. the high limbs of an intermediate result may be 0
+ */
+
+// scratch space for the limb routines, which have no way to hand an
+// error back. as when the collector cannot promote an object, running out
+// here ends the program
+static void * Bigint_Scratch(size_t size) {
+	void * p = malloc(size);
+	if (!p) {
+		fputs("out of memory in bignum arithmetic\n", stderr);
+		exit(1);
+	}
+	return p;
+}
+
+// size of a[0..n) without its high zero limbs
+static int Bigint_Trim(const bigint_limb * a, int n) {
+	while (n > 0 && a[n - 1] == 0)
+		--n;
+	return n;
+}
+
+static int Bigint_CompareLimbs(const bigint_limb * a, int an, const bigint_limb * b, int bn) {
+	an = Bigint_Trim(a, an);
+	bn = Bigint_Trim(b, bn);
+	if (an != bn)
+		return an < bn ? -1 : 1;
+	while (an--)
+		if (a[an] != b[an])
+			return a[an] < b[an] ? -1 : 1;
+	return 0;
+}
+
+// r[0..an] = a + b, an >= bn
+static void Bigint_AddLimbs(bigint_limb * r, const bigint_limb * a, int an,
+	const bigint_limb * b, int bn)
+{
+	bigint_dlimb carry = 0;
+	int i;
+	for (i = 0; i < bn; ++i) {
+		carry += (bigint_dlimb)a[i] + b[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+	for (; i < an; ++i) {
+		carry += a[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+	r[an] = (bigint_limb)carry;
+}
+
+// r[0..an) = a - b, a >= b and an >= bn. r may be a
+static void Bigint_SubLimbs(bigint_limb * r, const bigint_limb * a, int an,
+	const bigint_limb * b, int bn)
+{
+	// a limb that goes below 0 wraps around into the high half
+	bigint_limb borrow = 0;
+	int i;
+	for (i = 0; i < bn; ++i) {
+		bigint_dlimb d = (bigint_dlimb)a[i] - b[i] - borrow;
+		r[i] = (bigint_limb)d;
+		borrow = (d >> 32) != 0;
+	}
+	for (; i < an; ++i) {
+		bigint_dlimb d = (bigint_dlimb)a[i] - borrow;
+		r[i] = (bigint_limb)d;
+		borrow = (d >> 32) != 0;
+	}
+}
+
+// r[0..rn) += a[0..an), an <= rn and the sum fits
+static void Bigint_AddTo(bigint_limb * r, int rn, const bigint_limb * a, int an) {
+	bigint_dlimb carry = 0;
+	int i;
+	for (i = 0; i < an; ++i) {
+		carry += (bigint_dlimb)r[i] + a[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+	for (; carry && i < rn; ++i) {
+		carry += r[i];
+		r[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+}
+
+// r[0..rn) -= a[0..an), r >= a
+static void Bigint_SubFrom(bigint_limb * r, int rn, const bigint_limb * a, int an) {
+	Bigint_SubLimbs(r, r, rn, a, an);
+}
+
+// a[0..n) -= 1, a > 0
+static void Bigint_DecLimbs(bigint_limb * a, int n) {
+	int i;
+	for (i = 0; i < n && a[i]-- == 0; ++i)
+		;
+}
+
+// r[0..n] = a[0..n) << s, s < 32
+static void Bigint_ShiftLeft(bigint_limb * r, const bigint_limb * a, int n, int s) {
+	bigint_limb carry = 0;
+	int i;
+	for (i = 0; i < n; ++i) {
+		bigint_limb l = a[i];
+		r[i] = (l << s) | carry;
+		carry = s ? l >> (32 - s) : 0;
+	}
+	r[n] = carry;
+}
+
+// r[0..n) = a[0..n) >> s, s < 32
+static void Bigint_ShiftRight(bigint_limb * r, const bigint_limb * a, int n, int s) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		r[i] = a[i] >> s;
+		if (s && i + 1 < n)
+			r[i] |= a[i + 1] << (32 - s);
+	}
+}
+
+// a[0..n) = a * m + add, returns the limb carried out
+static bigint_limb Bigint_MulAddLimb(bigint_limb * a, int n, bigint_limb m, bigint_limb add) {
+	bigint_dlimb carry = add;
+	int i;
+	for (i = 0; i < n; ++i) {
+		carry += (bigint_dlimb)a[i] * m;
+		a[i] = (bigint_limb)carry;
+		carry >>= 32;
+	}
+	return (bigint_limb)carry;
+}
+
+// a[0..n) /= d, returns the remainder
+static bigint_limb Bigint_DivLimb(bigint_limb * a, int n, bigint_limb d) {
+	bigint_dlimb rem = 0;
+	while (n--) {
+		bigint_dlimb cur = (rem << 32) | a[n];
+		a[n] = (bigint_limb)(cur / d);
+		rem = cur % d;
+	}
+	return (bigint_limb)rem;
+}
+
+/* Multiplication */
+
+static void Bigint_MulSchool(bigint_limb * r, const bigint_limb * a, int an,
+	const bigint_limb * b, int bn)
+{
+	memset(r, 0, sizeof(bigint_limb) * (an + bn));
+
+	int i, j;
+	for (i = 0; i < bn; ++i) {
+		bigint_dlimb carry = 0, m = b[i];
+		if (!m)
+			continue;
+		for (j = 0; j < an; ++j) {
+			carry += a[j] * m + r[i + j];
+			r[i + j] = (bigint_limb)carry;
+			carry >>= 32;
+		}
+		r[i + an] = (bigint_limb)carry;
+	}
+}
+
+// r[0..an + bn) = a * b, r is apart from both
+static void Bigint_MulLimbs(bigint_limb * r, const bigint_limb * a, int an,
+	const bigint_limb * b, int bn)
+{
+	if (an < bn) {
+		const bigint_limb * t = a;
+		a = b;
+		b = t;
+		int tn = an;
+		an = bn;
+		bn = tn;
+	}
+
+	if (bn < BIGINT_KARATSUBA_LIMBS) {
+		Bigint_MulSchool(r, a, an, b, bn);
+		return;
+	}
+
+	int h = (an + 1) / 2;
+	if (bn <= h) {
+		// lopsided, a is multiplied a piece as long as b at a time
+		memset(r, 0, sizeof(bigint_limb) * (an + bn));
+		bigint_limb * t = Bigint_Scratch(sizeof(bigint_limb) * 2 * bn);
+		int i;
+		for (i = 0; i < an; i += bn) {
+			int n = an - i < bn ? an - i : bn;
+			Bigint_MulLimbs(t, a + i, n, b, bn);
+			Bigint_AddTo(r + i, an + bn - i, t, n + bn);
+		}
+		free(t);
+		return;
+	}
+
+	// with a = a1 B^h + a0 and b = b1 B^h + b0, where B is the limb base,
+	// a b = z2 B^2h + ((a0 + a1)(b0 + b1) - z2 - z0) B^h + z0, three
+	// products of half the size instead of four. z0 = a0 b0 and z2 = a1 b1
+	// go straight into r, they do not overlap
+	int n2 = an + bn - 2 * h;
+	Bigint_MulLimbs(r, a, h, b, h);
+	Bigint_MulLimbs(r + 2 * h, a + h, an - h, b + h, bn - h);
+
+	bigint_limb * sa = Bigint_Scratch(sizeof(bigint_limb) * (4 * h + 4));
+	bigint_limb * sb = sa + h + 1;
+	bigint_limb * z1 = sb + h + 1;
+	Bigint_AddLimbs(sa, a, h, a + h, an - h);
+	Bigint_AddLimbs(sb, b, h, b + h, bn - h);
+	Bigint_MulLimbs(z1, sa, h + 1, sb, h + 1);
+	Bigint_SubFrom(z1, 2 * h + 2, r, 2 * h);
+	Bigint_SubFrom(z1, 2 * h + 2, r + 2 * h, n2);
+	Bigint_AddTo(r + h, an + bn - h, z1, Bigint_Trim(z1, 2 * h + 2));
+	free(sa);
+}
+
+/* Division */
+
+// Knuth's algorithm D: q[0..un - vn] = u[0..un) / v[0..vn), the remainder
+// is left in u[0..vn). v is normalised, its top bit set, vn >= 2, and u
+// has a limb u[un] to spare above the dividend (which may hold its top)
+static void Bigint_DivKnuth(bigint_limb * q, bigint_limb * u, int un,
+	const bigint_limb * v, int vn)
+{
+	bigint_dlimb vtop = v[vn - 1], vnext = v[vn - 2];
+	int i, j;
+	for (j = un - vn; j >= 0; --j) {
+		// the quotient limb estimated from the top limbs is at most one
+		// too large after this
+		bigint_dlimb num = ((bigint_dlimb)u[j + vn] << 32) | u[j + vn - 1];
+		bigint_dlimb qhat = num / vtop, rhat = num % vtop;
+		while (qhat >= BIGINT_BASE || qhat * vnext > ((rhat << 32) | u[j + vn - 2])) {
+			--qhat;
+			rhat += vtop;
+			if (rhat >= BIGINT_BASE)
+				break;
+		}
+
+		// u -= qhat v
+		int64_t borrow = 0, t;
+		for (i = 0; i < vn; ++i) {
+			bigint_dlimb p = qhat * v[i];
+			t = (int64_t)u[i + j] - borrow - (int64_t)(p & 0xffffffff);
+			u[i + j] = (bigint_limb)t;
+			borrow = (int64_t)(p >> 32) - (t >> 32);
+		}
+		t = (int64_t)u[j + vn] - borrow;
+		u[j + vn] = (bigint_limb)t;
+
+		// it was, v goes back on
+		if (t < 0) {
+			--qhat;
+			bigint_dlimb carry = 0;
+			for (i = 0; i < vn; ++i) {
+				carry += (bigint_dlimb)u[i + j] + v[i];
+				u[i + j] = (bigint_limb)carry;
+				carry >>= 32;
+			}
+			u[j + vn] += (bigint_limb)carry;
+		}
+		q[j] = (bigint_limb)qhat;
+	}
+}
+
+static void Bigint_Div3n2n(bigint_limb * q, bigint_limb * r, const bigint_limb * a,
+	const bigint_limb * b, int k);
+
+// Burnikel and Ziegler: q[0..n) and r[0..n) from a[0..2n) / b[0..n), b
+// normalised and a < b B^n. a is divided in two steps of 3 halves by 2,
+// each of which takes a division of half the size and a multiplication
+static void Bigint_Div2n1n(bigint_limb * q, bigint_limb * r, const bigint_limb * a,
+	const bigint_limb * b, int n)
+{
+	if (n % 2 || n < BIGINT_BZ_LIMBS) {
+		bigint_limb * u = Bigint_Scratch(sizeof(bigint_limb) * (3 * n + 2));
+		bigint_limb * qq = u + 2 * n + 1;
+		memcpy(u, a, sizeof(bigint_limb) * 2 * n);
+		u[2 * n] = 0;
+		Bigint_DivKnuth(qq, u, 2 * n, b, n);
+		memcpy(q, qq, sizeof(bigint_limb) * n);
+		memcpy(r, u, sizeof(bigint_limb) * n);
+		free(u);
+		return;
+	}
+
+	// the top three quarters of a first, then the remainder followed by
+	// the last quarter
+	int h = n / 2;
+	bigint_limb * t = Bigint_Scratch(sizeof(bigint_limb) * 3 * h);
+	Bigint_Div3n2n(q + h, t + h, a + h, b, h);
+	memcpy(t, a, sizeof(bigint_limb) * h);
+	Bigint_Div3n2n(q, r, t, b, h);
+	free(t);
+}
+
+// q[0..k) and r[0..2k) from a[0..3k) / b[0..2k), b normalised and a < b B^k
+static void Bigint_Div3n2n(bigint_limb * q, bigint_limb * r, const bigint_limb * a,
+	const bigint_limb * b, int k)
+{
+	// with a = [a1 a2 a3] and b = [b1 b2], most significant first, q is
+	// estimated from [a1 a2] / b1. the remainder r1 B^k + a3 - q b2 is
+	// worked out in rh, with room for what is added while it is below 0
+	const bigint_limb * a1 = a + 2 * k, * b1 = b + k;
+	int rn = 2 * k + 2;
+	bigint_limb * rh = Bigint_Scratch(sizeof(bigint_limb) * (rn + 2 * k));
+	bigint_limb * d = rh + rn;
+	memset(rh, 0, sizeof(bigint_limb) * rn);
+	memcpy(rh, a, sizeof(bigint_limb) * k);
+
+	if (Bigint_CompareLimbs(a1, k, b1, k) < 0) {
+		Bigint_Div2n1n(q, rh + k, a + k, b1, k);
+	} else {
+		// a1 = b1, q = B^k - 1 and r1 = [a1 a2] - q b1 = a2 + b1
+		memset(q, 0xff, sizeof(bigint_limb) * k);
+		Bigint_AddLimbs(rh + k, a + k, k, b1, k);
+	}
+
+	// the estimate is at most 2 too large
+	Bigint_MulLimbs(d, q, k, b, k);
+	while (Bigint_CompareLimbs(rh, rn, d, 2 * k) < 0) {
+		Bigint_AddTo(rh, rn, b, 2 * k);
+		Bigint_DecLimbs(q, k);
+	}
+	Bigint_SubFrom(rh, rn, d, 2 * k);
+	memcpy(r, rh, sizeof(bigint_limb) * 2 * k);
+	free(rh);
+}
+
+// q[0..an - bn] = a / b and r[0..bn) = a % b, an >= bn and b[bn - 1] != 0
+static void Bigint_DivLimbs(bigint_limb * q, bigint_limb * r, const bigint_limb * a, int an,
+	const bigint_limb * b, int bn)
+{
+	if (bn == 1) {
+		memcpy(q, a, sizeof(bigint_limb) * an);
+		r[0] = Bigint_DivLimb(q, an, b[0]);
+		return;
+	}
+
+	// both are shifted until the top bit of b is set
+	int s = __builtin_clz(b[bn - 1]);
+
+	if (bn < BIGINT_BZ_LIMBS || an - bn < BIGINT_BZ_LIMBS) {
+		bigint_limb * u = Bigint_Scratch(sizeof(bigint_limb) * (an + 1 + bn));
+		bigint_limb * v = u + an + 1;
+		Bigint_ShiftLeft(u, a, an, s);
+		Bigint_ShiftLeft(v, b, bn - 1, s);
+		v[bn - 1] = (b[bn - 1] << s) | (s ? b[bn - 2] >> (32 - s) : 0);
+		Bigint_DivKnuth(q, u, an, v, bn);
+		Bigint_ShiftRight(r, u, bn, s);
+		free(u);
+		return;
+	}
+
+	// and padded with low zero limbs to n = j 2^m limbs, j below
+	// BIGINT_BZ_LIMBS, so the recursion can halve it all the way down
+	int m = 0;
+	while ((bn + (1 << m) - 1) >> m >= BIGINT_BZ_LIMBS)
+		++m;
+	int n = ((bn + (1 << m) - 1) >> m) << m;
+	int pad = n - bn;
+
+	// a is taken n limbs at a time, the top block is 0 in its top limb and
+	// so less than b
+	int blocks = (an + 1 + pad) / n + 1;
+	size_t u_size = sizeof(bigint_limb) * ((size_t)blocks * n + n + 1);
+	size_t qq_size = sizeof(bigint_limb) * ((size_t)blocks * n + 3 * n);
+	bigint_limb * u = memset(Bigint_Scratch(u_size), 0, u_size);
+	bigint_limb * v = u + blocks * n;
+	bigint_limb * qq = memset(Bigint_Scratch(qq_size), 0, qq_size);
+	bigint_limb * z = qq + blocks * n;
+	bigint_limb * rem = z + 2 * n;
+	Bigint_ShiftLeft(u + pad, a, an, s);
+	Bigint_ShiftLeft(v + pad, b, bn, s);
+
+	memcpy(z, u + (blocks - 2) * n, sizeof(bigint_limb) * 2 * n);
+	int i;
+	for (i = blocks - 2; i >= 0; --i) {
+		Bigint_Div2n1n(qq + i * n, rem, z, v, n);
+		memcpy(z + n, rem, sizeof(bigint_limb) * n);
+		if (i)
+			memcpy(z, u + (i - 1) * n, sizeof(bigint_limb) * n);
+	}
+
+	memcpy(q, qq, sizeof(bigint_limb) * (an - bn + 1));
+	Bigint_ShiftRight(r, rem + pad, bn, s);
+	free(u);
+	free(qq);
+}
+
+/* Numbers */
+
+// an exact integer as limbs and a sign, a long long gets limbs of its own
+typedef struct bigint_view {
+	const bigint_limb * limbs;
+	int size;
+	char negative;
+	bigint_limb small[2];
+} bigint_view;
+
+static void Bigint_ViewLong(bigint_view * v, long long i) {
+	unsigned long long m = i < 0 ? 0 - (unsigned long long)i : (unsigned long long)i;
+	v->negative = i < 0;
+	v->small[0] = (bigint_limb)m;
+	v->small[1] = (bigint_limb)(m >> 32);
+	v->limbs = v->small;
+	v->size = Bigint_Trim(v->small, 2);
+}
+
+static void Bigint_View(bigint_view * v, scheme_number * num) {
+	if (num->type == NUMBER_BIGINT) {
+		v->limbs = num->bigint_val->limbs;
+		v->size = num->bigint_val->size;
+		v->negative = num->bigint_val->negative;
+		return;
+	}
+
+	Bigint_ViewLong(v, num->integer_val);
+}
+
+static int Bigint_IsInteger(scheme_number * num) {
+	return num->type == NUMBER_INTEGER || num->type == NUMBER_BIGINT;
+}
+
+// 1 if limbs[0..size) with a sign fits a long long, which is left in *value
+static int Bigint_FitsLong(const bigint_limb * limbs, int size, char negative, long long * value) {
+	size = Bigint_Trim(limbs, size);
+	if (size > 2)
+		return 0;
+
+	unsigned long long m = size ? limbs[0] : 0;
+	if (size == 2)
+		m |= (unsigned long long)limbs[1] << 32;
+	if (m > LLONG_MAX && !(negative && m - 1 == LLONG_MAX))
+		return 0;
+	*value = negative && m ? -(long long)(m - 1) - 1 : (long long)m;
+	return 1;
+}
+
+static scheme_bigint * Bigint_Alloc(int size) {
+	scheme_bigint * big = malloc(sizeof(scheme_bigint) + sizeof(bigint_limb) * (size ? size : 1));
+	if (!big)
+		Scheme_SetError("runtime malloc(bigint) error");
+	return big;
+}
+
+// the number made of size limbs of big and a sign, big is handed over to
+// it or freed
+static scheme_object * Bigint_Finish(scheme_bigint * big, int size, char negative) {
+	long long value;
+	if (Bigint_FitsLong(big->limbs, size, negative, &value)) {
+		free(big);
+		return Scheme_CreateInteger(value);
+	}
+
+	big->size = Bigint_Trim(big->limbs, size);
+	big->negative = negative;
+	return Scheme_CreateBigint(big);
+}
+
+// a + b, or a - b when negate is set
+static scheme_object * Bigint_AddSigned(scheme_number * a, scheme_number * b, char negate) {
+	bigint_view x, y;
+	Bigint_View(&x, a);
+	Bigint_View(&y, b);
+	y.negative ^= negate && y.size;
+
+	// the magnitudes are added or the smaller taken from the larger
+	const bigint_view * big = &x, * small = &y;
+	if (Bigint_CompareLimbs(x.limbs, x.size, y.limbs, y.size) < 0) {
+		big = &y;
+		small = &x;
+	}
+
+	scheme_bigint * r = Bigint_Alloc(big->size + 1);
+	if (!r)
+		return NULL;
+	if (x.negative == y.negative)
+		Bigint_AddLimbs(r->limbs, big->limbs, big->size, small->limbs, small->size);
+	else
+		Bigint_SubLimbs(r->limbs, big->limbs, big->size, small->limbs, small->size);
+	return Bigint_Finish(r, x.negative == y.negative ? big->size + 1 : big->size, big->negative);
+}
+
+static scheme_object * Bigint_MulIntegers(scheme_number * a, scheme_number * b) {
+	bigint_view x, y;
+	Bigint_View(&x, a);
+	Bigint_View(&y, b);
+	if (!x.size || !y.size)
+		return Scheme_MakeFixnum(0);
+
+	scheme_bigint * r = Bigint_Alloc(x.size + y.size);
+	if (!r)
+		return NULL;
+	Bigint_MulLimbs(r->limbs, x.limbs, x.size, y.limbs, y.size);
+	return Bigint_Finish(r, x.size + y.size, x.negative != y.negative);
+}
+
+int Bigint_DivMod(scheme_number * a, scheme_number * b,
+	scheme_object ** quotient, scheme_object ** remainder)
+{
+	bigint_view x, y;
+	Bigint_View(&x, a);
+	Bigint_View(&y, b);
+	if (!y.size) {
+		Scheme_SetError("division by zero");
+		return 0;
+	}
+
+	scheme_object * q = NULL, * r = NULL;
+	if (Bigint_CompareLimbs(x.limbs, x.size, y.limbs, y.size) < 0) {
+		q = Scheme_MakeFixnum(0);
+		if (remainder && !(r = Scheme_CreateNumber(a)))
+			return 0;
+	} else {
+		scheme_bigint * qb = Bigint_Alloc(x.size - y.size + 1);
+		scheme_bigint * rb = Bigint_Alloc(y.size);
+		if (!qb || !rb) {
+			free(qb);
+			free(rb);
+			return 0;
+		}
+		Bigint_DivLimbs(qb->limbs, rb->limbs, x.limbs, x.size, y.limbs, y.size);
+
+		// the remainder is kept alive while the quotient is made
+		if (remainder) {
+			if (!(r = Bigint_Finish(rb, y.size, x.negative))) {
+				free(qb);
+				return 0;
+			}
+		} else {
+			free(rb);
+		}
+
+		if (quotient) {
+			GC_PROTECT(r);
+			q = Bigint_Finish(qb, x.size - y.size + 1, x.negative != y.negative);
+			GC_UNPROTECT(1);
+			if (!q)
+				return 0;
+		} else {
+			free(qb);
+		}
+	}
+
+	if (quotient)
+		*quotient = q;
+	if (remainder)
+		*remainder = r;
+	return 1;
+}
+
+static int Bigint_CompareSigned(const bigint_limb * a, int an, char a_negative,
+	const bigint_limb * b, int bn, char b_negative)
+{
+	if (a_negative != b_negative)
+		return a_negative ? -1 : 1;
+
+	int cmp = Bigint_CompareLimbs(a, an, b, bn);
+	return a_negative ? -cmp : cmp;
+}
+
+/* Rationals
+ * a rational is worked on as a numerator and denominator copied out of
+ * the number. the gcd of the denominators is taken out before adding,
+ * and the cross gcds of numerators and denominators before multiplying
+ * (Knuth 4.5.1), so what comes out is in lowest terms without a gcd of
+ * the full result. the gcds taken are mostly of a small number
+ */
+
+// limbs[0..size) with a sign, copied. like the rest below NULL when out
+// of memory
+static scheme_bigint * Bigint_New(const bigint_limb * limbs, int size, char negative) {
+	size = Bigint_Trim(limbs, size);
+	scheme_bigint * big = Bigint_Alloc(size);
+	if (!big)
+		return NULL;
+	memcpy(big->limbs, limbs, sizeof(bigint_limb) * size);
+	big->size = size;
+	big->negative = negative && size;
+	return big;
+}
+
+static int Bigint_IsOne(const scheme_bigint * big) {
+	return big->size == 1 && big->limbs[0] == 1 && !big->negative;
+}
+
+// the numerator and denominator of an exact number. 1 for success, 0
+// with neither made when out of memory
+static int Bigint_Ratio(scheme_number * num, scheme_bigint ** numerator, scheme_bigint ** denominator) {
+	static const bigint_limb one = 1;
+	bigint_view v;
+	switch (num->type) {
+	case NUMBER_RATIONAL:
+		Bigint_ViewLong(&v, num->numerator);
+		*numerator = Bigint_New(v.limbs, v.size, v.negative);
+		Bigint_ViewLong(&v, num->denominator);
+		*denominator = Bigint_New(v.limbs, v.size, v.negative);
+		break;
+	case NUMBER_BIGRATIONAL:
+		*numerator = Bigint_Copy(num->big_numerator);
+		*denominator = Bigint_Copy(num->big_denominator);
+		break;
+	default:
+		Bigint_View(&v, num);
+		*numerator = Bigint_New(v.limbs, v.size, v.negative);
+		*denominator = Bigint_New(&one, 1, 0);
+		break;
+	}
+
+	if (*numerator && *denominator)
+		return 1;
+	free(*numerator);
+	free(*denominator);
+	*numerator = *denominator = NULL;
+	Scheme_SetError("runtime malloc(bigint) error");
+	return 0;
+}
+
+static scheme_bigint * Bigint_MulBig(const scheme_bigint * a, const scheme_bigint * b) {
+	scheme_bigint * r = Bigint_Alloc(a->size + b->size + 1);
+	if (!r)
+		return NULL;
+	r->size = 0;
+	r->negative = 0;
+	if (a->size && b->size) {
+		Bigint_MulLimbs(r->limbs, a->limbs, a->size, b->limbs, b->size);
+		r->size = Bigint_Trim(r->limbs, a->size + b->size);
+		r->negative = a->negative != b->negative;
+	}
+	return r;
+}
+
+static scheme_bigint * Bigint_AddBig(const scheme_bigint * a, const scheme_bigint * b) {
+	const scheme_bigint * big = a, * small = b;
+	if (Bigint_CompareLimbs(a->limbs, a->size, b->limbs, b->size) < 0) {
+		big = b;
+		small = a;
+	}
+
+	scheme_bigint * r = Bigint_Alloc(big->size + 1);
+	if (!r)
+		return NULL;
+	int size = big->size;
+	if (a->negative == b->negative)
+		Bigint_AddLimbs(r->limbs, big->limbs, size++, small->limbs, small->size);
+	else
+		Bigint_SubLimbs(r->limbs, big->limbs, size, small->limbs, small->size);
+	r->size = Bigint_Trim(r->limbs, size);
+	r->negative = big->negative && r->size;
+	return r;
+}
+
+// a / b, truncated
+static scheme_bigint * Bigint_DivBig(const scheme_bigint * a, const scheme_bigint * b) {
+	static const bigint_limb zero = 0;
+	if (Bigint_CompareLimbs(a->limbs, a->size, b->limbs, b->size) < 0)
+		return Bigint_New(&zero, 1, 0);
+
+	int qn = a->size - b->size + 1;
+	scheme_bigint * q = Bigint_Alloc(qn + b->size);
+	if (!q)
+		return NULL;
+	Bigint_DivLimbs(q->limbs, q->limbs + qn, a->limbs, a->size, b->limbs, b->size);
+	q->size = Bigint_Trim(q->limbs, qn);
+	q->negative = a->negative != b->negative && q->size;
+	return q;
+}
+
+// gcd of the magnitudes by Euclid's algorithm, down to a single limb
+// where gcd() takes over
+static scheme_bigint * Bigint_GcdBig(const scheme_bigint * a, const scheme_bigint * b) {
+	int n = a->size > b->size ? a->size : b->size;
+	bigint_limb * buffer = malloc(sizeof(bigint_limb) * (4 * n + 2));
+	if (!buffer) {
+		Scheme_SetError("runtime malloc(bigint) error");
+		return NULL;
+	}
+	bigint_limb * x = buffer, * y = x + n, * r = y + n, * q = r + n;
+	int xn = a->size, yn = b->size;
+	memcpy(x, a->limbs, sizeof(bigint_limb) * xn);
+	memcpy(y, b->limbs, sizeof(bigint_limb) * yn);
+	if (Bigint_CompareLimbs(x, xn, y, yn) < 0) {
+		bigint_limb * t = x;
+		x = y;
+		y = t;
+		xn = b->size;
+		yn = a->size;
+	}
+
+	while (yn > 1) {
+		Bigint_DivLimbs(q, r, x, xn, y, yn);
+		bigint_limb * t = x;
+		x = y;
+		xn = yn;
+		y = r;
+		yn = Bigint_Trim(r, yn);
+		r = t;
+	}
+
+	scheme_bigint * g;
+	if (yn) {
+		bigint_limb limb = (bigint_limb)gcd(y[0], Bigint_DivLimb(x, xn, y[0]));
+		g = Bigint_New(&limb, 1, 0);
+	} else {
+		g = Bigint_New(x, xn, 0);
+	}
+	free(buffer);
+	return g;
+}
+
+// the number numerator / denominator, in lowest terms with a positive
+// denominator. both are handed over to it or freed
+static scheme_object * Bigint_RatioFinish(scheme_bigint * numerator, scheme_bigint * denominator) {
+	if (!numerator->size || Bigint_IsOne(denominator)) {
+		free(denominator);
+		return Bigint_Finish(numerator, numerator->size, numerator->negative);
+	}
+
+	long long n, d;
+	if (Bigint_FitsLong(numerator->limbs, numerator->size, numerator->negative, &n)
+	    && Bigint_FitsLong(denominator->limbs, denominator->size, 0, &d))
+	{
+		free(numerator);
+		free(denominator);
+		return Scheme_CreateRational(n, d);
+	}
+	return Scheme_CreateBigRational(numerator, denominator);
+}
+
+// a + b, or a - b when negate is set
+static scheme_object * Bigint_RatioAdd(scheme_number * a, scheme_number * b, char negate) {
+	scheme_bigint * an = NULL, * ad = NULL, * bn = NULL, * bd = NULL;
+	scheme_bigint * d1 = NULL, * d2 = NULL, * ad1 = NULL, * bd1 = NULL, * bd2 = NULL;
+	scheme_bigint * x = NULL, * y = NULL, * t = NULL;
+	scheme_bigint * numerator = NULL, * denominator = NULL;
+	scheme_object * result = NULL;
+	if (!Bigint_Ratio(a, &an, &ad) || !Bigint_Ratio(b, &bn, &bd))
+		goto done;
+	bn->negative ^= negate && bn->size;
+
+	if (!(d1 = Bigint_GcdBig(ad, bd)))
+		goto done;
+	if (Bigint_IsOne(d1)) {
+		// an/ad + bn/bd = (an bd + bn ad) / ad bd, in lowest terms as is
+		if (!(x = Bigint_MulBig(an, bd)) || !(y = Bigint_MulBig(bn, ad)))
+			goto done;
+		numerator = Bigint_AddBig(x, y);
+		denominator = Bigint_MulBig(ad, bd);
+	} else {
+		// t = an (bd / d1) + bn (ad / d1) can only have factors of d1 in
+		// common with ad bd / d1
+		if (!(ad1 = Bigint_DivBig(ad, d1)) || !(bd1 = Bigint_DivBig(bd, d1))
+		    || !(x = Bigint_MulBig(an, bd1)) || !(y = Bigint_MulBig(bn, ad1))
+		    || !(t = Bigint_AddBig(x, y)) || !(d2 = Bigint_GcdBig(t, d1))
+		    || !(bd2 = Bigint_DivBig(bd, d2)))
+			goto done;
+		numerator = Bigint_DivBig(t, d2);
+		denominator = Bigint_MulBig(ad1, bd2);
+	}
+
+	if (numerator && denominator) {
+		result = Bigint_RatioFinish(numerator, denominator);
+		numerator = denominator = NULL;
+	}
+
+done:
+	free(numerator);
+	free(denominator);
+	free(ad1);
+	free(bd1);
+	free(bd2);
+	free(x);
+	free(y);
+	free(t);
+	free(d1);
+	free(d2);
+	free(an);
+	free(ad);
+	free(bn);
+	free(bd);
+	return result;
+}
+
+// a * b, or a / b when invert is set
+static scheme_object * Bigint_RatioMul(scheme_number * a, scheme_number * b, char invert) {
+	scheme_bigint * an = NULL, * ad = NULL, * bn = NULL, * bd = NULL;
+	scheme_bigint * g1 = NULL, * g2 = NULL, * x = NULL, * y = NULL;
+	scheme_bigint * numerator = NULL, * denominator = NULL;
+	scheme_object * result = NULL;
+	if (!Bigint_Ratio(a, &an, &ad) || !Bigint_Ratio(b, &bn, &bd))
+		goto done;
+
+	if (invert) {
+		if (!bn->size) {
+			Scheme_SetError("division by zero");
+			goto done;
+		}
+		scheme_bigint * t = bn;
+		bn = bd;
+		bd = t;
+		bn->negative = bd->negative;
+		bd->negative = 0;
+	}
+
+	if (!an->size || !bn->size) {
+		result = Scheme_MakeFixnum(0);
+		goto done;
+	}
+
+	// what is left once the cross gcds are out has nothing in common
+	if (!(g1 = Bigint_GcdBig(an, bd)) || !(g2 = Bigint_GcdBig(bn, ad))
+	    || !(x = Bigint_DivBig(an, g1)) || !(y = Bigint_DivBig(bn, g2))
+	    || !(numerator = Bigint_MulBig(x, y)))
+		goto done;
+	free(x);
+	free(y);
+	x = y = NULL;
+	if (!(x = Bigint_DivBig(ad, g2)) || !(y = Bigint_DivBig(bd, g1))
+	    || !(denominator = Bigint_MulBig(x, y)))
+		goto done;
+	result = Bigint_RatioFinish(numerator, denominator);
+	numerator = denominator = NULL;
+
+done:
+	free(numerator);
+	free(denominator);
+	free(x);
+	free(y);
+	free(g1);
+	free(g2);
+	free(an);
+	free(ad);
+	free(bn);
+	free(bd);
+	return result;
+}
+
+/* Exact numbers */
+
+scheme_object * Bigint_Add(scheme_number * a, scheme_number * b) {
+	if (Bigint_IsInteger(a) && Bigint_IsInteger(b))
+		return Bigint_AddSigned(a, b, 0);
+	return Bigint_RatioAdd(a, b, 0);
+}
+
+scheme_object * Bigint_Sub(scheme_number * a, scheme_number * b) {
+	if (Bigint_IsInteger(a) && Bigint_IsInteger(b))
+		return Bigint_AddSigned(a, b, 1);
+	return Bigint_RatioAdd(a, b, 1);
+}
+
+scheme_object * Bigint_Mul(scheme_number * a, scheme_number * b) {
+	if (Bigint_IsInteger(a) && Bigint_IsInteger(b))
+		return Bigint_MulIntegers(a, b);
+	return Bigint_RatioMul(a, b, 0);
+}
+
+scheme_object * Bigint_Div(scheme_number * a, scheme_number * b) {
+	return Bigint_RatioMul(a, b, 1);
+}
+
+int Bigint_Compare(scheme_number * a, scheme_number * b) {
+	if (Bigint_IsInteger(a) && Bigint_IsInteger(b)) {
+		bigint_view x, y;
+		Bigint_View(&x, a);
+		Bigint_View(&y, b);
+		return Bigint_CompareSigned(x.limbs, x.size, x.negative, y.limbs, y.size, y.negative);
+	}
+
+	// denominators are positive, a/b < c/d as a d < c b
+	scheme_bigint * an = NULL, * ad = NULL, * bn = NULL, * bd = NULL;
+	scheme_bigint * x = NULL, * y = NULL;
+	int cmp = 2;
+	if (Bigint_Ratio(a, &an, &ad) && Bigint_Ratio(b, &bn, &bd)
+	    && (x = Bigint_MulBig(an, bd)) && (y = Bigint_MulBig(bn, ad)))
+		cmp = Bigint_CompareSigned(x->limbs, x->size, x->negative, y->limbs, y->size, y->negative);
+	free(an);
+	free(ad);
+	free(bn);
+	free(bd);
+	free(x);
+	free(y);
+	return cmp;
+}
+
+// the top three limbs of big, which hold more bits than a double does,
+// and in *exponent the power of 2 they are to be scaled by
+static double Bigint_Mantissa(scheme_bigint * big, int * exponent) {
+	int i = big->size - 1;
+	double d = 0;
+	for (; i >= 0 && i >= big->size - 3; --i)
+		d = d * (double)BIGINT_BASE + big->limbs[i];
+	*exponent = 32 * (i + 1);
+	return d;
+}
+
+double Bigint_ToDouble(scheme_bigint * big) {
+	// Bigint_Mantissa sets exponent, it is called before exponent is read
+	int exponent;
+	double m = Bigint_Mantissa(big, &exponent);
+	double d = ldexp(m, exponent);
+	return big->negative ? -d : d;
+}
+
+double Bigint_RatioToDouble(scheme_bigint * numerator, scheme_bigint * denominator) {
+	// scaled apart, either may be out of the range of a double alone
+	int n_exponent, d_exponent;
+	double n = Bigint_Mantissa(numerator, &n_exponent);
+	double d = Bigint_Mantissa(denominator, &d_exponent);
+	double r = ldexp(n / d, n_exponent - d_exponent);
+	return numerator->negative ? -r : r;
+}
+
+scheme_bigint * Bigint_Copy(scheme_bigint * big) {
+	size_t size = sizeof(scheme_bigint) + sizeof(bigint_limb) * big->size;
+	scheme_bigint * copy = malloc(size);
+	if (copy)
+		memcpy(copy, big, size);
+	return copy;
+}
+
+scheme_object * Bigint_Parse(const char * str) {
+	char negative = *str == '-';
+	if (*str == '-' || *str == '+')
+		++str;
+
+	// 9 digits at a time, they fit in a limb. a limb holds more than 9
+	// digits, so size stays below digits / 9 + 1
+	int digits = strlen(str);
+	scheme_bigint * big = Bigint_Alloc(digits / 9 + 1);
+	if (!big)
+		return NULL;
+
+	int size = 0, chunk = digits % 9 ? digits % 9 : 9;
+	while (*str) {
+		bigint_limb value = 0;
+		int i;
+		for (i = 0; i < chunk; ++i)
+			value = value * 10 + (*str++ - '0');
+		bigint_limb carry = Bigint_MulAddLimb(big->limbs, size, 1000000000, value);
+		if (carry)
+			big->limbs[size++] = carry;
+		chunk = 9;
+	}
+	return Bigint_Finish(big, size, negative);
+}
+
+/* Printing
+ * a number is split in two on the largest 10^(9 2^k) with no more than
+ * half its limbs, the high part printed followed by the low part padded
+ * with zeros to 9 2^k digits. a small enough part is divided by 10^9
+ * over and over instead
+ */
+
+// the digits of a[0..n) written so they end at end, with zeros in front
+// to make width of them if width is set. a is used up. returns where they
+// start
+static char * Bigint_Format(char * end, bigint_limb * a, int n, int width,
+	bigint_limb ** powers, int * power_sizes, int k)
+{
+	n = Bigint_Trim(a, n);
+	while (k >= 0 && power_sizes[k] > n / 2)
+		--k;
+
+	char * p = end;
+	if (n <= BIGINT_PRINT_LIMBS || k < 0) {
+		while (n) {
+			bigint_limb chunk = Bigint_DivLimb(a, n, 1000000000);
+			n = Bigint_Trim(a, n);
+			int i;
+			for (i = 0; i < 9 && (n || chunk); ++i) {
+				*--p = '0' + chunk % 10;
+				chunk /= 10;
+			}
+		}
+	} else {
+		int digits = 9 << k;
+		int pn = power_sizes[k];
+		bigint_limb * q = Bigint_Scratch(sizeof(bigint_limb) * (n + 1));
+		bigint_limb * r = q + n - pn + 1;
+		Bigint_DivLimbs(q, r, a, n, powers[k], pn);
+		p = Bigint_Format(p, r, pn, digits, powers, power_sizes, k);
+		p = Bigint_Format(p, q, n - pn + 1, width ? width - digits : 0, powers, power_sizes, k);
+		free(q);
+	}
+
+	while (width && p > end - width)
+		*--p = '0';
+	return p;
+}
+
+void Bigint_Display(scheme_bigint * big) {
+	int n = big->size;
+
+	// 10^9, 10^18, 10^36 ... up to half the size of big
+	bigint_limb * powers[32];
+	int power_sizes[32];
+	int k = 0;
+	powers[0] = Bigint_Scratch(sizeof(bigint_limb));
+	powers[0][0] = 1000000000;
+	power_sizes[0] = 1;
+	while (power_sizes[k] * 4 <= n) {
+		int size = power_sizes[k] * 2;
+		powers[k + 1] = Bigint_Scratch(sizeof(bigint_limb) * size);
+		Bigint_MulLimbs(powers[k + 1], powers[k], power_sizes[k], powers[k], power_sizes[k]);
+		power_sizes[k + 1] = Bigint_Trim(powers[k + 1], size);
+		++k;
+	}
+
+	// a limb is less than 10 digits, the sign takes one more
+	char * buffer = Bigint_Scratch(10 * n + 2);
+	char * end = buffer + 10 * n + 1;
+	*end = '\0';
+	bigint_limb * a = Bigint_Scratch(sizeof(bigint_limb) * n);
+	memcpy(a, big->limbs, sizeof(bigint_limb) * n);
+
+	char * p = Bigint_Format(end, a, n, 0, powers, power_sizes, k);
+	if (big->negative)
+		*--p = '-';
+	printf("%s", p);
+
+	free(a);
+	free(buffer);
+	for (; k >= 0; --k)
+		free(powers[k]);
+}
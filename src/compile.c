@@ -0,0 +1,497 @@
+#include "compile.h"
+#include "scheme.h"
+#include "gc.h"
+
+scheme_compiler * scheme_compilers = NULL;
+
+#define SCHEME_OP_MAX 0xffff
+
+static void Scheme_PutOp(scheme_compiler * c, int op) {
+	if (op > SCHEME_OP_MAX || c->op_count > SCHEME_OP_MAX)
+		c->overflow = 1;
+
+	if (c->op_count == c->op_size) {
+		c->op_size = c->op_size ? c->op_size * 2 : 16;
+		c->ops = realloc(c->ops, sizeof(scheme_op) * c->op_size);
+	}
+	c->ops[c->op_count++] = op;
+}
+
+void Scheme_EmitStack(scheme_compiler * c, int delta) {
+	c->depth += delta;
+	if (c->depth > c->max_depth)
+		c->max_depth = c->depth;
+}
+
+void Scheme_Emit(scheme_compiler * c, scheme_op op) {
+	c->last = c->op_count;
+	Scheme_PutOp(c, op);
+	Scheme_EmitStack(c, scheme_ops[op].stack);
+}
+
+void Scheme_EmitOperand(scheme_compiler * c, int operand) {
+	Scheme_PutOp(c, operand);
+}
+
+void Scheme_EmitReturn(scheme_compiler * c, char tail) {
+	if (tail)
+		Scheme_Emit(c, OP_RETURN);
+}
+
+// the variant of a call that tests its value for the jump after it
+static scheme_op Scheme_CallJumpIfFalse(scheme_op op) {
+	switch (op) {
+	case OP_CALL:             return OP_CALL_JIF;
+	case OP_CALL_GLOBAL_L:    return OP_CALL_GLOBAL_L_JIF;
+	case OP_CALL_GLOBAL_LL:   return OP_CALL_GLOBAL_LL_JIF;
+	case OP_CALL_GLOBAL_LK:   return OP_CALL_GLOBAL_LK_JIF;
+	case OP_CALL_GLOBAL_KL:   return OP_CALL_GLOBAL_KL_JIF;
+	case OP_NUM_EQ:           return OP_NUM_EQ_JIF;
+	case OP_LT:               return OP_LT_JIF;
+	case OP_GT:               return OP_GT_JIF;
+	case OP_NULLP:            return OP_NULLP_JIF;
+	case OP_FL_LT:            return OP_FL_LT_JIF;
+	default:                  return op;
+	}
+}
+
+int Scheme_EmitJump(scheme_compiler * c, scheme_op op) {
+	// the jump stays where it is, so jumps to it still work
+	if (op == OP_JUMP_IF_FALSE && c->last >= 0)
+		c->ops[c->last] = Scheme_CallJumpIfFalse(c->ops[c->last]);
+	Scheme_Emit(c, op);
+	Scheme_PutOp(c, 0);
+	return c->op_count - 1;
+}
+
+void Scheme_PatchJump(scheme_compiler * c, int at) {
+	if (c->op_count > SCHEME_OP_MAX)
+		c->overflow = 1;
+	c->ops[at] = c->op_count;
+}
+
+int Scheme_AddConstant(scheme_compiler * c, scheme_object * obj) {
+	if (c->const_count == c->const_size) {
+		c->const_size = c->const_size ? c->const_size * 2 : 8;
+		c->consts = realloc(c->consts, sizeof(scheme_object *) * c->const_size);
+	}
+	c->consts[c->const_count] = obj;
+	return c->const_count++;
+}
+
+int Scheme_AddCell(scheme_compiler * c, scheme_define * cell) {
+	if (c->cell_count == c->cell_size) {
+		c->cell_size = c->cell_size ? c->cell_size * 2 : 8;
+		c->cells = realloc(c->cells, sizeof(scheme_define *) * c->cell_size);
+	}
+	c->cells[c->cell_count] = cell;
+	return c->cell_count++;
+}
+
+/* Frames */
+
+void Scheme_EnterBlock(scheme_compiler * c, scheme_block * block, int size, char captured) {
+	block->lambda = 0;
+	block->captured = captured;
+	block->base = c->slot_count;
+	block->parent = c->block;
+	c->block = block;
+
+	if (captured)
+		return;
+	c->slot_count += size;
+	if (c->slot_count > c->frame_size)
+		c->frame_size = c->slot_count;
+}
+
+void Scheme_LeaveBlock(scheme_compiler * c) {
+	c->slot_count = c->block->base;
+	c->block = c->block->parent;
+}
+
+static void Scheme_CompileConstant(scheme_object * obj, scheme_compiler * c) {
+	Scheme_Emit(c, OP_CONST);
+	Scheme_EmitOperand(c, Scheme_AddConstant(c, obj));
+}
+
+static void Scheme_CompileGlobal(scheme_define * cell, scheme_compiler * c) {
+	Scheme_Emit(c, OP_GLOBAL);
+	Scheme_EmitOperand(c, Scheme_AddCell(c, cell));
+}
+
+static void Scheme_CompileRef(scheme_ref * ref, scheme_compiler * c) {
+	if (ref->cell) {
+		Scheme_CompileGlobal(ref->cell, c);
+		return;
+	}
+
+	// frames on the value stack are never seen from a nested lambda, so
+	// only the heap frames on the way count towards the depth
+	scheme_block * block = c->block;
+	int depth, heap_depth = 0;
+	for (depth = ref->depth; depth; --depth) {
+		heap_depth += block->captured;
+		block = block->parent;
+	}
+
+	if (block->captured) {
+		Scheme_Emit(c, OP_ENV);
+		Scheme_EmitOperand(c, heap_depth);
+		Scheme_EmitOperand(c, ref->slot);
+	} else {
+		Scheme_Emit(c, OP_LOCAL);
+		Scheme_EmitOperand(c, block->base + ref->slot);
+	}
+}
+
+void Scheme_CompileSetLocal(scheme_compiler * c, scheme_ref * ref) {
+	if (c->block->captured) {
+		Scheme_Emit(c, OP_SET_ENV);
+		Scheme_EmitOperand(c, ref->slot);
+	} else {
+		Scheme_Emit(c, OP_SET_LOCAL);
+		Scheme_EmitOperand(c, c->block->base + ref->slot);
+	}
+}
+
+// the special form a resolved operator names, NULL for an application
+static scheme_cfunc * Scheme_OperatorSpecial(scheme_object * op) {
+	if (Scheme_Type(op) != SCHEME_REF)
+		return NULL;
+
+	scheme_define * cell = Scheme_GetRef(op)->cell;
+	if (!cell || Scheme_Type(cell->object) != SCHEME_CFUNC)
+		return NULL;
+
+	scheme_cfunc * cfunc = Scheme_GetCFunc(cell->object);
+	return cfunc->special_form ? cfunc : NULL;
+}
+
+static int Scheme_CompileSpecial(scheme_cfunc * special, scheme_object ** objs, int count,
+	scheme_compiler * c, char tail)
+{
+	if (count < special->arg_count || (count > special->arg_count && !special->dot_args)) {
+		Scheme_SetError("bad arg count");
+		return 0;
+	}
+
+	switch (special->special_form) {
+	case SPECIAL_DEFINE: return Scheme_Special_Define(objs, count, c, tail);
+	case SPECIAL_LAMBDA: return Scheme_Special_Lambda(objs, count, c, tail);
+	case SPECIAL_IF    : return Scheme_Special_If(objs, count, c, tail);
+	case SPECIAL_QUOTE : return Scheme_Special_Quote(objs, count, c, tail);
+	case SPECIAL_COND  : return Scheme_Special_Cond(objs, count, c, tail);
+	case SPECIAL_LET   : return Scheme_Special_Let(objs, count, c, tail);
+	default:
+		Scheme_SetError("unknown special form");
+		return 0;
+	}
+}
+
+// the frame slot of a variable on the value stack, -1 for any other
+// expression
+static int Scheme_LocalSlot(scheme_object * expr, scheme_compiler * c) {
+	if (Scheme_Type(expr) != SCHEME_REF)
+		return -1;
+	scheme_ref * ref = Scheme_GetRef(expr);
+	if (ref->cell)
+		return -1;
+
+	scheme_block * block = c->block;
+	int depth;
+	for (depth = ref->depth; depth; --depth)
+		block = block->parent;
+	return block->captured ? -1 : block->base + ref->slot;
+}
+
+static char Scheme_IsLiteral(scheme_object * expr) {
+	switch (Scheme_Type(expr)) {
+	case SCHEME_REF:
+	case SCHEME_SYMBOL:
+	case SCHEME_PAIR:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+// a call to a global on one or two locals and constants, the shape the
+// OP_CALL_GLOBAL_* superinstructions cover. 0 if the call has another
+static int Scheme_CompileCallGlobal(scheme_define * cell, scheme_object ** objs, int count,
+	scheme_compiler * c)
+{
+	int a = count > 0 ? Scheme_LocalSlot(objs[0], c) : -1;
+	int b = count > 1 ? Scheme_LocalSlot(objs[1], c) : -1;
+	int ops[2];
+	scheme_op op;
+
+	if (count == 1 && a >= 0) {
+		op = OP_CALL_GLOBAL_L;
+		ops[0] = a;
+	} else if (count == 2 && a >= 0 && b >= 0) {
+		op = OP_CALL_GLOBAL_LL;
+		ops[0] = a;
+		ops[1] = b;
+	} else if (count == 2 && a >= 0 && Scheme_IsLiteral(objs[1])) {
+		op = OP_CALL_GLOBAL_LK;
+		ops[0] = a;
+		ops[1] = Scheme_AddConstant(c, objs[1]);
+	} else if (count == 2 && b >= 0 && Scheme_IsLiteral(objs[0])) {
+		op = OP_CALL_GLOBAL_KL;
+		ops[0] = Scheme_AddConstant(c, objs[0]);
+		ops[1] = b;
+	} else {
+		return 0;
+	}
+
+	// the procedure and arguments are on the stack during the call
+	Scheme_EmitStack(c, count + 1);
+	Scheme_EmitStack(c, -count - 1);
+	Scheme_Emit(c, op);
+	Scheme_EmitOperand(c, Scheme_AddCell(c, cell));
+	Scheme_EmitOperand(c, ops[0]);
+	if (count == 2)
+		Scheme_EmitOperand(c, ops[1]);
+	return 1;
+}
+
+// a call to the primitive cell holds, if it has a fixed entry point for
+// count arguments. 0 if it does not, then the call is compiled as usual
+// and an arg count that does not match is an error when it runs
+static int Scheme_CompilePrimitive(scheme_define * cell, scheme_object ** objs, int count,
+	scheme_compiler * c, char tail)
+{
+	scheme_object * func = cell->object;
+	if (!func || Scheme_Type(func) != SCHEME_CFUNC)
+		return 0;
+	scheme_cfunc * cfunc = Scheme_GetCFunc(func);
+	if (cfunc->func || cfunc->special_form || cfunc->arg_count != count)
+		return 0;
+
+	int i;
+	for (i = 0; i < count; ++i)
+		if (!Scheme_CompileExpr(objs[i], c, 0))
+			return -1;
+
+	// room for the procedure, should the global be redefined
+	Scheme_EmitStack(c, 1);
+	Scheme_EmitStack(c, -1);
+	Scheme_Emit(c, OP_PRIM0 + count);
+	Scheme_EmitOperand(c, Scheme_AddCell(c, cell));
+	Scheme_EmitOperand(c, Scheme_AddConstant(c, func));
+	Scheme_EmitReturn(c, tail);
+	return 1;
+}
+
+// a call to a primitive the VM runs inline (see OP_ADD), when cell
+// holds one and it is given the arguments its instruction pops
+static int Scheme_CompileInline(scheme_define * cell, scheme_object ** objs, int count,
+	scheme_compiler * c, char tail)
+{
+	scheme_object * func = cell->object;
+	if (!func || Scheme_Type(func) != SCHEME_CFUNC)
+		return 0;
+	scheme_op op = Scheme_GetCFunc(func)->inline_op;
+	if (!op || 1 - scheme_ops[op].stack != count)
+		return 0;
+
+	int i;
+	for (i = 0; i < count; ++i)
+		if (!Scheme_CompileExpr(objs[i], c, 0))
+			return -1;
+
+	// room for the procedure, should the global be redefined
+	Scheme_EmitStack(c, 1);
+	Scheme_EmitStack(c, -1);
+	Scheme_Emit(c, op);
+	Scheme_EmitOperand(c, Scheme_AddCell(c, cell));
+	Scheme_EmitReturn(c, tail);
+	return 1;
+}
+
+static int Scheme_CompileApplication(scheme_object * op, scheme_object ** objs, int count,
+	scheme_compiler * c, char tail)
+{
+	scheme_define * cell = Scheme_Type(op) == SCHEME_REF ? Scheme_GetRef(op)->cell : NULL;
+	if (cell) {
+		int prim = Scheme_CompileInline(cell, objs, count, c, tail);
+		if (!prim)
+			prim = Scheme_CompilePrimitive(cell, objs, count, c, tail);
+		if (prim)
+			return prim > 0;
+
+		// a tail call has to be able to replace the frame, so it is left as is
+		if (!tail && Scheme_CompileCallGlobal(cell, objs, count, c))
+			return 1;
+	}
+
+	// the procedure goes below its arguments
+	if (!Scheme_CompileExpr(op, c, 0))
+		return 0;
+
+	int i;
+	for (i = 0; i < count; ++i)
+		if (!Scheme_CompileExpr(objs[i], c, 0))
+			return 0;
+
+	// a tail call returns from the frame by itself
+	Scheme_Emit(c, tail ? OP_TAIL_CALL : OP_CALL);
+	Scheme_EmitOperand(c, count);
+	Scheme_EmitStack(c, -count);
+	return 1;
+}
+
+static int Scheme_CompileForm(scheme_object * form, scheme_compiler * c, char tail) {
+	scheme_pair * pair = Scheme_GetPair(form);
+	int count = Scheme_ListLength(pair->cdr);
+	if (error_str)
+		return 0;
+
+	scheme_object * objs[count + 1];
+	scheme_object * node = pair->cdr;
+	int i;
+	for (i = 0; i < count; ++i) {
+		scheme_pair * p = Scheme_GetPair(node);
+		objs[i] = p->car;
+		node = p->cdr;
+	}
+
+	scheme_cfunc * special = Scheme_OperatorSpecial(pair->car);
+	if (special)
+		return Scheme_CompileSpecial(special, objs, count, c, tail);
+	return Scheme_CompileApplication(pair->car, objs, count, c, tail);
+}
+
+int Scheme_CompileExpr(scheme_object * expr, scheme_compiler * c, char tail) {
+	switch (Scheme_Type(expr)) {
+	case SCHEME_REF:
+		Scheme_CompileRef(Scheme_GetRef(expr), c);
+		break;
+	case SCHEME_SYMBOL:
+		// only code Scheme_Resolve gave up on has symbols left in it
+		Scheme_CompileGlobal(Scheme_GetGlobalCell(c->global, Scheme_GetSymbol(expr)->sym), c);
+		break;
+	case SCHEME_PAIR:
+		return Scheme_CompileForm(expr, c, tail);
+	default:
+		Scheme_CompileConstant(expr, c);
+		break;
+	}
+
+	Scheme_EmitReturn(c, tail);
+	return 1;
+}
+
+int Scheme_CompileBody(scheme_object ** exprs, int count, scheme_compiler * c, char tail) {
+	int i;
+	for (i = 0; i < count - 1; ++i) {
+		if (!Scheme_CompileExpr(exprs[i], c, 0))
+			return 0;
+		Scheme_Emit(c, OP_POP);
+	}
+	return Scheme_CompileExpr(exprs[count - 1], c, tail);
+}
+
+static void Scheme_BeginCompile(scheme_compiler * c, scheme_env * global) {
+	memset(c, 0, sizeof(scheme_compiler));
+	c->last = -1;
+	c->global = global;
+	c->parent = scheme_compilers;
+	scheme_compilers = c;
+}
+
+// code taking over what c compiled, NULL if it failed
+static scheme_object * Scheme_EndCompile(scheme_compiler * c, int success) {
+	if (success && c->overflow) {
+		Scheme_SetError("too much code in one lambda");
+		success = 0;
+	}
+
+	// feedback slots for the call sites, see profile.h
+	uint16_t * feedback = NULL;
+	if (success && !(feedback = calloc(c->op_count + 1, sizeof(uint16_t)))) {
+		Scheme_SetError("out of memory");
+		success = 0;
+	}
+
+	scheme_object * code_obj = NULL;
+	if (success)
+		code_obj = Scheme_CreateCode();
+
+	scheme_compilers = c->parent;
+	if (!code_obj) {
+		free(c->ops);
+		free(c->consts);
+		free(c->cells);
+		free(feedback);
+		return NULL;
+	}
+
+	scheme_code * code = Scheme_GetCode(code_obj);
+	code->feedback = feedback;
+	code->frame_size = c->frame_size;
+	code->stack_size = c->frame_size + c->max_depth;
+	code->ops = c->ops;
+	code->op_count = c->op_count;
+	code->consts = c->consts;
+	code->const_count = c->const_count;
+	code->cells = c->cells;
+	code->cell_count = c->cell_count;
+	code->epoch = scheme_global_epoch;
+	return code_obj;
+}
+
+int Scheme_CompileLambda(scheme_object * args, int frame_size, char captured,
+	scheme_object ** body, int body_count, scheme_compiler * c)
+{
+	scheme_compiler lambda;
+	Scheme_BeginCompile(&lambda, c->global);
+
+	// the special form has checked the argument list
+	int argc = Scheme_ListLength(args);
+
+	// the arguments stay where the caller pushed them unless the frame
+	// is captured, then they are copied into its environment
+	scheme_block block;
+	block.lambda = 1;
+	block.captured = captured;
+	block.base = 0;
+	block.parent = c->block;
+	lambda.block = &block;
+	lambda.slot_count = lambda.frame_size = captured ? argc : frame_size;
+
+	int success = Scheme_CompileBody(body, body_count, &lambda, 1);
+	scheme_object * code_obj = Scheme_EndCompile(&lambda, success);
+	if (!code_obj)
+		return -1;
+
+	scheme_code * code = Scheme_GetCode(code_obj);
+	code->arg_count = argc;
+	code->arg_ids = malloc(sizeof(symbol *) * argc);
+	code->captured = captured;
+	code->env_size = captured ? frame_size : 0;
+
+	int i;
+	for (i = 0; i < argc; ++i) {
+		scheme_pair * pair = Scheme_GetPair(args);
+		ReferenceSymbol(&code->arg_ids[i], Scheme_GetSymbol(pair->car)->sym);
+		args = pair->cdr;
+	}
+
+	return Scheme_AddConstant(c, code_obj);
+}
+
+scheme_object * Scheme_Compile(scheme_object * expr, scheme_object * env) {
+	// code never moves, like the parser's
+	++gc_pretenure;
+	GC_PROTECT(expr);
+
+	scheme_compiler c;
+	Scheme_BeginCompile(&c, Scheme_GetEnvObj(env));
+	int success = Scheme_CompileExpr(expr, &c, 1);
+	scheme_object * code = Scheme_EndCompile(&c, success);
+
+	GC_UNPROTECT(1);
+	--gc_pretenure;
+	return code;
+}
@@ -0,0 +1,455 @@
+#include <time.h>
+
+#include "gc.h"
+#include "scheme.h"
+#include "compile.h"
+#include "slab.h"
+
+scheme_object *** gc_root_stack = NULL;
+size_t gc_root_count = 0;
+size_t gc_root_size  = 0;
+
+char * gc_young_start = NULL, * gc_young_end = NULL;
+char * gc_nursery_top = NULL, * gc_nursery_end = NULL;
+int gc_pretenure = 0;
+
+scheme_gc_stats gc_stats = {
+	.threshold = GC_MIN_THRESHOLD,
+	.external_threshold = GC_EXTERNAL_MIN
+};
+
+// survivor space holding the objects that survived the last minor
+// collection, and the one the next collection copies into
+static char * survivor_from, * survivor_from_top;
+static char * survivor_to;
+
+// during a minor collection
+static char * copy_top, * copy_end;
+static int promote_all;
+static scheme_object ** promoted = NULL;
+static size_t promoted_count = 0, promoted_size = 0;
+
+// during a major collection
+static scheme_object ** mark_stack = NULL;
+static size_t mark_count = 0, mark_size = 0;
+
+int Scheme_InitGC(void) {
+	gc_root_stack = malloc(sizeof(scheme_object **) * GC_ROOT_STACK_INIT_SIZE);
+	gc_young_start = malloc(GC_NURSERY_SIZE + 2 * GC_SURVIVOR_SIZE);
+	if (!gc_root_stack || !gc_young_start) {
+		Scheme_SetError("Scheme_InitGC : malloc() error");
+		return 0;
+	}
+
+	gc_root_count = 0;
+	gc_root_size  = GC_ROOT_STACK_INIT_SIZE;
+
+	gc_nursery_top = gc_young_start;
+	gc_nursery_end = gc_young_start + GC_NURSERY_SIZE;
+	survivor_from  = survivor_from_top = gc_nursery_end;
+	survivor_to    = gc_nursery_end + GC_SURVIVOR_SIZE;
+	gc_young_end   = survivor_to + GC_SURVIVOR_SIZE;
+	return 1;
+}
+
+void Scheme_GCGrowRoots(void) {
+	gc_root_size *= 2;
+	gc_root_stack = realloc(gc_root_stack, sizeof(scheme_object **) * gc_root_size);
+}
+
+/* Minor collection */
+
+static void Scheme_GCPushPromoted(scheme_object * obj) {
+	if (promoted_count == promoted_size) {
+		promoted_size = promoted_size ? promoted_size * 2 : 256;
+		promoted = realloc(promoted, sizeof(scheme_object *) * promoted_size);
+	}
+	promoted[promoted_count++] = obj;
+}
+
+// new address of obj, copying it out of the nursery if it is still there
+static scheme_object * Scheme_GCForward(scheme_object * obj) {
+	if (!Scheme_GCIsYoung(obj))
+		return obj;
+	if (obj->type == SCHEME_FORWARD)
+		return *(scheme_object **)obj->payload;
+
+	size_t size = Scheme_ObjectSize(obj->type);
+	scheme_object * copy;
+
+	if (!promote_all && obj->age + 1 < GC_PROMOTE_AGE && copy_top + size <= copy_end) {
+		copy = (scheme_object *)copy_top;
+		copy_top += size;
+		memcpy(copy, obj, size);
+		++copy->age;
+		++gc_stats.survived;
+	} else {
+		copy = Slab_Alloc(Scheme_ObjectSlab(obj->type));
+		if (!copy) {
+			fputs("out of memory promoting nursery object\n", stderr);
+			exit(1);
+		}
+		memcpy(copy, obj, size);
+		copy->age = 0;
+		Scheme_GCPushPromoted(copy);
+		++gc_stats.promoted;
+		++gc_stats.allocated;
+	}
+
+	obj->type = SCHEME_FORWARD;
+	*(scheme_object **)obj->payload = copy;
+	return copy;
+}
+
+#define FORWARD(field) ((field) = Scheme_GCForward(field), young |= Scheme_GCIsYoung(field))
+
+// forwards every object field, returns 1 if any still points into the nursery
+static int Scheme_GCScanObject(scheme_object * obj) {
+	int young = 0;
+	int i;
+
+	switch (obj->type) {
+	case SCHEME_PAIR: {
+		scheme_pair * pair = (scheme_pair *)obj->payload;
+		FORWARD(pair->car);
+		FORWARD(pair->cdr);
+		break; }
+	case SCHEME_LAMBDA: {
+		scheme_lambda * lambda = (scheme_lambda *)obj->payload;
+		FORWARD(lambda->code);
+		FORWARD(lambda->closure);
+		break; }
+	case SCHEME_CODE: {
+		scheme_code * code = (scheme_code *)obj->payload;
+		for (i = 0; i < code->const_count; ++i)
+			FORWARD(code->consts[i]);
+		break; }
+	case SCHEME_ENV: {
+		scheme_env * env = (scheme_env *)obj->payload;
+		if (env->cells) {
+			for (i = 0; i < env->count; ++i)
+				FORWARD(env->cells[i]->object);
+		} else {
+			for (i = 0; i < env->count; ++i)
+				FORWARD(env->slots[i]);
+		}
+		FORWARD(env->parent);
+		break; }
+	}
+
+	return young;
+}
+
+#undef FORWARD
+
+static void Scheme_GCScanCard(void * cell) {
+	scheme_object * obj = cell;
+	if (obj->type != SCHEME_FREED && Scheme_GCScanObject(obj))
+		Slab_MarkCard(obj);
+}
+
+static void Scheme_GCForwardRoots(void) {
+	SYSTEM_GLOBAL_ENVIRONMENT_OBJ = Scheme_GCForward(SYSTEM_GLOBAL_ENVIRONMENT_OBJ);
+	USER_INITIAL_ENVIRONMENT_OBJ  = Scheme_GCForward(USER_INITIAL_ENVIRONMENT_OBJ);
+	if (SYSTEM_GLOBAL_ENVIRONMENT_OBJ)
+		SYSTEM_GLOBAL_ENVIRONMENT = Scheme_GetEnvObj(SYSTEM_GLOBAL_ENVIRONMENT_OBJ);
+	if (USER_INITIAL_ENVIRONMENT_OBJ)
+		USER_INITIAL_ENVIRONMENT  = Scheme_GetEnvObj(USER_INITIAL_ENVIRONMENT_OBJ);
+
+	scheme_call_segment * calls;
+	scheme_call * call, * end;
+	for (calls = call_segment; calls; calls = calls->prev) {
+		end = calls == call_segment ? call_stack_end : calls->end;
+		for (call = calls->calls; call < end; ++call) {
+			call->proc = Scheme_GCForward(call->proc);
+			call->env = Scheme_GCForward(call->env);
+		}
+	}
+
+	scheme_stack_segment * segment;
+	scheme_object ** slot, ** top;
+	for (segment = vm_segment; segment; segment = segment->prev) {
+		top = segment == vm_segment ? vm_sp : segment->top;
+		for (slot = segment->slots; slot < top; ++slot)
+			*slot = Scheme_GCForward(*slot);
+	}
+
+	scheme_compiler * compiler;
+	int j;
+	for (compiler = scheme_compilers; compiler; compiler = compiler->parent)
+		for (j = 0; j < compiler->const_count; ++j)
+			compiler->consts[j] = Scheme_GCForward(compiler->consts[j]);
+
+	size_t i;
+	for (i = 0; i < gc_root_count; ++i)
+		*gc_root_stack[i] = Scheme_GCForward(*gc_root_stack[i]);
+
+	Slab_ForEachDirty(Scheme_GCScanCard);
+}
+
+// finalizes the objects in [start, end) that were not copied out
+static void Scheme_GCReleaseYoung(char * start, char * end) {
+	char * p = start;
+	while (p < end) {
+		scheme_object * obj = (scheme_object *)p;
+		if (obj->type == SCHEME_FORWARD) {
+			p += Scheme_ObjectSize((*(scheme_object **)obj->payload)->type);
+		} else {
+			size_t size = Scheme_ObjectSize(obj->type);
+			gc_stats.freed_bytes += size;
+			p += size;
+			Scheme_FinalizeObject(obj);
+		}
+	}
+
+#ifdef SCHEME_GC_STRESS
+	// poison the space so anything still pointing here fails loudly
+	memset(start, 0xdb, end - start);
+#endif
+}
+
+void Scheme_GCMinor(void) {
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	copy_top = survivor_to;
+	copy_end = survivor_to + GC_SURVIVOR_SIZE;
+	promoted_count = 0;
+
+	Scheme_GCForwardRoots();
+
+	// cheney scan over both the survivor space and the promoted objects
+	char * scan = survivor_to;
+	size_t promoted_scan = 0;
+	while (scan < copy_top || promoted_scan < promoted_count) {
+		while (scan < copy_top) {
+			scheme_object * obj = (scheme_object *)scan;
+			Scheme_GCScanObject(obj);
+			scan += Scheme_ObjectSize(obj->type);
+		}
+
+		while (promoted_scan < promoted_count) {
+			scheme_object * obj = promoted[promoted_scan++];
+			if (Scheme_GCScanObject(obj))
+				Slab_MarkCard(obj);
+		}
+	}
+
+	Scheme_GCReleaseYoung(gc_young_start, gc_nursery_top);
+	Scheme_GCReleaseYoung(survivor_from, survivor_from_top);
+
+	char * swap = survivor_from;
+	survivor_from = survivor_to;
+	survivor_from_top = copy_top;
+	survivor_to = swap;
+	gc_nursery_top = gc_young_start;
+
+	++gc_stats.minor_collections;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	unsigned long long pause = (t1.tv_sec - t0.tv_sec) * 1000000000ull
+		+ t1.tv_nsec - t0.tv_nsec;
+	gc_stats.pause_total_ns += pause;
+	if (pause > gc_stats.pause_max_ns)
+		gc_stats.pause_max_ns = pause;
+
+	if (!promote_all && gc_stats.allocated >= gc_stats.threshold)
+		Scheme_GCCollect();
+}
+
+/* Major collection */
+
+static void Scheme_GCPushMark(scheme_object * obj) {
+	if (!obj || Scheme_IsImmediate(obj) || obj->mark)
+		return;
+
+	if (mark_count == mark_size) {
+		mark_size = mark_size ? mark_size * 2 : 1024;
+		mark_stack = realloc(mark_stack, sizeof(scheme_object *) * mark_size);
+	}
+	mark_stack[mark_count++] = obj;
+}
+
+// marking works off an explicit stack, so the C stack depth stays
+// constant however long or deeply nested the structure is. the last
+// reference of each object (a pair's cdr, a closure, a parent env) is
+// followed in place rather than pushed, which keeps the stack small
+// for lists and environment chains
+void Scheme_GCMark(scheme_object * obj) {
+	Scheme_GCPushMark(obj);
+
+	while (mark_count) {
+		obj = mark_stack[--mark_count];
+
+		while (obj && !Scheme_IsImmediate(obj) && !obj->mark) {
+			obj->mark = 1;
+
+			int i;
+			switch (obj->type) {
+			case SCHEME_PAIR: {
+				scheme_pair * pair = (scheme_pair *)obj->payload;
+				Scheme_GCPushMark(pair->car);
+				obj = pair->cdr;
+				break; }
+			case SCHEME_LAMBDA: {
+				scheme_lambda * lambda = (scheme_lambda *)obj->payload;
+				Scheme_GCPushMark(lambda->code);
+				obj = lambda->closure;
+				break; }
+			case SCHEME_CODE: {
+				scheme_code * code = (scheme_code *)obj->payload;
+				for (i = 0; i < code->const_count; ++i)
+					Scheme_GCPushMark(code->consts[i]);
+				obj = NULL;
+				break; }
+			case SCHEME_ENV: {
+				scheme_env * env = (scheme_env *)obj->payload;
+				if (env->cells) {
+					for (i = 0; i < env->count; ++i)
+						Scheme_GCPushMark(env->cells[i]->object);
+				} else {
+					for (i = 0; i < env->count; ++i)
+						Scheme_GCPushMark(env->slots[i]);
+				}
+				obj = env->parent;
+				break; }
+			default:
+				obj = NULL;
+				break;
+			}
+		}
+	}
+}
+
+static void Scheme_GCMarkRoots(void) {
+	Scheme_GCMark(SYSTEM_GLOBAL_ENVIRONMENT_OBJ);
+	Scheme_GCMark(USER_INITIAL_ENVIRONMENT_OBJ);
+
+	scheme_call_segment * calls;
+	scheme_call * call, * end;
+	for (calls = call_segment; calls; calls = calls->prev) {
+		end = calls == call_segment ? call_stack_end : calls->end;
+		for (call = calls->calls; call < end; ++call) {
+			Scheme_GCMark(call->proc);
+			Scheme_GCMark(call->env);
+		}
+	}
+
+	scheme_stack_segment * segment;
+	scheme_object ** slot, ** top;
+	for (segment = vm_segment; segment; segment = segment->prev) {
+		top = segment == vm_segment ? vm_sp : segment->top;
+		for (slot = segment->slots; slot < top; ++slot)
+			Scheme_GCMark(*slot);
+	}
+
+	scheme_compiler * compiler;
+	int j;
+	for (compiler = scheme_compilers; compiler; compiler = compiler->parent)
+		for (j = 0; j < compiler->const_count; ++j)
+			Scheme_GCMark(compiler->consts[j]);
+
+	size_t i;
+	for (i = 0; i < gc_root_count; ++i)
+		Scheme_GCMark(*gc_root_stack[i]);
+}
+
+static void Scheme_GCRelease(scheme_object * obj) {
+	int slab = Scheme_ObjectSlab(obj->type);
+
+	Scheme_FinalizeObject(obj);
+#ifdef SCHEME_GC_STRESS
+	memset(obj->payload, 0xdb, slab_classes[slab].cell_size - sizeof(scheme_object));
+#endif
+	obj->type = SCHEME_FREED;
+	gc_stats.freed_bytes += slab_classes[slab].cell_size;
+	Slab_Free(slab, obj);
+}
+
+static void Scheme_GCSweepCell(void * cell) {
+	scheme_object * obj = cell;
+	if (obj->type == SCHEME_FREED)
+		return;
+
+	if (obj->mark) {
+		obj->mark = 0;
+		++gc_stats.live;
+	} else {
+		Scheme_GCRelease(obj);
+		++gc_stats.freed;
+	}
+}
+
+void Scheme_GCCollect(void) {
+	// with the nursery emptied into the old generation nothing
+	// moves any more and everything live can be marked in place
+	promote_all = 1;
+	Scheme_GCMinor();
+	promote_all = 0;
+
+	Scheme_GCMarkRoots();
+
+	gc_stats.live = 0;
+	int i;
+	for (i = 0; i < SLAB_OBJECT_CLASSES; ++i)
+		Slab_ForEach(i, Scheme_GCSweepCell);
+
+	++gc_stats.collections;
+	gc_stats.allocated = 0;
+	gc_stats.threshold = gc_stats.live > GC_MIN_THRESHOLD ?
+		gc_stats.live : GC_MIN_THRESHOLD;
+	gc_stats.external_threshold = gc_stats.external > GC_EXTERNAL_MIN / 2 ?
+		2 * gc_stats.external : GC_EXTERNAL_MIN;
+}
+
+void Scheme_GCCollectExternal(void) {
+	// most of it usually belongs to numbers that died young
+	Scheme_GCMinor();
+	if (gc_stats.external >= gc_stats.external_threshold)
+		Scheme_GCCollect();
+}
+
+static void Scheme_GCFreeCell(void * cell) {
+	scheme_object * obj = cell;
+	if (obj->type != SCHEME_FREED)
+		Scheme_GCRelease(obj);
+}
+
+void Scheme_GCFreeAll(void) {
+	Scheme_GCReleaseYoung(gc_young_start, gc_nursery_top);
+	Scheme_GCReleaseYoung(survivor_from, survivor_from_top);
+
+	int i;
+	for (i = 0; i < SLAB_OBJECT_CLASSES; ++i)
+		Slab_ForEach(i, Scheme_GCFreeCell);
+
+	free(gc_young_start);
+	gc_young_start = gc_young_end = gc_nursery_top = gc_nursery_end = NULL;
+
+	free(promoted);
+	promoted = NULL;
+	promoted_count = promoted_size = 0;
+
+	free(mark_stack);
+	mark_stack = NULL;
+	mark_count = mark_size = 0;
+
+	free(gc_root_stack);
+	gc_root_stack = NULL;
+	gc_root_count = gc_root_size = 0;
+}
+
+void Scheme_DisplayGCStats(void) {
+	fprintf(stderr, "-- GC --\n");
+	fprintf(stderr, "minor       %zu\n", gc_stats.minor_collections);
+	fprintf(stderr, "major       %zu\n", gc_stats.collections);
+	fprintf(stderr, "survived    %zu\n", gc_stats.survived);
+	fprintf(stderr, "promoted    %zu\n", gc_stats.promoted);
+	fprintf(stderr, "live        %zu\n", gc_stats.live);
+	fprintf(stderr, "freed       %zu (%zu bytes reclaimed)\n", gc_stats.freed, gc_stats.freed_bytes);
+	fprintf(stderr, "external    %zu bytes\n", gc_stats.external);
+	if (gc_stats.minor_collections)
+		fprintf(stderr, "pause       avg %.1fus max %.1fus\n",
+			gc_stats.pause_total_ns / 1000.0 / gc_stats.minor_collections,
+			gc_stats.pause_max_ns / 1000.0);
+}
@@ -0,0 +1,849 @@
+#include "jit.h"
+
+#ifdef SCHEME_JIT
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "gc.h"
+#include "profile.h"
+
+void Scheme_InitJIT(void) {
+	const char * setting = getenv("SCHEME_JIT");
+	if (!setting)
+		return;
+	scheme_tier_threshold = strcmp(setting, "off") ? atoi(setting) : -1;
+}
+
+/* Machine code
+ * while in machine code the frame is held in callee saved registers,
+ * everything else in the caller saved ones around a single template
+ */
+enum {
+	JIT_RAX, JIT_RCX, JIT_RDX, JIT_RBX, JIT_RSP, JIT_RBP, JIT_RSI, JIT_RDI,
+	JIT_R8, JIT_R9, JIT_R10, JIT_R11, JIT_R12, JIT_R13, JIT_R14, JIT_R15
+};
+
+#define JIT_FP    JIT_RBX // fp of the frame
+#define JIT_SP    JIT_R12 // top of its operands
+#define JIT_CALL  JIT_R13 // its scheme_call
+#define JIT_VM_SP JIT_R14 // &vm_sp
+
+// condition codes, the opposite of each is cc ^ 1
+enum {
+	JIT_O = 0x0, JIT_E = 0x4, JIT_NE = 0x5, JIT_L = 0xc, JIT_G = 0xf
+};
+
+// opcodes of op r/m64, r64 and op r64, r/m64
+enum {
+	JIT_ADD = 0x01, JIT_OR = 0x09, JIT_AND = 0x21, JIT_SUB = 0x29, JIT_CMP = 0x39,
+	JIT_TEST = 0x85, JIT_MOV = 0x89, JIT_LOAD = 0x8b, JIT_LEA = 0x8d,
+	JIT_CMP_LOAD = 0x3b
+};
+
+// the /digit of the 0x81 group, op r/m64, imm32
+enum {
+	JIT_ADD_IMM = 0, JIT_SUB_IMM = 5, JIT_XOR_IMM = 6, JIT_CMP_IMM = 7
+};
+
+#define JIT_PAYLOAD offsetof(scheme_object, payload)
+#define JIT_NONE    SIZE_MAX
+
+// a jump to patch once where it goes is known, to an instruction or to
+// the stub handing that instruction back to the VM
+typedef struct jit_fixup {
+	size_t at; // the rel32
+	int op;
+} jit_fixup;
+
+typedef struct jit_compiler {
+	unsigned char * bytes;
+	size_t count, size;
+	char failed;
+
+	scheme_code * code;
+	size_t * labels; // where each instruction starts, by its position in ops
+	size_t exit, error;
+
+	jit_fixup * jumps, * exits;
+	int jump_count, jump_size, exit_count, exit_size;
+} jit_compiler;
+
+static void Jit_Byte(jit_compiler * j, int byte) {
+	if (j->count == j->size) {
+		if (j->failed)
+			return;
+		size_t size = j->size ? j->size * 2 : 4096;
+		unsigned char * bytes = realloc(j->bytes, size);
+		if (!bytes) {
+			j->failed = 1;
+			return;
+		}
+		j->bytes = bytes;
+		j->size = size;
+	}
+	j->bytes[j->count++] = byte;
+}
+
+static void Jit_Bytes(jit_compiler * j, uint64_t value, int count) {
+	int i;
+	for (i = 0; i < count; ++i)
+		Jit_Byte(j, (value >> (8 * i)) & 0xff);
+}
+
+// REX prefix for a 64 bit operation (w) or one that names r8 .. r15
+static void Jit_Rex(jit_compiler * j, int w, int reg, int rm) {
+	int rex = w << 3 | (reg >> 3) << 2 | rm >> 3;
+	if (rex)
+		Jit_Byte(j, 0x40 | rex);
+}
+
+// ModRM for [base + disp32], rsp and r12 as the base take a SIB byte
+static void Jit_Mem(jit_compiler * j, int reg, int base, int32_t disp) {
+	Jit_Byte(j, 0x80 | (reg & 7) << 3 | (base & 7));
+	if ((base & 7) == JIT_RSP)
+		Jit_Byte(j, 0x24);
+	Jit_Bytes(j, (uint32_t)disp, 4);
+}
+
+// op reg, [base + disp] or op [base + disp], reg as opcode has it
+static void Jit_OpMem(jit_compiler * j, int opcode, int reg, int base, int32_t disp) {
+	Jit_Rex(j, 1, reg, base);
+	Jit_Byte(j, opcode);
+	Jit_Mem(j, reg, base, disp);
+}
+
+#define Jit_Load(j, reg, base, disp)  Jit_OpMem(j, JIT_LOAD, reg, base, disp)
+#define Jit_Store(j, base, disp, reg) Jit_OpMem(j, JIT_MOV, reg, base, disp)
+
+// op rm, reg
+static void Jit_OpReg(jit_compiler * j, int opcode, int rm, int reg) {
+	Jit_Rex(j, 1, reg, rm);
+	Jit_Byte(j, opcode);
+	Jit_Byte(j, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// op reg, imm32 of the 0x81 group
+static void Jit_OpImm(jit_compiler * j, int digit, int reg, int32_t imm) {
+	Jit_Rex(j, 1, 0, reg);
+	Jit_Byte(j, 0x81);
+	Jit_Byte(j, 0xc0 | digit << 3 | (reg & 7));
+	Jit_Bytes(j, (uint32_t)imm, 4);
+}
+
+// op qword [base + disp], imm32 of the 0x81 group
+static void Jit_OpMemImm(jit_compiler * j, int digit, int base, int32_t disp, int32_t imm) {
+	Jit_Rex(j, 1, 0, base);
+	Jit_Byte(j, 0x81);
+	Jit_Mem(j, digit, base, disp);
+	Jit_Bytes(j, (uint32_t)imm, 4);
+}
+
+static void Jit_StoreImm(jit_compiler * j, int base, int32_t disp, int32_t imm) {
+	Jit_Rex(j, 1, 0, base);
+	Jit_Byte(j, 0xc7);
+	Jit_Mem(j, 0, base, disp);
+	Jit_Bytes(j, (uint32_t)imm, 4);
+}
+
+// test reg32, imm32
+static void Jit_TestImm(jit_compiler * j, int reg, int32_t imm) {
+	Jit_Rex(j, 0, 0, reg);
+	Jit_Byte(j, 0xf7);
+	Jit_Byte(j, 0xc0 | (reg & 7));
+	Jit_Bytes(j, (uint32_t)imm, 4);
+}
+
+static void Jit_MovImm(jit_compiler * j, int reg, uint64_t imm) {
+	Jit_Rex(j, 1, 0, reg);
+	Jit_Byte(j, 0xb8 | (reg & 7));
+	Jit_Bytes(j, imm, 8);
+}
+
+// call reg
+static void Jit_CallReg(jit_compiler * j, int reg) {
+	Jit_Rex(j, 0, 0, reg);
+	Jit_Byte(j, 0xff);
+	Jit_Byte(j, 0xd0 | (reg & 7));
+}
+
+static void Jit_Call(jit_compiler * j, uintptr_t func) {
+	Jit_MovImm(j, JIT_RAX, func);
+	Jit_CallReg(j, JIT_RAX);
+}
+
+// jmp rel32, or jcc rel32 for a condition code, returns the position of
+// the rel32 to patch
+static size_t Jit_Jump(jit_compiler * j, int cc) {
+	if (cc < 0) {
+		Jit_Byte(j, 0xe9);
+	} else {
+		Jit_Byte(j, 0x0f);
+		Jit_Byte(j, 0x80 | cc);
+	}
+	size_t at = j->count;
+	Jit_Bytes(j, 0, 4);
+	return at;
+}
+
+static void Jit_Patch(jit_compiler * j, size_t at, size_t to) {
+	if (j->failed)
+		return;
+	int32_t rel = (int32_t)(to - (at + 4));
+	memcpy(j->bytes + at, &rel, 4);
+}
+
+static void Jit_PatchHere(jit_compiler * j, size_t at) {
+	Jit_Patch(j, at, j->count);
+}
+
+static void Jit_AddFixup(jit_compiler * j, jit_fixup ** list, int * count, int * size,
+	size_t at, int op)
+{
+	if (*count == *size) {
+		int new_size = *size ? *size * 2 : 64;
+		jit_fixup * fixups = realloc(*list, sizeof(jit_fixup) * new_size);
+		if (!fixups) {
+			j->failed = 1;
+			return;
+		}
+		*list = fixups;
+		*size = new_size;
+	}
+	(*list)[(*count)++] = (jit_fixup){ at, op };
+}
+
+// a jump to the instruction at op
+static void Jit_JumpTo(jit_compiler * j, int cc, int op) {
+	Jit_AddFixup(j, &j->jumps, &j->jump_count, &j->jump_size, Jit_Jump(j, cc), op);
+}
+
+// gives the frame back to the VM at the instruction at op
+static void Jit_Exit(jit_compiler * j, int cc, int op) {
+	Jit_AddFixup(j, &j->exits, &j->exit_count, &j->exit_size, Jit_Jump(j, cc), op);
+}
+
+static void Jit_JumpError(jit_compiler * j, int cc) {
+	Jit_Patch(j, Jit_Jump(j, cc), j->error);
+}
+
+/* Templates */
+
+// vm_sp = sp, before anything that may allocate
+static void Jit_SaveSP(jit_compiler * j) {
+	Jit_Store(j, JIT_VM_SP, 0, JIT_SP);
+}
+
+static void Jit_Push(jit_compiler * j, int reg) {
+	Jit_Store(j, JIT_SP, 0, reg);
+	Jit_OpImm(j, JIT_ADD_IMM, JIT_SP, sizeof(scheme_object *));
+}
+
+// sp += count slots, leaving the flags alone
+static void Jit_MoveSP(jit_compiler * j, int count) {
+	if (count)
+		Jit_OpMem(j, JIT_LEA, JIT_SP, JIT_SP, count * (int)sizeof(scheme_object *));
+}
+
+// reg = the operand count slots below the top
+static void Jit_Operand(jit_compiler * j, int reg, int count) {
+	Jit_Load(j, reg, JIT_SP, -count * (int)sizeof(scheme_object *));
+}
+
+// the value in rax takes the place of argc operands
+static void Jit_Result(jit_compiler * j, int argc) {
+	Jit_Store(j, JIT_SP, -argc * (int)sizeof(scheme_object *), JIT_RAX);
+	Jit_MoveSP(j, 1 - argc);
+}
+
+// a C function returning NULL has set the error
+static void Jit_CheckResult(jit_compiler * j) {
+	Jit_OpReg(j, JIT_TEST, JIT_RAX, JIT_RAX);
+	Jit_JumpError(j, JIT_E);
+}
+
+// the VM's guard on an inlined primitive, see VM_INLINE_GUARD
+static void Jit_InlineGuard(jit_compiler * j, int op) {
+	Jit_MovImm(j, JIT_RAX, (uintptr_t)&scheme_global_epoch);
+	Jit_Byte(j, 0x8b); // mov eax, [rax]
+	Jit_Byte(j, 0x00);
+	Jit_Byte(j, 0x3d); // cmp eax, imm32
+	Jit_Bytes(j, j->code->epoch, 4);
+	Jit_Exit(j, JIT_NE, op);
+}
+
+// jumps to where the OP_JUMP_IF_FALSE after the test at op goes, when
+// the flags have cc, and past it otherwise
+static void Jit_Branch(jit_compiler * j, int op, int cc) {
+	const scheme_op * ops = j->code->ops;
+	Jit_JumpTo(j, cc, ops[op + 3]);
+	Jit_JumpTo(j, -1, op + 4);
+}
+
+// the outcome of a test at op whose flags have cc for true, in place of
+// its argc operands. one fused with the jump after it (branch) jumps
+static void Jit_TestFlags(jit_compiler * j, int op, int cc, int argc, char branch) {
+	if (branch) {
+		Jit_MoveSP(j, -argc);
+		Jit_Branch(j, op, cc ^ 1);
+		return;
+	}
+
+	// SCHEME_FALSE_OBJ with bit 2 set for true, see SCHEME_IMMEDIATE
+	Jit_Byte(j, 0x0f); // setcc al
+	Jit_Byte(j, 0x90 | cc);
+	Jit_Byte(j, 0xc0);
+	Jit_Byte(j, 0x0f); // movzx eax, al
+	Jit_Byte(j, 0xb6);
+	Jit_Byte(j, 0xc0);
+	Jit_Byte(j, 0xc1); // shl eax, 2
+	Jit_Byte(j, 0xe0);
+	Jit_Byte(j, 0x02);
+	Jit_OpImm(j, JIT_ADD_IMM, JIT_RAX, (int32_t)(uintptr_t)SCHEME_FALSE_OBJ);
+	Jit_Result(j, argc);
+}
+
+// the same for a test whose value is in rax
+static void Jit_TestValue(jit_compiler * j, int op, int argc, char branch) {
+	if (!branch) {
+		Jit_Result(j, argc);
+		return;
+	}
+	Jit_MoveSP(j, -argc);
+	Jit_OpImm(j, JIT_CMP_IMM, JIT_RAX, (int32_t)(uintptr_t)SCHEME_FALSE_OBJ);
+	Jit_Branch(j, op, JIT_E);
+}
+
+// func(sp - 2, env, 2), the VM's call for anything but fixnums
+static void Jit_CallArithmetic(jit_compiler * j, uintptr_t func) {
+	Jit_SaveSP(j);
+	Jit_OpMem(j, JIT_LEA, JIT_RDI, JIT_SP, -2 * (int)sizeof(scheme_object *));
+	Jit_Load(j, JIT_RSI, JIT_CALL, offsetof(scheme_call, env));
+	Jit_MovImm(j, JIT_RDX, 2);
+	Jit_Call(j, func);
+	Jit_CheckResult(j);
+}
+
+// rax and rcx are the two operands, jumps to the returned rel32 unless
+// both are fixnums
+static size_t Jit_Fixnums(jit_compiler * j) {
+	Jit_Operand(j, JIT_RAX, 2);
+	Jit_Operand(j, JIT_RCX, 1);
+	Jit_OpReg(j, JIT_MOV, JIT_RDX, JIT_RAX);
+	Jit_OpReg(j, JIT_AND, JIT_RDX, JIT_RCX);
+	Jit_TestImm(j, JIT_RDX, SCHEME_FIXNUM_TAG);
+	return Jit_Jump(j, JIT_E);
+}
+
+// a primitive called with its two operands, the other way round for
+// swap, which may allocate
+static void Jit_CallPrimitive2(jit_compiler * j, uintptr_t func, char swap) {
+	Jit_SaveSP(j);
+	Jit_Operand(j, swap ? JIT_RSI : JIT_RDI, 2);
+	Jit_Operand(j, swap ? JIT_RDI : JIT_RSI, 1);
+	Jit_Call(j, func);
+	Jit_CheckResult(j);
+}
+
+// rax and rcx are the two operands, jumps to the returned rel32 unless
+// both are flonums, x ^ 4 has its low three bits clear for a flonum x
+static size_t Jit_Flonums(jit_compiler * j) {
+	Jit_Operand(j, JIT_RAX, 2);
+	Jit_Operand(j, JIT_RCX, 1);
+	Jit_OpReg(j, JIT_MOV, JIT_RDX, JIT_RAX);
+	Jit_OpImm(j, JIT_XOR_IMM, JIT_RDX, SCHEME_FLONUM_TAG);
+	Jit_OpReg(j, JIT_MOV, JIT_RSI, JIT_RCX);
+	Jit_OpImm(j, JIT_XOR_IMM, JIT_RSI, SCHEME_FLONUM_TAG);
+	Jit_OpReg(j, JIT_OR, JIT_RDX, JIT_RSI);
+	Jit_TestImm(j, JIT_RDX, 0x7);
+	return Jit_Jump(j, JIT_NE);
+}
+
+// the kinds both operands of the site at op were seen with, see
+// profile.h. a site that never ran while profiled gets the fixnum path
+static int Jit_SiteKinds(jit_compiler * j, int op) {
+	scheme_code * code = j->code;
+	scheme_feedback slot = code->feedback[op + 1 + scheme_ops[code->ops[op]].operands];
+	if (!slot)
+		return SCHEME_KIND_FIXNUM;
+	return Scheme_FeedbackKinds(slot, 0) & Scheme_FeedbackKinds(slot, 1);
+}
+
+// + and - of two fixnums work on them tagged, 2a+1 + 2b+1 - 1 is the tagged
+// sum, and overflow only when the result would not be a fixnum. func_fl
+// is the flonum primitive, tried where both operands have been seen as
+// flonums
+static void Jit_AddSub(jit_compiler * j, int op, char add, uintptr_t func, uintptr_t func_fl) {
+	int kinds = Jit_SiteKinds(j, op);
+	Jit_InlineGuard(j, op);
+
+	size_t done = JIT_NONE, done_fl = JIT_NONE;
+	if (kinds & SCHEME_KIND_FIXNUM) {
+		size_t slow = Jit_Fixnums(j);
+		Jit_OpReg(j, JIT_MOV, JIT_RDX, JIT_RAX);
+		size_t overflow;
+		if (add) {
+			Jit_OpImm(j, JIT_SUB_IMM, JIT_RDX, 1);
+			Jit_OpReg(j, JIT_ADD, JIT_RDX, JIT_RCX);
+			overflow = Jit_Jump(j, JIT_O);
+		} else {
+			Jit_OpReg(j, JIT_SUB, JIT_RDX, JIT_RCX);
+			overflow = Jit_Jump(j, JIT_O);
+			Jit_OpImm(j, JIT_ADD_IMM, JIT_RDX, 1);
+		}
+		Jit_Store(j, JIT_SP, -2 * (int)sizeof(scheme_object *), JIT_RDX);
+		Jit_MoveSP(j, -1);
+		done = Jit_Jump(j, -1);
+
+		Jit_PatchHere(j, slow);
+		Jit_PatchHere(j, overflow);
+	}
+	if (kinds & SCHEME_KIND_FLONUM) {
+		size_t slow = Jit_Flonums(j);
+		Jit_CallPrimitive2(j, func_fl, 0);
+		done_fl = Jit_Jump(j, -1);
+		Jit_PatchHere(j, slow);
+	}
+
+	Jit_CallArithmetic(j, func);
+	if (done_fl != JIT_NONE)
+		Jit_PatchHere(j, done_fl);
+	Jit_Result(j, 2);
+	if (done != JIT_NONE)
+		Jit_PatchHere(j, done);
+}
+
+// fixnums compare tagged as they are. func_fl is the flonum primitive
+// for a site that has seen flonums, if there is one, called with the
+// operands the other way round for swap
+static void Jit_Compare(jit_compiler * j, int op, int cc, char branch, uintptr_t func,
+	uintptr_t func_fl, char swap)
+{
+	int kinds = Jit_SiteKinds(j, op);
+	Jit_InlineGuard(j, op);
+
+	size_t done = JIT_NONE, done_fl = JIT_NONE;
+	if (kinds & SCHEME_KIND_FIXNUM) {
+		size_t slow = Jit_Fixnums(j);
+		Jit_OpReg(j, JIT_CMP, JIT_RAX, JIT_RCX);
+		Jit_TestFlags(j, op, cc, 2, branch);
+		if (!branch)
+			done = Jit_Jump(j, -1);
+		Jit_PatchHere(j, slow);
+	}
+	if ((kinds & SCHEME_KIND_FLONUM) && func_fl) {
+		size_t slow = Jit_Flonums(j);
+		Jit_CallPrimitive2(j, func_fl, swap);
+		Jit_TestValue(j, op, 2, branch);
+		if (!branch)
+			done_fl = Jit_Jump(j, -1);
+		Jit_PatchHere(j, slow);
+	}
+
+	Jit_CallArithmetic(j, func);
+	Jit_TestValue(j, op, 2, branch);
+	if (done != JIT_NONE)
+		Jit_PatchHere(j, done);
+	if (done_fl != JIT_NONE)
+		Jit_PatchHere(j, done_fl);
+}
+
+// car or cdr at offset in a pair, the primitive raises the error otherwise
+static void Jit_PairField(jit_compiler * j, int op, size_t offset, uintptr_t func) {
+	Jit_InlineGuard(j, op);
+	Jit_Operand(j, JIT_RDI, 1);
+	Jit_TestImm(j, JIT_RDI, SCHEME_TAG_MASK);
+	size_t immediate = Jit_Jump(j, JIT_NE);
+	Jit_Byte(j, 0x80); // cmp byte [rdi], SCHEME_PAIR
+	Jit_Mem(j, 7, JIT_RDI, offsetof(scheme_object, type));
+	Jit_Byte(j, SCHEME_PAIR);
+	size_t other = Jit_Jump(j, JIT_NE);
+	Jit_Load(j, JIT_RAX, JIT_RDI, JIT_PAYLOAD + offset);
+	size_t done = Jit_Jump(j, -1);
+
+	Jit_PatchHere(j, immediate);
+	Jit_PatchHere(j, other);
+	Jit_Call(j, func);
+	Jit_CheckResult(j);
+	Jit_PatchHere(j, done);
+	Jit_Result(j, 1);
+}
+
+static void Scheme_JitSetEnv(scheme_call * call, scheme_object * val, int slot) {
+	((scheme_env *)call->env->payload)->slots[slot] = val;
+	GC_WRITE_BARRIER(call->env, val);
+}
+
+// OP_MAKE_ENV, 1 for success, 0 for error
+static int Scheme_JitMakeEnv(scheme_call * call, scheme_object ** sp, int n, int size) {
+	scheme_object * env = Scheme_CreateEnvObj(call->env, size);
+	if (!env)
+		return 0;
+	memcpy(Scheme_GetEnvObj(env)->slots, sp - n, sizeof(scheme_object *) * n);
+	call->env = env;
+	return 1;
+}
+
+// a tail call from the code to the lambda running it reuses the frame,
+// the arguments take the place of the old ones and the machine code starts
+// over. anything else is handed back to the VM
+static void Jit_TailCall(jit_compiler * j, int op, int n) {
+	scheme_code * code = j->code;
+	if (n != code->arg_count || code->captured || code->dot_args) {
+		Jit_Exit(j, -1, op);
+		return;
+	}
+
+	Jit_Operand(j, JIT_RAX, n + 1);
+	Jit_OpMem(j, JIT_CMP_LOAD, JIT_RAX, JIT_CALL, offsetof(scheme_call, proc));
+	Jit_Exit(j, JIT_NE, op);
+
+	int i;
+	for (i = 0; i < n; ++i) {
+		Jit_Operand(j, JIT_RCX, n - i);
+		Jit_Store(j, JIT_FP, i * (int)sizeof(scheme_object *), JIT_RCX);
+	}
+	for (; i < code->frame_size; ++i)
+		Jit_StoreImm(j, JIT_FP, i * (int)sizeof(scheme_object *), 0);
+
+	// as Scheme_EnterFrame leaves it, a let may have changed env
+	Jit_Load(j, JIT_RAX, JIT_RAX, JIT_PAYLOAD + offsetof(scheme_lambda, closure));
+	Jit_Store(j, JIT_CALL, offsetof(scheme_call, env), JIT_RAX);
+	Jit_OpMem(j, JIT_LEA, JIT_SP, JIT_FP, code->frame_size * (int)sizeof(scheme_object *));
+	// a loop, counted as the VM counts it
+	Jit_MovImm(j, JIT_RAX, (uintptr_t)&code->loops);
+	Jit_OpMemImm(j, JIT_ADD_IMM, JIT_RAX, 0, 1);
+#ifdef SCHEME_ALLOC_STATS
+	Jit_MovImm(j, JIT_RAX, (uintptr_t)&scheme_call_count);
+	Jit_OpMemImm(j, JIT_ADD_IMM, JIT_RAX, 0, 1);
+#endif
+	Jit_JumpTo(j, -1, 0);
+}
+
+static void Jit_Op(jit_compiler * j, int op) {
+	scheme_code * code = j->code;
+	const scheme_op * pc = code->ops + op + 1;
+	int slot = sizeof(scheme_object *);
+	int i;
+
+	switch (code->ops[op]) {
+	case OP_CONST:
+		Jit_MovImm(j, JIT_RAX, (uintptr_t)&code->consts[pc[0]]);
+		Jit_Load(j, JIT_RAX, JIT_RAX, 0);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_LOCAL:
+		Jit_Load(j, JIT_RAX, JIT_FP, pc[0] * slot);
+		Jit_OpReg(j, JIT_TEST, JIT_RAX, JIT_RAX);
+		Jit_Exit(j, JIT_E, op);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_SET_LOCAL:
+		Jit_MoveSP(j, -1);
+		Jit_Load(j, JIT_RAX, JIT_SP, 0);
+		Jit_Store(j, JIT_FP, pc[0] * slot, JIT_RAX);
+		break;
+
+	case OP_UNBIND:
+		Jit_StoreImm(j, JIT_FP, pc[0] * slot, 0);
+		break;
+
+	case OP_ENV:
+		Jit_Load(j, JIT_RAX, JIT_CALL, offsetof(scheme_call, env));
+		for (i = 0; i < pc[0]; ++i)
+			Jit_Load(j, JIT_RAX, JIT_RAX, JIT_PAYLOAD + offsetof(scheme_env, parent));
+		Jit_Load(j, JIT_RAX, JIT_RAX, JIT_PAYLOAD + offsetof(scheme_env, slots));
+		Jit_Load(j, JIT_RAX, JIT_RAX, pc[1] * slot);
+		Jit_OpReg(j, JIT_TEST, JIT_RAX, JIT_RAX);
+		Jit_Exit(j, JIT_E, op);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_SET_ENV:
+		Jit_MoveSP(j, -1);
+		Jit_OpReg(j, JIT_MOV, JIT_RDI, JIT_CALL);
+		Jit_Load(j, JIT_RSI, JIT_SP, 0);
+		Jit_MovImm(j, JIT_RDX, pc[0]);
+		Jit_Call(j, (uintptr_t)Scheme_JitSetEnv);
+		break;
+
+	case OP_GLOBAL:
+		Jit_MovImm(j, JIT_RAX, (uintptr_t)code->cells[pc[0]]);
+		Jit_Load(j, JIT_RAX, JIT_RAX, offsetof(scheme_define, object));
+		Jit_OpReg(j, JIT_TEST, JIT_RAX, JIT_RAX);
+		Jit_Exit(j, JIT_E, op);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_POP:
+		Jit_MoveSP(j, -1);
+		break;
+
+	case OP_DUP:
+		Jit_Operand(j, JIT_RAX, 1);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_JUMP:
+		Jit_JumpTo(j, -1, pc[0]);
+		break;
+
+	case OP_JUMP_IF_FALSE: {
+		// #f and #t without a call, Scheme_BoolTest decides the rest
+		Jit_MoveSP(j, -1);
+		Jit_Load(j, JIT_RDI, JIT_SP, 0);
+		Jit_OpImm(j, JIT_CMP_IMM, JIT_RDI, (int32_t)(uintptr_t)SCHEME_FALSE_OBJ);
+		Jit_JumpTo(j, JIT_E, pc[0]);
+		Jit_OpImm(j, JIT_CMP_IMM, JIT_RDI, (int32_t)(uintptr_t)SCHEME_TRUE_OBJ);
+		size_t truth = Jit_Jump(j, JIT_E);
+		Jit_Call(j, (uintptr_t)Scheme_BoolTest);
+		Jit_Byte(j, 0x84); // test al, al
+		Jit_Byte(j, 0xc0);
+		Jit_JumpTo(j, JIT_E, pc[0]);
+		Jit_PatchHere(j, truth);
+		break; }
+
+	case OP_CLOSURE:
+		Jit_SaveSP(j);
+		Jit_MovImm(j, JIT_RAX, (uintptr_t)&code->consts[pc[0]]);
+		Jit_Load(j, JIT_RDI, JIT_RAX, 0);
+		Jit_Load(j, JIT_RSI, JIT_CALL, offsetof(scheme_call, env));
+		Jit_Call(j, (uintptr_t)Scheme_CreateLambda);
+		Jit_CheckResult(j);
+		Jit_Push(j, JIT_RAX);
+		break;
+
+	case OP_MAKE_ENV:
+		Jit_SaveSP(j);
+		Jit_OpReg(j, JIT_MOV, JIT_RDI, JIT_CALL);
+		Jit_OpReg(j, JIT_MOV, JIT_RSI, JIT_SP);
+		Jit_MovImm(j, JIT_RDX, pc[0]);
+		Jit_MovImm(j, JIT_RCX, pc[1]);
+		Jit_Call(j, (uintptr_t)Scheme_JitMakeEnv);
+		Jit_CheckResult(j);
+		Jit_MoveSP(j, -pc[0]);
+		break;
+
+	case OP_POP_ENV:
+		Jit_Load(j, JIT_RAX, JIT_CALL, offsetof(scheme_call, env));
+		Jit_Load(j, JIT_RAX, JIT_RAX, JIT_PAYLOAD + offsetof(scheme_env, parent));
+		Jit_Store(j, JIT_CALL, offsetof(scheme_call, env), JIT_RAX);
+		break;
+
+	case OP_TAIL_CALL:
+		Jit_TailCall(j, op, pc[0]);
+		break;
+
+	case OP_PRIM0:
+	case OP_PRIM1:
+	case OP_PRIM2:
+	case OP_PRIM3: {
+		// called directly while the global still holds the primitive
+		int argc = code->ops[op] - OP_PRIM0;
+		Jit_MovImm(j, JIT_RAX, (uintptr_t)code->cells[pc[0]]);
+		Jit_Load(j, JIT_R11, JIT_RAX, offsetof(scheme_define, object));
+		Jit_MovImm(j, JIT_RAX, (uintptr_t)&code->consts[pc[1]]);
+		Jit_OpMem(j, JIT_CMP_LOAD, JIT_R11, JIT_RAX, 0);
+		Jit_Exit(j, JIT_NE, op);
+
+		Jit_SaveSP(j);
+		static const int args[] = { JIT_RDI, JIT_RSI, JIT_RDX };
+		for (i = 0; i < argc; ++i)
+			Jit_Operand(j, args[i], argc - i);
+		Jit_Load(j, JIT_R11, JIT_R11, JIT_PAYLOAD + offsetof(scheme_cfunc, func0));
+		Jit_CallReg(j, JIT_R11);
+		Jit_CheckResult(j);
+		Jit_Result(j, argc);
+		break; }
+
+	case OP_ADD:
+		Jit_AddSub(j, op, 1, (uintptr_t)__Scheme_CallAdd__, (uintptr_t)__Flonum_Add__);
+		break;
+	case OP_SUB:
+		Jit_AddSub(j, op, 0, (uintptr_t)__Scheme_CallSub__, (uintptr_t)__Flonum_Sub__);
+		break;
+
+	case OP_NUM_EQ:
+	case OP_NUM_EQ_JIF:
+		Jit_Compare(j, op, JIT_E, code->ops[op] == OP_NUM_EQ_JIF, (uintptr_t)__Scheme_CallAEqual__,
+			0, 0);
+		break;
+	case OP_LT:
+	case OP_LT_JIF:
+		Jit_Compare(j, op, JIT_L, code->ops[op] == OP_LT_JIF, (uintptr_t)__Scheme_CallALessThan__,
+			(uintptr_t)__Flonum_LessThan__, 0);
+		break;
+	case OP_GT:
+	case OP_GT_JIF:
+		Jit_Compare(j, op, JIT_G, code->ops[op] == OP_GT_JIF, (uintptr_t)__Scheme_CallAGreaterThan__,
+			(uintptr_t)__Flonum_LessThan__, 1);
+		break;
+
+	case OP_CONS:
+		Jit_InlineGuard(j, op);
+		Jit_CallPrimitive2(j, (uintptr_t)Scheme_CreatePair, 0);
+		Jit_Result(j, 2);
+		break;
+
+	case OP_CAR:
+		Jit_PairField(j, op, offsetof(scheme_pair, car), (uintptr_t)__Scheme_car__);
+		break;
+	case OP_CDR:
+		Jit_PairField(j, op, offsetof(scheme_pair, cdr), (uintptr_t)__Scheme_cdr__);
+		break;
+
+	case OP_NULLP:
+	case OP_NULLP_JIF:
+		Jit_InlineGuard(j, op);
+		Jit_OpMemImm(j, JIT_CMP_IMM, JIT_SP, -slot, (int32_t)(uintptr_t)SCHEME_NULL_OBJ);
+		Jit_TestFlags(j, op, JIT_E, 1, code->ops[op] == OP_NULLP_JIF);
+		break;
+
+	case OP_FL_ADD:
+		Jit_InlineGuard(j, op);
+		Jit_CallPrimitive2(j, (uintptr_t)__Flonum_Add__, 0);
+		Jit_Result(j, 2);
+		break;
+	case OP_FL_SUB:
+		Jit_InlineGuard(j, op);
+		Jit_CallPrimitive2(j, (uintptr_t)__Flonum_Sub__, 0);
+		Jit_Result(j, 2);
+		break;
+	case OP_FL_MUL:
+		Jit_InlineGuard(j, op);
+		Jit_CallPrimitive2(j, (uintptr_t)__Flonum_Mul__, 0);
+		Jit_Result(j, 2);
+		break;
+	case OP_FL_LT:
+	case OP_FL_LT_JIF:
+		Jit_InlineGuard(j, op);
+		Jit_CallPrimitive2(j, (uintptr_t)__Flonum_LessThan__, 0);
+		Jit_TestValue(j, op, 2, code->ops[op] == OP_FL_LT_JIF);
+		break;
+
+	default:
+		// calls, returns and top level definitions are left to the VM
+		Jit_Exit(j, -1, op);
+		break;
+	}
+}
+
+// entered with call, sp and the entry in rdi, rsi and rdx. pushes four
+// registers, which with the return address keeps rsp 16 byte aligned for
+// the calls out after the sub
+static void Jit_Prologue(jit_compiler * j) {
+	Jit_Byte(j, 0x53);                     // push rbx
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x54);  // push r12
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x55);  // push r13
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x56);  // push r14
+	Jit_OpImm(j, JIT_SUB_IMM, JIT_RSP, 8);
+	Jit_OpReg(j, JIT_MOV, JIT_CALL, JIT_RDI);
+	Jit_OpReg(j, JIT_MOV, JIT_SP, JIT_RSI);
+	Jit_Load(j, JIT_FP, JIT_CALL, offsetof(scheme_call, fp));
+	Jit_MovImm(j, JIT_VM_SP, (uintptr_t)&vm_sp);
+	Jit_Byte(j, 0xff); Jit_Byte(j, 0xe2);  // jmp rdx
+
+	// rax holds the instruction to carry on from, or NULL for an error
+	j->exit = j->count;
+	Jit_SaveSP(j);
+	size_t leave = j->count;
+	Jit_OpImm(j, JIT_ADD_IMM, JIT_RSP, 8);
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x5e);  // pop r14
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x5d);  // pop r13
+	Jit_Byte(j, 0x41); Jit_Byte(j, 0x5c);  // pop r12
+	Jit_Byte(j, 0x5b);                     // pop rbx
+	Jit_Byte(j, 0xc3);                     // ret
+
+	j->error = j->count;
+	Jit_Byte(j, 0x31); Jit_Byte(j, 0xc0);  // xor eax, eax
+	Jit_Patch(j, Jit_Jump(j, -1), leave);
+}
+
+int Scheme_JitCompile(scheme_code * code) {
+	jit_compiler j;
+	memset(&j, 0, sizeof(j));
+	j.code = code;
+	j.labels = malloc(sizeof(size_t) * code->op_count);
+	size_t * stubs = malloc(sizeof(size_t) * code->op_count);
+	void ** entries = malloc(sizeof(void *) * code->op_count);
+	if (!j.labels || !stubs || !entries)
+		j.failed = 1;
+
+	int op, i;
+	if (!j.failed) {
+		for (op = 0; op < code->op_count; ++op)
+			j.labels[op] = stubs[op] = JIT_NONE;
+
+		Jit_Prologue(&j);
+		for (op = 0; op < code->op_count; op += 1 + scheme_ops[code->ops[op]].operands) {
+			j.labels[op] = j.count;
+			Jit_Op(&j, op);
+		}
+
+		// one stub for each instruction handed back to the VM
+		for (i = 0; i < j.exit_count; ++i) {
+			op = j.exits[i].op;
+			if (stubs[op] == JIT_NONE) {
+				stubs[op] = j.count;
+				Jit_MovImm(&j, JIT_RAX, (uintptr_t)(code->ops + op));
+				Jit_Patch(&j, Jit_Jump(&j, -1), j.exit);
+			}
+			Jit_Patch(&j, j.exits[i].at, stubs[op]);
+		}
+		for (i = 0; i < j.jump_count; ++i)
+			Jit_Patch(&j, j.jumps[i].at, j.labels[j.jumps[i].op]);
+	}
+
+	// written to a mapping of its own, then made executable
+	void * region = MAP_FAILED;
+	size_t size = 0;
+	if (!j.failed) {
+		size_t page = 4096;
+		size = (j.count + page - 1) / page * page;
+		region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (region != MAP_FAILED) {
+		memcpy(region, j.bytes, j.count);
+		if (mprotect(region, size, PROT_READ | PROT_EXEC)) {
+			munmap(region, size);
+			region = MAP_FAILED;
+		}
+	}
+
+	scheme_jit_code * jit = NULL;
+	if (region != MAP_FAILED) {
+		jit = malloc(sizeof(scheme_jit_code));
+		if (jit) {
+			jit->func = (scheme_jit_func)region;
+			jit->size = size;
+			jit->entries = entries;
+			for (op = 0; op < code->op_count; ++op)
+				entries[op] = j.labels[op] == JIT_NONE ? NULL : (char *)region + j.labels[op];
+		} else {
+			munmap(region, size);
+		}
+	}
+	if (!jit)
+		free(entries);
+
+	free(j.bytes);
+	free(j.labels);
+	free(j.jumps);
+	free(j.exits);
+	free(stubs);
+
+	code->jit = jit;
+	return jit != NULL;
+}
+
+void Scheme_JitFree(scheme_jit_code * jit) {
+	if (!jit)
+		return;
+	munmap((void *)jit->func, jit->size);
+	free(jit->entries);
+	free(jit);
+}
+
+#endif
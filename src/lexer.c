@@ -1,5 +1,7 @@
 #include "lexer.h"
 
+#include <errno.h>
+
 char * __ERR_MSG__EXPECTED_QUOTE__ = "Expected terminating \" character";
 char * __ERR_MSG__MALFORMED_NUMBER__ = "Malformed number literal";
 char * __ERR_MSG__MALFORMED_BOOLEAN__ = "Malformed boolean literal";
@@ -260,6 +262,7 @@ int Lexer_AnalyseNumber(struct lexer * lex) {
 
 	char * endptr, * lastchar;
 
+	errno = 0;
 	if (lex->number_type == NUMBER_DOUBLE)
 		lex->double_val   = strtod(buff.buffer, &endptr);
 	else
@@ -273,6 +276,13 @@ int Lexer_AnalyseNumber(struct lexer * lex) {
 		return TOKEN_EOF;
 	}
 
+	// too big for a long long, the parser makes a bignum of the digits
+	if (lex->number_type == NUMBER_INTEGER && errno == ERANGE) {
+		lex->number_type = NUMBER_BIGINT;
+		lex->string = buff.buffer;
+		return TOKEN_NUMBER;
+	}
+
 	FreeStringBuffer(&buff);
 	return TOKEN_NUMBER;
 }
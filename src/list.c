@@ -1,21 +1,8 @@
 #include "list.h"
+#include "gc.h"
 
 int Scheme_IsPair(scheme_object * obj) {
-	return obj && obj->type == SCHEME_PAIR;
-}
-
-int Scheme_IsNull(scheme_object * obj) {
-	if (!obj || obj->type == SCHEME_NULL)
-		return 1;
-	if (obj->type == SCHEME_PAIR) {
-		scheme_pair * p = Scheme_GetPair(obj);
-		if ((!p->car || p->car->type==SCHEME_NULL) &&
-		    (!p->cdr || p->cdr->type==SCHEME_NULL))
-		{
-			return 1;
-		}
-	}
-	return 0;
+	return Scheme_Type(obj) == SCHEME_PAIR;
 }
 
 int Scheme_ListLength(scheme_object * obj) {
@@ -26,19 +13,17 @@ int Scheme_ListLength(scheme_object * obj) {
 		return 0;
 	}
 
-	int count = 1;
-	while (1) {
-		if (node->type != SCHEME_PAIR) {
+	int count = 0;
+	while (!Scheme_IsNull(node)) {
+		if (Scheme_Type(node) != SCHEME_PAIR) {
 			Scheme_SetError("ListLength() on non-list");
 			return 0;
 		}
 
-		scheme_pair * p = Scheme_GetPair(node);
-		if (Scheme_IsNull(p->cdr))
-			return count;
-		node = p->cdr;
+		node = Scheme_GetPair(node)->cdr;
 		++count;
 	}
+	return count;
 }
 
 #define TEST_NULL(obj, fail) if(obj==NULL){Scheme_SetError("operation on null object");return fail;}
@@ -60,9 +45,18 @@ scheme_object * Scheme_Cdr(scheme_object * obj) {
 	return pair->cdr;
 }
 
+// every store into an existing pair goes through these for the write barrier
+void Scheme_SetCar(scheme_object * pair, scheme_object * obj) {
+	Scheme_GetPair(pair)->car = obj;
+	GC_WRITE_BARRIER(pair, obj);
+}
+
+void Scheme_SetCdr(scheme_object * pair, scheme_object * obj) {
+	Scheme_GetPair(pair)->cdr = obj;
+	GC_WRITE_BARRIER(pair, obj);
+}
+
 scheme_object * Scheme_Cons(scheme_object * a, scheme_object * b) {
-	if (a && a->type == SCHEME_NULL) a = NULL;
-	if (b && b->type == SCHEME_NULL) b = NULL;
 	return Scheme_CreatePair(a , b);
 }
 
@@ -73,20 +67,23 @@ scheme_object * Scheme_ListFromArray(scheme_object ** array, int count) {
 		return NULL;
 	}
 
-	scheme_object * base = Scheme_CreatePair(array[0], NULL),
+	scheme_object * base = Scheme_CreatePair(array[0], SCHEME_NULL_OBJ),
 	              * prev = base;
+	GC_PROTECT(base);
+	GC_PROTECT(prev);
 	int i;
 	for (i = 1; i < count; ++i) {
-		scheme_object * new_pair = Scheme_CreatePair(array[i], NULL);
-		Scheme_GetPair(prev)->cdr = new_pair;
+		scheme_object * new_pair = Scheme_CreatePair(array[i], SCHEME_NULL_OBJ);
+		Scheme_SetCdr(prev, new_pair);
 		prev = new_pair;
 	}
 
+	GC_UNPROTECT(2);
 	return base;
 }
 
 scheme_object * Scheme_AppendList(scheme_object * list, scheme_object * obj) {
-	if (!list || list->type != SCHEME_PAIR) {
+	if (Scheme_Type(list) != SCHEME_PAIR) {
 		Scheme_SetError("attempt to append to non-pair object");
 		return NULL;
 	}
@@ -94,8 +91,12 @@ scheme_object * Scheme_AppendList(scheme_object * list, scheme_object * obj) {
 	scheme_object * iter = list;
 	while (1) {
 		scheme_pair * pair = Scheme_GetPair(iter);
-		if (!pair->cdr) {
-			pair->cdr = Scheme_CreatePair(obj, NULL);
+		if (Scheme_IsNull(pair->cdr)) {
+			GC_PROTECT(list);
+			GC_PROTECT(iter);
+			scheme_object * new_pair = Scheme_CreatePair(obj, SCHEME_NULL_OBJ);
+			Scheme_SetCdr(iter, new_pair);
+			GC_UNPROTECT(2);
 			return list;
 		} else {
 			iter = pair->cdr;
@@ -1,5 +1,8 @@
 #include "parser.h"
 #include "scheme.h"
+#include "slab.h"
+#include "gc.h"
+#include "jit.h"
 
 void test_lexer(struct lexer * lex) {
 	int token;
@@ -12,22 +15,16 @@ void test_lexer(struct lexer * lex) {
 			obj = Scheme_CreateString(lex->string);
 			Scheme_Display(obj);
 			Scheme_Newline();
-			Scheme_FreeObject(obj);
 			break;
 		case TOKEN_SYMBOL:
 			obj = Scheme_CreateSymbol(lex->symbol);
 			Scheme_Display(obj);
 			Scheme_Newline();
-			Scheme_FreeObject(obj);
 			break;
 		case TOKEN_NUMBER:
-			if (lex->number_type == NUMBER_DOUBLE)
-				obj = Scheme_CreateDouble(lex->double_val);
-			else if (lex->number_type == NUMBER_INTEGER)
-				obj = Scheme_CreateInteger(lex->integer_val);
+			obj = Parser_ParseNumber(lex);
 			Scheme_Display(obj);
 			Scheme_Newline();
-			Scheme_FreeObject(obj);
 			break;
 		default:
 			printf("%c ", (char)token);
@@ -57,11 +54,16 @@ int main(int argc, char ** argv) {
 	}*/
 
 	InitSymTable(SYM_TABLE_INIT_SIZE);
+	Scheme_InitGC();
 
 	Lexer_LoadFromStream(&lex, stdin);
 	Scheme_DefineStartupEnv();
 
 	Scheme_InitCallStack(SCHEME_STACK_SIZE);
+	Scheme_InitVM(VM_STACK_SIZE);
+#ifdef SCHEME_JIT
+	Scheme_InitJIT();
+#endif
 
 	//Scheme_DisplayEnv(SYSTEM_GLOBAL_ENVIRONMENT);
 	//DisplaySymbolTable();
@@ -71,23 +73,37 @@ int main(int argc, char ** argv) {
 		scheme_object * obj = Parser_Parse(&lex);
 		if (!obj) break;
 
+		GC_PROTECT(obj);
 		scheme_object * eval_result = Scheme_Eval(obj, USER_INITIAL_ENVIRONMENT_OBJ);
 		char * err = Scheme_GetError();
 
-		if (eval_result) {
+		if (eval_result == SCHEME_UNSPECIFIED_OBJ) {
+			// nothing to print
+		} else if (eval_result) {
 			Scheme_Display(eval_result);
 			printf("\n");
 		} else if (err) {
 			printf("%s\n", err);
 		}
 
-		Scheme_DereferenceObject(&obj);
-		Scheme_DereferenceObject(&eval_result);
+		// an error unwinds without popping its roots
+		gc_root_count = 0;
 	}
 
+#ifdef SCHEME_ALLOC_STATS
+	Scheme_DisplayAllocStats();
+	Slab_DisplayStats();
+	Scheme_DisplayGCStats();
+#endif
+#ifdef SCHEME_VM_STATS
+	Scheme_DisplayVMStats();
+#endif
+
+	Scheme_FreeVM();
 	Scheme_FreeCallStack();
 	Scheme_FreeStartupEnv();
 	FreeSymTable();
+	Slab_FreeAll();
 	
 	//fclose(file);
 	//Lexer_Free(&lex);
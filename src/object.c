@@ -1,250 +1,211 @@
 #include "object.h"
 #include "scheme.h"
+#include "slab.h"
+#include "gc.h"
+#include "bigint.h"
+#include "jit.h"
 
-int Scheme_AllocateObject(scheme_object ** object, int type) {
-	*object = malloc(sizeof(scheme_object));
-	if (!*object) {
-		Scheme_SetError("runtime malloc(scheme_object) error");
-		return 0;
+size_t Scheme_PayloadSize(int type) {
+	switch (type) {
+	case SCHEME_PAIR  : return sizeof(scheme_pair);
+	case SCHEME_NUMBER: return sizeof(scheme_number);
+	case SCHEME_SYMBOL: return sizeof(scheme_symbol);
+	case SCHEME_STRING: return sizeof(scheme_string);
+	case SCHEME_LAMBDA: return sizeof(scheme_lambda);
+	case SCHEME_ENV   : return sizeof(scheme_env);
+	case SCHEME_CFUNC : return sizeof(scheme_cfunc);
+	case SCHEME_REF   : return sizeof(scheme_ref);
+	case SCHEME_CODE  : return sizeof(scheme_code);
+	default: return 0;
 	}
+}
 
+// slab class an object type is allocated from
+int Scheme_ObjectSlab(int type) {
 	switch (type) {
-	case SCHEME_NULL:
-		(*object)->payload = NULL;
-		return 1;
-	case SCHEME_PAIR:
-		(*object)->payload = malloc(sizeof(scheme_pair));
-		break;
-	case SCHEME_NUMBER:
-		(*object)->payload = malloc(sizeof(scheme_number));
-		break;
-	case SCHEME_BOOLEAN:
-		(*object)->payload = malloc(sizeof(scheme_boolean));
-		break;
-	case SCHEME_SYMBOL:
-		(*object)->payload = malloc(sizeof(scheme_symbol));
-		break;
-	case SCHEME_STRING:
-		(*object)->payload = malloc(sizeof(scheme_string));
-		break;
-	case SCHEME_LAMBDA:
-		(*object)->payload = malloc(sizeof(scheme_lambda));
-		break;
-	case SCHEME_ENV:
-		(*object)->payload = malloc(sizeof(scheme_env));
-		break;
-	case SCHEME_CFUNC:
-		(*object)->payload = malloc(sizeof(scheme_cfunc));
-		break;
-	default:
-		free(*object);
+	case SCHEME_PAIR  : return SLAB_PAIR;
+	case SCHEME_NUMBER: return SLAB_NUMBER;
+	case SCHEME_ENV   : return SLAB_ENV;
+	case SCHEME_LAMBDA: return SLAB_LAMBDA;
+	case SCHEME_STRING: return SLAB_STRING;
+	case SCHEME_SYMBOL: return SLAB_SYMBOL;
+	case SCHEME_REF   : return SLAB_REF;
+	case SCHEME_CODE  : return SLAB_CODE;
+	default: return SLAB_CFUNC;
+	}
+}
+
+size_t Scheme_ObjectSize(int type) {
+	return slab_classes[Scheme_ObjectSlab(type)].cell_size;
+}
+
+int Scheme_AllocateObject(scheme_object ** object, int type) {
+	size_t payload_size = Scheme_PayloadSize(type);
+	if (!payload_size) {
 		Scheme_SetError("invalid type given to Scheme_AllocateObject");
 		return 0;
 	}
 
-	if ((*object)->payload == NULL) {
-		free(*object);
-		Scheme_SetError("runtime malloc(payload) error");
-		return 0;
+	int slab = Scheme_ObjectSlab(type);
+	size_t size = slab_classes[slab].cell_size;
+
+#ifdef SCHEME_GC_STRESS
+	// every other allocation runs a minor collection, the rest a major one
+	static int stress;
+	if (++stress & 1)
+		Scheme_GCMinor();
+	else
+		Scheme_GCCollect();
+#endif
+
+	if (gc_stats.external >= gc_stats.external_threshold)
+		Scheme_GCCollectExternal();
+
+	if (gc_pretenure) {
+		// header and payload share a single slab cell
+		if (++gc_stats.allocated >= gc_stats.threshold)
+			Scheme_GCCollect();
+
+		*object = Slab_Alloc(slab);
+		if (!*object) {
+			Scheme_SetError("runtime malloc(scheme_object) error");
+			return 0;
+		}
+	} else {
+		if (gc_nursery_top + size > gc_nursery_end)
+			Scheme_GCMinor();
+
+		*object = (scheme_object *)gc_nursery_top;
+		gc_nursery_top += size;
 	}
 
 	(*object)->type = type;
-	(*object)->ref_count = 1;
+	(*object)->mark = 0;
+	(*object)->age  = 0;
+
+#ifdef SCHEME_ALLOC_STATS
+	++scheme_alloc_count[type];
+#endif
 	return 1;
 }
 
-void Scheme_ReferenceObject(scheme_object ** pointer, scheme_object * object) {
-	*pointer = object;
-	if (object) ++object->ref_count;
-}
-
-void Scheme_DereferenceObject(scheme_object ** pointer) {
-	if (!pointer) return;
-
-	if (*pointer) {
-		(*pointer)->ref_count -= 1;
-		if ((*pointer)->ref_count == 0) {
-			Scheme_FreeObject(*pointer);
-		} else {
-			/*if ((*pointer)->type == SCHEME_ENV) {
-				scheme_env * env = Scheme_GetEnvObj(*pointer);
-				Scheme_DereferenceObject(&env->parent);
-			}*/
-	
-			/*if ((*pointer)->type == SCHEME_LAMBDA) {
-				scheme_lambda * lambda = Scheme_GetLambda(*pointer);
-				Scheme_DereferenceObject(&lambda->closure);
-			}*/
-		}
-		*pointer = NULL;
-	}
-}
+#ifdef SCHEME_ALLOC_STATS
+size_t scheme_alloc_count[SCHEME_UNSPECIFIED + 1];
+size_t scheme_malloc_count;
+size_t scheme_call_count;
 
-void Scheme_DereferenceEnv(scheme_env * env) {
-	size_t i;
-	for (i = 0; i < env->count; ++i) {
-		scheme_define * def = env->defs + i;
-		scheme_object * obj = def->object;
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * ptr, size_t size);
 
-		if (obj->ref_count > 1) {
-			Scheme_DereferenceObject(&def->object);
-			def->object = obj;
-		} else {
-			Scheme_DereferenceObject(&def->object);
-		}
-	}
+void * __wrap_malloc(size_t size) {
+	++scheme_malloc_count;
+	return __real_malloc(size);
 }
 
-struct scheme_freed_memory * Scheme_InitFreedMemory() {
-	struct scheme_freed_memory * mem = malloc(sizeof(struct scheme_freed_memory));
-	mem->size = SCHEME_FREED_MEMORY_START_SIZE;
-	mem->pos  = 0;
-
-	mem->objects = malloc(sizeof(scheme_object *) * mem->size);
-	return mem;
+void * __wrap_calloc(size_t count, size_t size) {
+	++scheme_malloc_count;
+	return __real_calloc(count, size);
 }
 
-int Scheme_CheckIfFreed(struct scheme_freed_memory * mem, scheme_object * address) {
-	int i;
-	for (i = 0; i < mem->pos; ++i) {
-		if (mem->objects[i] == address) return 1;
-	}
-
-	return 0;
+void * __wrap_realloc(void * ptr, size_t size) {
+	++scheme_malloc_count;
+	return __real_realloc(ptr, size);
 }
 
-void Scheme_AddFreed(struct scheme_freed_memory * mem, scheme_object * address) {
-	if (mem->pos >= mem->size) {
-		mem->size *= 2;
-		mem->objects = realloc(mem->objects, mem->size * sizeof(scheme_object *));
-	}
+void Scheme_DisplayAllocStats(void) {
+	static const char * names[] = { "null", "pair", "number", "boolean",
+		"string", "symbol", "lambda", "env", "cfunc", "ref", "code", "unspecified" };
 
-	mem->objects[mem->pos] = address;
-	++mem->pos;
-}
+	size_t i, total = 0;
+	fprintf(stderr, "-- ALLOCATIONS --\n");
+	for (i = 0; i <= SCHEME_UNSPECIFIED; ++i) {
+		if (!scheme_alloc_count[i]) continue;
+		fprintf(stderr, "%-8s %zu\n", names[i], scheme_alloc_count[i]);
+		total += scheme_alloc_count[i];
+	}
+	fprintf(stderr, "total    %zu\n", total);
 
-void Scheme_FreeFreedMemory(struct scheme_freed_memory * mem) {
-	free(mem->objects);
-	free(mem);
+	double calls = scheme_call_count ? scheme_call_count : 1;
+	fprintf(stderr, "calls    %zu\n", scheme_call_count);
+	fprintf(stderr, "objects  %.3f per call\n", total / calls);
+	fprintf(stderr, "mallocs  %zu, %.3f per call\n", scheme_malloc_count, scheme_malloc_count / calls);
 }
+#endif
 
-struct scheme_freed_memory * freed_mem = NULL;
-void Scheme_FreeObject(scheme_object * object) {
-	if (object == NULL) return;
-	//Scheme_Display(object);
-	//printf(" got freed!\n");
-
-	#define freereturn(p) {p(object->payload);free(object);return;}
+void Scheme_FinalizeObject(scheme_object * object) {
 	switch (object->type) {
-	case SCHEME_NULL:
-		free(object);
-		return;
-	case SCHEME_PAIR: 
-		freed_mem = Scheme_InitFreedMemory();
-		Scheme_AddFreed(freed_mem, object);
-		Scheme_FreePair(object->payload);
-		free(object);
-		Scheme_FreeFreedMemory(freed_mem);
-		return;
-	case SCHEME_NUMBER : freereturn(Scheme_FreeNumber);
-	case SCHEME_BOOLEAN: freereturn(Scheme_FreeBoolean);
-	case SCHEME_SYMBOL : freereturn(Scheme_FreeSymbol);
-	case SCHEME_STRING : freereturn(Scheme_FreeString);
-	case SCHEME_LAMBDA : freereturn(Scheme_FreeLambda);
-	case SCHEME_ENV    : freereturn(Scheme_FreeEnvObj);
-	case SCHEME_CFUNC  : freereturn(Scheme_FreeCFunc);
+	case SCHEME_NUMBER : Scheme_FreeNumber((void *)object->payload); return;
+	case SCHEME_SYMBOL : Scheme_FreeSymbol((void *)object->payload); return;
+	case SCHEME_STRING : Scheme_FreeString((void *)object->payload); return;
+	case SCHEME_LAMBDA : Scheme_FreeLambda((void *)object->payload); return;
+	case SCHEME_ENV    : Scheme_FreeEnvObj((void *)object->payload); return;
+	case SCHEME_REF    : Scheme_FreeRef((void *)object->payload); return;
+	case SCHEME_CODE   : Scheme_FreeCode((void *)object->payload); return;
 	default: return;
 	}
-	#undef freereturn
-}
-
-void Scheme_FreeObjectRecur(scheme_object * object) {
-	if (object == NULL) return;
-
-	if (object->type != SCHEME_PAIR) {
-		Scheme_DereferenceObject(&object);
-	} else {
-		//Scheme_DereferenceObject(&object);
-		object->ref_count -= 1;
-		if (object->ref_count <= 0) {
-			Scheme_FreePair(object->payload);
-			free(object);
-		}
-	}
-}
-
-void Scheme_FreePair(scheme_pair * pair) {
-	if (pair == NULL) return;
-
-	#define CHECK_FREE(address) if (!Scheme_CheckIfFreed(freed_mem, address)) {\
-                                        Scheme_AddFreed(freed_mem, address); \
-	                                Scheme_FreeObjectRecur(address);}
-	CHECK_FREE(pair->car);
-	CHECK_FREE(pair->cdr);
-	free(pair);
 }
 
 void Scheme_FreeNumber(scheme_number * number) {
-	if (number == NULL) return;
-	free(number);
-}
-
-void Scheme_FreeBoolean(scheme_boolean * boolean) {
-	if (boolean == NULL) return;
-	free(boolean);
+	if (number->type == NUMBER_BIGINT) {
+		gc_stats.external -= Bigint_Bytes(number->bigint_val);
+		free(number->bigint_val);
+	} else if (number->type == NUMBER_BIGRATIONAL) {
+		gc_stats.external -= Bigint_Bytes(number->big_numerator)
+			+ Bigint_Bytes(number->big_denominator);
+		free(number->big_numerator);
+		free(number->big_denominator);
+	}
 }
 
 void Scheme_FreeString(scheme_string * string) {
 	if (string == NULL) return;
 	if (string->string) free(string->string);
-	free(string);
 }
 
 void Scheme_FreeSymbol(scheme_symbol * symbol) {
 	if (symbol == NULL) return;
 	if (symbol->sym) DereferenceSymbol(&symbol->sym);
-	free(symbol);
 }
 
 void Scheme_FreeLambda(scheme_lambda * lambda) {
-	if (lambda == NULL) return;
-
-	if (lambda->arg_ids) {
-		int i;
-		for (i = 0; i < lambda->arg_count; ++i) {
-			DereferenceSymbol(&lambda->arg_ids[i]);
-		}
-		// the closure environment when freed will free
-		// the argument symbol strings anyway
-		free(lambda->arg_ids);
-	}
-
-	if (lambda->body) {
-		int i;
-		for (i = 0; i < lambda->body_count; ++i) {
-			Scheme_DereferenceObject(&lambda->body[i]);
-		} 
-		free(lambda->body);
-	}
-
-	Scheme_DereferenceObject(&lambda->closure);
-
-	//lambda->closure = NULL;
-	free(lambda);
+	// the code and closure are heap objects of their own
 }
 
 void Scheme_FreeEnvObj(scheme_env * env) {
 	if (env == NULL) return;
 	Scheme_FreeEnv(env);
-	free(env);
 }
 
-void Scheme_FreeCFunc(scheme_cfunc * cfunc) {
-	if (cfunc) free(cfunc);
+void Scheme_FreeRef(scheme_ref * ref) {
+	if (ref == NULL) return;
+	if (ref->sym) DereferenceSymbol(&ref->sym);
+}
+
+void Scheme_FreeCode(scheme_code * code) {
+	if (code == NULL) return;
+
+	if (code->arg_ids) {
+		int i;
+		for (i = 0; i < code->arg_count; ++i) {
+			DereferenceSymbol(&code->arg_ids[i]);
+		}
+		free(code->arg_ids);
+	}
+
+	// the constants are heap objects of their own, the cells belong
+	// to their global environment
+	free(code->ops);
+	free(code->consts);
+	free(code->cells);
+	free(code->feedback);
+#ifdef SCHEME_JIT
+	Scheme_JitFree(code->jit);
+#endif
 }
 
 scheme_pair * Scheme_GetPair(scheme_object * obj) {
-	if (obj->type != SCHEME_PAIR) {
+	if (Scheme_Type(obj) != SCHEME_PAIR) {
 		Scheme_SetError("Attempting to access non-pair object as a pair");
 		return NULL;
 	}
@@ -253,7 +214,7 @@ scheme_pair * Scheme_GetPair(scheme_object * obj) {
 }
 
 scheme_string * Scheme_GetString(scheme_object * obj) {
-	if (obj->type != SCHEME_STRING) {
+	if (Scheme_Type(obj) != SCHEME_STRING) {
 		Scheme_SetError("Attempting to access non-string object as a string");
 		return NULL;
 	}
@@ -262,25 +223,22 @@ scheme_string * Scheme_GetString(scheme_object * obj) {
 }
 
 scheme_number * Scheme_GetNumber(scheme_object * obj) {
-	if (obj->type != SCHEME_NUMBER) {
+	if (Scheme_Type(obj) != SCHEME_NUMBER) {
 		Scheme_SetError("Attempting to access non-number object as a number");
 		return NULL;
 	}
 
-	return (scheme_number *)obj->payload;
-}
-
-scheme_boolean * Scheme_GetBoolean(scheme_object * obj) {
-	if (obj->type != SCHEME_BOOLEAN) {
-		Scheme_SetError("Attempting to access non-boolean object as a boolean");
+	// fixnums and flonums have no payload, use Scheme_GetNumberValue
+	if (Scheme_IsImmediate(obj)) {
+		Scheme_SetError("Attempting to access immediate number as a boxed number");
 		return NULL;
 	}
 
-	return (scheme_boolean *)obj->payload;
+	return (scheme_number *)obj->payload;
 }
 
 scheme_symbol * Scheme_GetSymbol(scheme_object * obj) {
-	if (obj->type != SCHEME_SYMBOL) {
+	if (Scheme_Type(obj) != SCHEME_SYMBOL) {
 		Scheme_SetError("Attempting to access non-symbol object as a symbol");
 		return NULL;
 	}
@@ -289,7 +247,7 @@ scheme_symbol * Scheme_GetSymbol(scheme_object * obj) {
 }
 
 scheme_lambda * Scheme_GetLambda(scheme_object * obj) {
-	if (obj->type != SCHEME_LAMBDA) {
+	if (Scheme_Type(obj) != SCHEME_LAMBDA) {
 		Scheme_SetError("Attempting to access non-lambda object as a lambda");
 		return NULL;
 	}
@@ -298,7 +256,7 @@ scheme_lambda * Scheme_GetLambda(scheme_object * obj) {
 }
 
 scheme_env * Scheme_GetEnvObj(scheme_object * obj) {
-	if (obj->type != SCHEME_ENV) {
+	if (Scheme_Type(obj) != SCHEME_ENV) {
 		Scheme_SetError("Attempting to access non-environment object as a environment");
 		return NULL;
 	}
@@ -307,7 +265,7 @@ scheme_env * Scheme_GetEnvObj(scheme_object * obj) {
 }
 
 scheme_cfunc * Scheme_GetCFunc (scheme_object * obj) {
-	if (obj->type != SCHEME_CFUNC) {
+	if (Scheme_Type(obj) != SCHEME_CFUNC) {
 		Scheme_SetError("Attempting to access cfunc object as a cfunc");
 		return NULL;
 	}
@@ -315,40 +273,57 @@ scheme_cfunc * Scheme_GetCFunc (scheme_object * obj) {
 	return (scheme_cfunc *)obj->payload;
 }
 
-scheme_object * Scheme_CreateNull( void ) {
-	scheme_object * obj;
-	int code = Scheme_AllocateObject(&obj, SCHEME_NULL);
-	if (!code) return NULL;
-	return obj;
-} 
+scheme_ref * Scheme_GetRef(scheme_object * obj) {
+	if (Scheme_Type(obj) != SCHEME_REF) {
+		Scheme_SetError("Attempting to access non-reference object as a reference");
+		return NULL;
+	}
 
-scheme_object * Scheme_CreatePair(scheme_object * car, scheme_object * cdr) {
-	scheme_object * obj;
-	int code = Scheme_AllocateObject(&obj, SCHEME_PAIR);
-	if (!code) return NULL;
+	return (scheme_ref *)obj->payload;
+}
 
-	scheme_pair * pair = Scheme_GetPair(obj);
-	Scheme_ReferenceObject(&pair->car, car);
-	Scheme_ReferenceObject(&pair->cdr, cdr);
+scheme_code * Scheme_GetCode(scheme_object * obj) {
+	if (Scheme_Type(obj) != SCHEME_CODE) {
+		Scheme_SetError("Attempting to access non-code object as code");
+		return NULL;
+	}
 
-	//pair->car = car;
-	//pair->cdr = cdr;
+	return (scheme_code *)obj->payload;
+}
 
-	return obj;
+scheme_number Scheme_GetNumberValue(scheme_object * obj) {
+	scheme_number num;
+	if (Scheme_IsFixnum(obj)) {
+		num.type = NUMBER_INTEGER;
+		num.integer_val = Scheme_FixnumValue(obj);
+		return num;
+	}
+	if (Scheme_IsFlonum(obj)) {
+		num.type = NUMBER_DOUBLE;
+		num.double_val = Scheme_FlonumValue(obj);
+		return num;
+	}
+
+	return *Scheme_GetNumber(obj);
 }
 
-scheme_object * Scheme_CreatePairWithoutRef(scheme_object * car, scheme_object * cdr) {
+scheme_object * Scheme_CreateNull( void ) {
+	return SCHEME_NULL_OBJ;
+} 
+
+scheme_object * Scheme_CreatePair(scheme_object * car, scheme_object * cdr) {
 	scheme_object * obj;
+	GC_PROTECT(car);
+	GC_PROTECT(cdr);
 	int code = Scheme_AllocateObject(&obj, SCHEME_PAIR);
+	GC_UNPROTECT(2);
 	if (!code) return NULL;
 
 	scheme_pair * pair = Scheme_GetPair(obj);
-
 	pair->car = car;
 	pair->cdr = cdr;
 
 	return obj;
-
 }
 
 scheme_object * Scheme_CreateSymbol(char * symbol_str) {
@@ -374,14 +349,7 @@ scheme_object * Scheme_CreateSymbolFromSymbol(symbol * sym) {
 }
 
 scheme_object * Scheme_CreateBoolean(char val) {
-	scheme_object * obj;
-	int code = Scheme_AllocateObject(&obj, SCHEME_BOOLEAN);
-	if (!code) return NULL;
-
-	scheme_boolean * boolean = Scheme_GetBoolean(obj);
-	boolean->val = val;
-
-	return obj;
+	return Scheme_MakeBoolean(val);
 }
 
 scheme_object * Scheme_CreateString(char * string_str) {
@@ -419,6 +387,9 @@ scheme_object * Scheme_CreateStringLiteral(const char * string_str) {
 }
 
 scheme_object * Scheme_CreateInteger(long long integer) {
+	if (Scheme_FixnumFits(integer))
+		return Scheme_MakeFixnum(integer);
+
 	scheme_object * obj;
 	int code = Scheme_AllocateObject(&obj, SCHEME_NUMBER);
 	if (!code) return NULL;
@@ -431,6 +402,9 @@ scheme_object * Scheme_CreateInteger(long long integer) {
 }
 
 scheme_object * Scheme_CreateDouble(double value) {
+	if (Scheme_FlonumFits(value))
+		return Scheme_MakeFlonum(value);
+
 	scheme_object * obj;
 	int code = Scheme_AllocateObject(&obj, SCHEME_NUMBER);
 	if (!code) return NULL;
@@ -442,6 +416,47 @@ scheme_object * Scheme_CreateDouble(double value) {
 	return obj;
 }
 
+// the limbs are counted before the object is made, so that making it
+// collects if they take the total over (see gc.h)
+scheme_object * Scheme_CreateBigint(scheme_bigint * big) {
+	gc_stats.external += Bigint_Bytes(big);
+	scheme_object * obj;
+	int code = Scheme_AllocateObject(&obj, SCHEME_NUMBER);
+	if (!code) {
+		gc_stats.external -= Bigint_Bytes(big);
+		free(big);
+		return NULL;
+	}
+
+	scheme_number * num = Scheme_GetNumber(obj);
+	num->type = NUMBER_BIGINT;
+	num->bigint_val = big;
+
+	return obj;
+}
+
+scheme_object * Scheme_CreateBigRational(scheme_bigint * numerator,
+                                         scheme_bigint * denominator)
+{
+	size_t bytes = Bigint_Bytes(numerator) + Bigint_Bytes(denominator);
+	gc_stats.external += bytes;
+	scheme_object * obj;
+	int code = Scheme_AllocateObject(&obj, SCHEME_NUMBER);
+	if (!code) {
+		gc_stats.external -= bytes;
+		free(numerator);
+		free(denominator);
+		return NULL;
+	}
+
+	scheme_number * num = Scheme_GetNumber(obj);
+	num->type = NUMBER_BIGRATIONAL;
+	num->big_numerator = numerator;
+	num->big_denominator = denominator;
+
+	return obj;
+}
+
 scheme_object * Scheme_CreateRational(long long numerator,
                                       long long denominator)
 {
@@ -458,43 +473,83 @@ scheme_object * Scheme_CreateRational(long long numerator,
 
 }
 
-scheme_object * Scheme_CreateEnvObj(scheme_object * parent, int init_size) {
+scheme_object * Scheme_CreateNumber(scheme_number * num) {
+	switch (num->type) {
+	case NUMBER_INTEGER : return Scheme_CreateInteger(num->integer_val);
+	case NUMBER_RATIONAL: return Scheme_CreateRational(num->numerator, num->denominator);
+	case NUMBER_DOUBLE  : return Scheme_CreateDouble(num->double_val);
+	case NUMBER_BIGINT  : {
+		// the new number gets limbs of its own
+		scheme_bigint * big = Bigint_Copy(num->bigint_val);
+		if (!big) {
+			Scheme_SetError("runtime malloc(bigint) error");
+			return NULL;
+		}
+		return Scheme_CreateBigint(big); }
+	case NUMBER_BIGRATIONAL: {
+		scheme_bigint * numerator = Bigint_Copy(num->big_numerator);
+		scheme_bigint * denominator = Bigint_Copy(num->big_denominator);
+		if (!numerator || !denominator) {
+			free(numerator);
+			free(denominator);
+			Scheme_SetError("runtime malloc(bigint) error");
+			return NULL;
+		}
+		return Scheme_CreateBigRational(numerator, denominator); }
+	default:
+		Scheme_SetError("invalid number type given to Scheme_CreateNumber");
+		return NULL;
+	}
+}
+
+scheme_object * Scheme_CreateEnvObj(scheme_object * parent, int size) {
 	scheme_object * obj;
+	GC_PROTECT(parent);
 	int code = Scheme_AllocateObject(&obj, SCHEME_ENV);
+	GC_UNPROTECT(1);
 	if (!code) return NULL;
 
 	scheme_env * env = Scheme_GetEnvObj(obj);
-	*env = Scheme_CreateEnv(parent, init_size);
+	*env = Scheme_CreateEnv(parent, size);
 
 	return obj;
 }
 
-scheme_object * Scheme_CreateEnvObjWithoutRef(scheme_object * parent, int init_size) {
+scheme_object * Scheme_CreateGlobalEnvObj(scheme_object * parent, int init_size) {
 	scheme_object * obj;
+	GC_PROTECT(parent);
 	int code = Scheme_AllocateObject(&obj, SCHEME_ENV);
+	GC_UNPROTECT(1);
 	if (!code) return NULL;
 
 	scheme_env * env = Scheme_GetEnvObj(obj);
-	*env = Scheme_CreateEnvWithoutRef(parent, init_size);
+	*env = Scheme_CreateGlobalEnv(parent, init_size);
 
 	return obj;
 }
 
-scheme_object * Scheme_CreateLambda(int argc, char dot_args, symbol ** args, int body_count,
-	scheme_object ** body, scheme_object * closure)
-{
+scheme_object * Scheme_CreateLambda(scheme_object * code, scheme_object * closure) {
 	scheme_object * obj;
-	int code = Scheme_AllocateObject(&obj, SCHEME_LAMBDA);
-	if (!code) return NULL;
+	GC_PROTECT(code);
+	GC_PROTECT(closure);
+	int success = Scheme_AllocateObject(&obj, SCHEME_LAMBDA);
+	GC_UNPROTECT(2);
+	if (!success) return NULL;
 
 	scheme_lambda * l = Scheme_GetLambda(obj);
-	l->arg_count = argc;
-	l->dot_args = dot_args;
-	l->arg_ids = args;
-	l->body_count = body_count;
-	l->body = body;
-	Scheme_ReferenceObject(&l->closure, closure);
-	//l->closure = closure;
+	l->code = code;
+	l->closure = closure;
+
+	return obj;
+}
+
+scheme_object * Scheme_CreateCode(void) {
+	scheme_object * obj;
+	int code = Scheme_AllocateObject(&obj, SCHEME_CODE);
+	if (!code) return NULL;
+
+	scheme_code * c = Scheme_GetCode(obj);
+	memset(c, 0, sizeof(scheme_code));
 
 	return obj;
 }
@@ -511,6 +566,45 @@ scheme_object * Scheme_CreateCFunc(int argc, char dot_args, char special_form,
 	c->dot_args = dot_args;
 	c->special_form = special_form;
 	c->func = func;
+	c->inline_op = 0;
+
+	return obj;
+}
+
+scheme_object * Scheme_CreateCFunc0(scheme_func0 func) {
+	scheme_object * obj = Scheme_CreateCFunc(0, 0, 0, NULL);
+	if (obj) Scheme_GetCFunc(obj)->func0 = func;
+	return obj;
+}
+
+scheme_object * Scheme_CreateCFunc1(scheme_func1 func) {
+	scheme_object * obj = Scheme_CreateCFunc(1, 0, 0, NULL);
+	if (obj) Scheme_GetCFunc(obj)->func1 = func;
+	return obj;
+}
+
+scheme_object * Scheme_CreateCFunc2(scheme_func2 func) {
+	scheme_object * obj = Scheme_CreateCFunc(2, 0, 0, NULL);
+	if (obj) Scheme_GetCFunc(obj)->func2 = func;
+	return obj;
+}
+
+scheme_object * Scheme_CreateCFunc3(scheme_func3 func) {
+	scheme_object * obj = Scheme_CreateCFunc(3, 0, 0, NULL);
+	if (obj) Scheme_GetCFunc(obj)->func3 = func;
+	return obj;
+}
+
+scheme_object * Scheme_CreateRef(symbol * sym, scheme_define * cell, int depth, int slot) {
+	scheme_object * obj;
+	int code = Scheme_AllocateObject(&obj, SCHEME_REF);
+	if (!code) return NULL;
+
+	scheme_ref * ref = Scheme_GetRef(obj);
+	ReferenceSymbol(&ref->sym, sym);
+	ref->cell = cell;
+	ref->depth = depth;
+	ref->slot = slot;
 
 	return obj;
 }
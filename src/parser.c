@@ -1,8 +1,17 @@
 #include "parser.h"
+#include "gc.h"
+#include "bigint.h"
 
 scheme_object * Parser_Parse(struct lexer * lex) {
 	Lexer_NextToken(lex); // get first token
-	return Parser_ParseExpression(lex);
+
+	// code lives as long as the lambdas made from it, so it skips the
+	// nursery. evaluation can then hold on to expressions without
+	// having to worry about them moving
+	++gc_pretenure;
+	scheme_object * obj = Parser_ParseExpression(lex);
+	--gc_pretenure;
+	return obj;
 }
 
 scheme_object * Parser_ParseExpression(struct lexer * lex) {
@@ -40,6 +49,10 @@ scheme_object * Parser_ParseNumber(struct lexer * lex) {
 	case NUMBER_DOUBLE:
 		obj = Scheme_CreateDouble(lex->double_val);
 		break;
+	case NUMBER_BIGINT:
+		obj = Bigint_Parse(lex->string);
+		free(lex->string);
+		break;
 	}
 
 	return obj;
@@ -67,27 +80,29 @@ scheme_object * Parser_ParseString(struct lexer * lex) {
 scheme_object * Parser_ParseList(struct lexer * lex) {
 	int token = Lexer_NextToken(lex); // eat '(' token
 	if (token == ')')
-		return NULL; // empty list
+		return SCHEME_NULL_OBJ;
 
 	scheme_object * first_object = Parser_ParseExpression(lex);
 	
-	scheme_object * base_pair = Scheme_CreatePairWithoutRef(first_object, NULL);
+	scheme_object * base_pair = Scheme_CreatePair(first_object, SCHEME_NULL_OBJ);
 	scheme_object * next_pair = base_pair;
+	GC_PROTECT(base_pair);
 	
 	while (Lexer_NextToken(lex) != ')') {
 		if (Lexer_CurrToken(lex) == TOKEN_EOF) {
 			Scheme_SetError("unexpected EOF");
+			GC_UNPROTECT(1);
 			return NULL;
 		}
 
 		scheme_object * new_object = Parser_ParseExpression(lex);
+		scheme_object * new_pair = Scheme_CreatePair(new_object, SCHEME_NULL_OBJ);
 
-		scheme_pair * pair = (scheme_pair *)next_pair->payload;
-		pair->cdr = Scheme_CreatePairWithoutRef(new_object, NULL);
-
-		next_pair = pair->cdr;
+		Scheme_SetCdr(next_pair, new_pair);
+		next_pair = new_pair;
 	}
 
+	GC_UNPROTECT(1);
 	return base_pair;
 }
 
@@ -98,10 +113,13 @@ scheme_object * Parser_ParseQuote  (struct lexer * lex) {
 	if (to_quote == NULL)
 		return NULL;
 
+	GC_PROTECT(to_quote);
 	scheme_object * quote_symbol = Scheme_CreateSymbolLiteral("quote");
+	GC_PROTECT(quote_symbol);
 
-	scheme_object * p2 = Scheme_CreatePairWithoutRef(to_quote, NULL);
-	scheme_object * p1 = Scheme_CreatePairWithoutRef(quote_symbol, p2);
+	scheme_object * p2 = Scheme_CreatePair(to_quote, SCHEME_NULL_OBJ);
+	scheme_object * p1 = Scheme_CreatePair(quote_symbol, p2);
 
+	GC_UNPROTECT(2);
 	return p1;
 }
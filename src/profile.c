@@ -0,0 +1,155 @@
+#include "profile.h"
+#include "vm.h"
+#include "gc.h"
+#include "jit.h"
+
+int scheme_tier_threshold = SCHEME_TIER_THRESHOLD;
+
+void Scheme_Promote(scheme_code * code) {
+	code->tier = SCHEME_TIER_HOT;
+#ifdef SCHEME_JIT
+	if (Scheme_JitCompile(code))
+		code->tier = SCHEME_TIER_COMPILED;
+#endif
+}
+
+int Scheme_SiteArgs(scheme_code * code, int op) {
+	const scheme_op * pc = code->ops + op;
+	switch (*pc) {
+	case OP_CALL:
+	case OP_CALL_JIF:
+	case OP_TAIL_CALL:
+		return pc[1];
+	case OP_CALL_GLOBAL_L:
+	case OP_CALL_GLOBAL_L_JIF:
+		return 1;
+	case OP_CALL_GLOBAL_LL:
+	case OP_CALL_GLOBAL_LL_JIF:
+	case OP_CALL_GLOBAL_LK:
+	case OP_CALL_GLOBAL_LK_JIF:
+	case OP_CALL_GLOBAL_KL:
+	case OP_CALL_GLOBAL_KL_JIF:
+		return 2;
+	case OP_PRIM0:
+	case OP_PRIM1:
+	case OP_PRIM2:
+	case OP_PRIM3:
+		return *pc - OP_PRIM0;
+	case OP_ADD:
+	case OP_SUB:
+	case OP_NUM_EQ:
+	case OP_LT:
+	case OP_GT:
+	case OP_NUM_EQ_JIF:
+	case OP_LT_JIF:
+	case OP_GT_JIF:
+		return 2;
+	default:
+		return -1;
+	}
+}
+
+static const char * const scheme_kind_names[] = { "fixnum", "flonum", "pair", "other" };
+static const char * const scheme_tier_names[] = { "profiled", "hot", "compiled" };
+
+// (key . val) consed onto list, which is kept alive while it allocates
+static scheme_object * Scheme_ProfileEntry(const char * key, scheme_object * val,
+	scheme_object * list)
+{
+	if (!val)
+		return NULL;
+	GC_PROTECT(val);
+	GC_PROTECT(list);
+	scheme_object * entry = Scheme_CreateSymbolLiteral(key);
+	if (entry)
+		entry = Scheme_CreatePair(entry, val);
+	if (entry)
+		entry = Scheme_CreatePair(entry, list);
+	GC_UNPROTECT(2);
+	return entry;
+}
+
+// (position name kinds ...) for the site at op
+static scheme_object * Scheme_ProfileSite(scheme_code * code, int op) {
+	const scheme_op * pc = code->ops + op;
+	const scheme_op_info * info = &scheme_ops[*pc];
+	scheme_feedback slot = code->feedback[op + 1 + info->operands];
+	int argc = Scheme_SiteArgs(code, op);
+	if (argc > SCHEME_FEEDBACK_ARGS)
+		argc = SCHEME_FEEDBACK_ARGS;
+
+	scheme_object * site = SCHEME_NULL_OBJ;
+	scheme_object * kinds = SCHEME_NULL_OBJ;
+	scheme_object * name = NULL;
+	GC_PROTECT(site);
+	GC_PROTECT(kinds);
+
+	int i, kind;
+	for (i = argc - 1; i >= 0 && site; --i) {
+		kinds = SCHEME_NULL_OBJ;
+		for (kind = 3; kind >= 0 && kinds; --kind) {
+			if (!(Scheme_FeedbackKinds(slot, i) & (1 << kind)))
+				continue;
+			name = Scheme_CreateSymbolLiteral(scheme_kind_names[kind]);
+			kinds = name ? Scheme_CreatePair(name, kinds) : NULL;
+		}
+		site = kinds ? Scheme_CreatePair(kinds, site) : NULL;
+	}
+
+	// every site but a call of what is on the stack names a global
+	if (site) {
+		if (*pc == OP_CALL || *pc == OP_CALL_JIF || *pc == OP_TAIL_CALL)
+			name = Scheme_CreateSymbolLiteral(info->name);
+		else
+			name = Scheme_CreateSymbolFromSymbol(code->cells[pc[1]]->sym);
+		site = name ? Scheme_CreatePair(name, site) : NULL;
+	}
+	if (site)
+		site = Scheme_CreatePair(Scheme_MakeFixnum(op), site);
+
+	GC_UNPROTECT(2);
+	return site;
+}
+
+scheme_object * Scheme_ProfileStats(scheme_code * code) {
+	// the sites are listed last first
+	int * sites = malloc(sizeof(int) * (code->op_count + 1));
+	if (!sites) {
+		Scheme_SetError("out of memory");
+		return NULL;
+	}
+	int site_count = 0;
+	int op;
+	for (op = 0; op < code->op_count; op += 1 + scheme_ops[code->ops[op]].operands)
+		if (Scheme_SiteArgs(code, op) >= 0)
+			sites[site_count++] = op;
+
+	scheme_object * list = SCHEME_NULL_OBJ;
+	scheme_object * site = NULL;
+	GC_PROTECT(list);
+	while (site_count > 0 && list) {
+		site = Scheme_ProfileSite(code, sites[--site_count]);
+		list = site ? Scheme_CreatePair(site, list) : NULL;
+	}
+	free(sites);
+
+	// each value is made before list is read for the call, which may
+	// have moved by then otherwise
+	scheme_object * val;
+	if (list)
+		list = Scheme_ProfileEntry("sites", list, SCHEME_NULL_OBJ);
+	if (list) {
+		val = Scheme_CreateSymbolLiteral(scheme_tier_names[code->tier]);
+		list = Scheme_ProfileEntry("tier", val, list);
+	}
+	if (list) {
+		val = Scheme_CreateInteger(code->loops);
+		list = Scheme_ProfileEntry("loops", val, list);
+	}
+	if (list) {
+		val = Scheme_CreateInteger(code->calls);
+		list = Scheme_ProfileEntry("calls", val, list);
+	}
+	GC_UNPROTECT(1);
+	return list;
+}
@@ -0,0 +1,297 @@
+#include "resolve.h"
+#include "scheme.h"
+#include "gc.h"
+
+static scheme_object * Scheme_ResolveExpr(scheme_object * expr, scheme_scope * scope, scheme_env * global);
+
+static void Scheme_InitScope(scheme_scope * scope, scheme_scope * parent, char lambda) {
+	scope->names = NULL;
+	scope->count = scope->size = 0;
+	scope->lambda = lambda;
+	scope->captured = 0;
+	scope->parent = parent;
+}
+
+static int Scheme_ScopeSlot(scheme_scope * scope, symbol * sym) {
+	int i;
+	for (i = 0; i < scope->count; ++i)
+		if (scope->names[i]->str == sym->str)
+			return i;
+	return -1;
+}
+
+static int Scheme_PushScope(scheme_scope * scope, symbol * sym) {
+	if (scope->count == scope->size) {
+		scope->size = scope->size ? scope->size * 2 : SCOPE_SIZE;
+		scope->names = realloc(scope->names, scope->size * sizeof(symbol *));
+	}
+	scope->names[scope->count] = sym;
+	return scope->count++;
+}
+
+// slot of sym in scope, added at the end if it is not there yet
+static int Scheme_DeclareScope(scheme_scope * scope, symbol * sym) {
+	int slot = Scheme_ScopeSlot(scope, sym);
+	if (slot != -1)
+		return slot;
+	return Scheme_PushScope(scope, sym);
+}
+
+static scheme_object * Scheme_ResolveSymbol(symbol * sym, scheme_scope * scope, scheme_env * global) {
+	int depth = 0;
+	char crossed = 0;
+	for (; scope; scope = scope->parent, ++depth) {
+		int slot = Scheme_ScopeSlot(scope, sym);
+		if (slot != -1) {
+			// seen from inside a nested lambda, the frame has to outlive its call
+			if (crossed)
+				scope->captured = 1;
+			return Scheme_CreateRef(sym, NULL, depth, slot);
+		}
+		crossed |= scope->lambda;
+	}
+
+	return Scheme_CreateRef(sym, Scheme_GetGlobalCell(global, sym), 0, 0);
+}
+
+static int Scheme_IsBound(symbol * sym, scheme_scope * scope) {
+	for (; scope; scope = scope->parent)
+		if (Scheme_ScopeSlot(scope, sym) != -1)
+			return 1;
+	return 0;
+}
+
+// the special form a form's operator names, SPECIAL_NONE for an application
+static int Scheme_FormSpecial(scheme_object * form, scheme_scope * scope, scheme_env * global) {
+	scheme_object * op = Scheme_GetPair(form)->car;
+	if (Scheme_Type(op) != SCHEME_SYMBOL)
+		return SPECIAL_NONE;
+
+	symbol * sym = Scheme_GetSymbol(op)->sym;
+	if (Scheme_IsBound(sym, scope))
+		return SPECIAL_NONE;
+
+	scheme_define * def = Scheme_GetEnv(global, sym);
+	if (!def || Scheme_Type(def->object) != SCHEME_CFUNC)
+		return SPECIAL_NONE;
+
+	return Scheme_GetCFunc(def->object)->special_form;
+}
+
+// resolves the car of every pair in list
+static void Scheme_ResolveEach(scheme_object * list, scheme_scope * scope, scheme_env * global) {
+	while (Scheme_Type(list) == SCHEME_PAIR) {
+		scheme_pair * p = Scheme_GetPair(list);
+		scheme_object * resolved = Scheme_ResolveExpr(p->car, scope, global);
+		Scheme_SetCar(list, resolved);
+		list = Scheme_GetPair(list)->cdr;
+	}
+}
+
+// the name a (define name ...) or (define (name ...) ...) form binds
+static symbol * Scheme_DefineTarget(scheme_object * form) {
+	scheme_object * rest = Scheme_GetPair(form)->cdr;
+	if (Scheme_Type(rest) != SCHEME_PAIR)
+		return NULL;
+
+	scheme_object * target = Scheme_GetPair(rest)->car;
+	if (Scheme_Type(target) == SCHEME_PAIR)
+		target = Scheme_GetPair(target)->car;
+	if (Scheme_Type(target) != SCHEME_SYMBOL)
+		return NULL;
+	return Scheme_GetSymbol(target)->sym;
+}
+
+// declares the defines at the top of a body up front, so the procedures
+// of a body can refer to each other whatever order they are defined in
+static void Scheme_ScanDefines(scheme_object * body, scheme_scope * scope, scheme_env * global) {
+	for (; Scheme_Type(body) == SCHEME_PAIR; body = Scheme_GetPair(body)->cdr) {
+		scheme_object * form = Scheme_GetPair(body)->car;
+		if (Scheme_Type(form) != SCHEME_PAIR)
+			continue;
+		if (Scheme_FormSpecial(form, scope, global) != SPECIAL_DEFINE)
+			continue;
+
+		symbol * sym = Scheme_DefineTarget(form);
+		if (sym)
+			Scheme_DeclareScope(scope, sym);
+	}
+}
+
+// resolves body in a new frame and puts its size and whether it is
+// captured after the operator of form
+static void Scheme_ResolveFrame(scheme_object * form, scheme_object * body,
+	scheme_scope * frame, scheme_env * global)
+{
+	Scheme_ScanDefines(body, frame, global);
+	Scheme_ResolveEach(body, frame, global);
+
+	scheme_object * size = Scheme_MakeFixnum(frame->count);
+	scheme_object * rest = Scheme_CreatePair(Scheme_MakeBoolean(frame->captured), Scheme_GetPair(form)->cdr);
+	GC_PROTECT(rest);
+	Scheme_SetCdr(form, Scheme_CreatePair(size, rest));
+	GC_UNPROTECT(1);
+	free(frame->names);
+}
+
+// (lambda (args ...) body ...)
+static void Scheme_ResolveLambda(scheme_object * form, scheme_scope * scope, scheme_env * global) {
+	scheme_object * rest = Scheme_GetPair(form)->cdr;
+	if (Scheme_Type(rest) != SCHEME_PAIR)
+		return;
+
+	scheme_scope frame;
+	Scheme_InitScope(&frame, scope, 1);
+
+	scheme_object * args = Scheme_GetPair(rest)->car;
+	for (; Scheme_Type(args) == SCHEME_PAIR; args = Scheme_GetPair(args)->cdr) {
+		scheme_object * arg = Scheme_GetPair(args)->car;
+		if (Scheme_Type(arg) != SCHEME_SYMBOL)
+			break;
+		// a repeated argument still takes a slot of its own
+		Scheme_PushScope(&frame, Scheme_GetSymbol(arg)->sym);
+	}
+
+	// malformed argument lists are left for the compiler to report
+	if (!Scheme_IsNull(args)) {
+		free(frame.names);
+		return;
+	}
+
+	Scheme_ResolveFrame(form, Scheme_GetPair(rest)->cdr, &frame, global);
+}
+
+// (let ((var expr) ...) body ...)
+static void Scheme_ResolveLet(scheme_object * form, scheme_scope * scope, scheme_env * global) {
+	scheme_object * rest = Scheme_GetPair(form)->cdr;
+	if (Scheme_Type(rest) != SCHEME_PAIR)
+		return;
+
+	scheme_scope frame;
+	Scheme_InitScope(&frame, scope, 0);
+
+	scheme_object * vars = Scheme_GetPair(rest)->car;
+	for (; Scheme_Type(vars) == SCHEME_PAIR; vars = Scheme_GetPair(vars)->cdr) {
+		scheme_object * var = Scheme_GetPair(vars)->car;
+		if (Scheme_Type(var) != SCHEME_PAIR)
+			break;
+
+		scheme_pair * var_pair = Scheme_GetPair(var);
+		if (Scheme_Type(var_pair->car) != SCHEME_SYMBOL || Scheme_Type(var_pair->cdr) != SCHEME_PAIR)
+			break;
+
+		// the values are evaluated outside the new frame
+		Scheme_ResolveEach(var_pair->cdr, scope, global);
+		Scheme_PushScope(&frame, Scheme_GetSymbol(var_pair->car)->sym);
+	}
+
+	if (!Scheme_IsNull(vars)) {
+		free(frame.names);
+		return;
+	}
+
+	Scheme_ResolveFrame(form, Scheme_GetPair(rest)->cdr, &frame, global);
+}
+
+// (define name expr) or (define (name args ...) body ...)
+static void Scheme_ResolveDefine(scheme_object * form, scheme_scope * scope, scheme_env * global) {
+	symbol * sym = Scheme_DefineTarget(form);
+	if (!sym)
+		return;
+
+	scheme_object * rest = Scheme_GetPair(form)->cdr;
+	scheme_object * target = Scheme_GetPair(rest)->car;
+
+	scheme_object * ref;
+	if (scope)
+		ref = Scheme_CreateRef(sym, NULL, 0, Scheme_DeclareScope(scope, sym));
+	else
+		ref = Scheme_CreateRef(sym, Scheme_GetGlobalCell(global, sym), 0, 0);
+	GC_PROTECT(ref);
+
+	if (Scheme_Type(target) == SCHEME_SYMBOL) {
+		Scheme_SetCar(rest, ref);
+		Scheme_ResolveEach(Scheme_GetPair(rest)->cdr, scope, global);
+		GC_UNPROTECT(1);
+		return;
+	}
+
+	// the (name args ...) pair becomes (lambda (args ...) body ...)
+	scheme_object * lambda_sym = Scheme_CreateSymbolLiteral("lambda");
+	GC_PROTECT(lambda_sym);
+	scheme_object * args_body = Scheme_CreatePair(Scheme_GetPair(target)->cdr, Scheme_GetPair(rest)->cdr);
+	Scheme_SetCar(target, lambda_sym);
+	Scheme_SetCdr(target, args_body);
+	GC_UNPROTECT(1);
+
+	scheme_object * value = Scheme_CreatePair(target, SCHEME_NULL_OBJ);
+	Scheme_SetCdr(form, Scheme_CreatePair(ref, value));
+	GC_UNPROTECT(1);
+
+	Scheme_SetCar(target, Scheme_ResolveSymbol(Scheme_GetSymbol(lambda_sym)->sym, NULL, global));
+	Scheme_ResolveLambda(target, scope, global);
+}
+
+// (cond (pred expr ...) ... (else expr ...))
+static void Scheme_ResolveCond(scheme_object * form, scheme_scope * scope, scheme_env * global) {
+	scheme_object * clauses = Scheme_GetPair(form)->cdr;
+	for (; Scheme_Type(clauses) == SCHEME_PAIR; clauses = Scheme_GetPair(clauses)->cdr) {
+		scheme_object * clause = Scheme_GetPair(clauses)->car;
+		if (Scheme_Type(clause) != SCHEME_PAIR)
+			continue;
+
+		scheme_object * pred = Scheme_GetPair(clause)->car;
+		if (Scheme_Type(pred) == SCHEME_SYMBOL
+		    && Scheme_SymbolEq(Scheme_GetSymbol(pred)->sym, ELSE_SYMBOL))
+			Scheme_ResolveEach(Scheme_GetPair(clause)->cdr, scope, global);
+		else
+			Scheme_ResolveEach(clause, scope, global);
+	}
+}
+
+static scheme_object * Scheme_ResolveExpr(scheme_object * expr, scheme_scope * scope, scheme_env * global) {
+	switch (Scheme_Type(expr)) {
+	case SCHEME_SYMBOL:
+		return Scheme_ResolveSymbol(Scheme_GetSymbol(expr)->sym, scope, global);
+	case SCHEME_PAIR:
+		break;
+	default:
+		return expr;
+	}
+
+	switch (Scheme_FormSpecial(expr, scope, global)) {
+	case SPECIAL_QUOTE:
+		// the quoted datum is left alone
+		break;
+	case SPECIAL_LAMBDA:
+		Scheme_ResolveLambda(expr, scope, global);
+		break;
+	case SPECIAL_LET:
+		Scheme_ResolveLet(expr, scope, global);
+		break;
+	case SPECIAL_DEFINE:
+		Scheme_ResolveDefine(expr, scope, global);
+		break;
+	case SPECIAL_COND:
+		Scheme_ResolveCond(expr, scope, global);
+		break;
+	default:
+		Scheme_ResolveEach(Scheme_GetPair(expr)->cdr, scope, global);
+		break;
+	}
+
+	// the operator itself, a special form's name is looked up like any global
+	scheme_object * op = Scheme_ResolveExpr(Scheme_GetPair(expr)->car, scope, global);
+	Scheme_SetCar(expr, op);
+	return expr;
+}
+
+scheme_object * Scheme_Resolve(scheme_object * expr, scheme_object * env) {
+	// resolved code never moves, like the parser's
+	++gc_pretenure;
+	GC_PROTECT(expr);
+	expr = Scheme_ResolveExpr(expr, NULL, Scheme_GetEnvObj(env));
+	GC_UNPROTECT(1);
+	--gc_pretenure;
+	return expr;
+}
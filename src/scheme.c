@@ -1,7 +1,10 @@
 #include "scheme.h"
+#include "resolve.h"
+#include "compile.h"
+#include "gc.h"
+#include "bigint.h"
 
 int SCHEME_INTERPRETER_HALT = 0;
-scheme_object DO_TAIL_CALL;
 
 scheme_object * SYSTEM_GLOBAL_ENVIRONMENT_OBJ;
 scheme_object * USER_INITIAL_ENVIRONMENT_OBJ;
@@ -17,31 +20,46 @@ int Scheme_SymbolEq(symbol * a, symbol * b) {
 #define CREATESYSDEF(func, name, argc, dotargs, special_form) \
 	Scheme_DefineEnv(SYSTEM_GLOBAL_ENVIRONMENT, Scheme_CreateDefineString(strdup(name), \
 		Scheme_CreateCFunc(argc,dotargs,special_form,func)))
-#define CREATESPEC(func, name, tok) \
+// a primitive taking exactly argc arguments, called without an array
+#define CREATESYSDEFN(func, name, argc) \
 	Scheme_DefineEnv(SYSTEM_GLOBAL_ENVIRONMENT, Scheme_CreateDefineString(strdup(name), \
-		Scheme_CreateCFunc(tok ## _ARGC,tok ## _DOT,1,func)))
+		Scheme_CreateCFunc ## argc(func)))
+#define CREATESPEC(special, name, tok) \
+	Scheme_DefineEnv(SYSTEM_GLOBAL_ENVIRONMENT, Scheme_CreateDefineString(strdup(name), \
+		Scheme_CreateCFunc(tok ## _ARGC,tok ## _DOT,special,NULL)))
+
+// calls of the primitive name is bound to are run inline by op
+static void Scheme_InlinePrimitive(const char * name, scheme_op op) {
+	scheme_define * def = Scheme_GetEnv(SYSTEM_GLOBAL_ENVIRONMENT, GetSymbol(name));
+	Scheme_GetCFunc(def->object)->inline_op = op;
+}
 
 void Scheme_DefineStartupEnv( void ) {
-	SYSTEM_GLOBAL_ENVIRONMENT_OBJ = Scheme_CreateEnvObj(NULL, 128);
-	USER_INITIAL_ENVIRONMENT_OBJ  = Scheme_CreateEnvObj(SYSTEM_GLOBAL_ENVIRONMENT_OBJ, 128);
+	// the global environments and primitives live for the whole run
+	++gc_pretenure;
+
+	SYSTEM_GLOBAL_ENVIRONMENT_OBJ = Scheme_CreateGlobalEnvObj(NULL, 128);
+	USER_INITIAL_ENVIRONMENT_OBJ  = Scheme_CreateGlobalEnvObj(SYSTEM_GLOBAL_ENVIRONMENT_OBJ, 128);
 
 	SYSTEM_GLOBAL_ENVIRONMENT = Scheme_GetEnvObj(SYSTEM_GLOBAL_ENVIRONMENT_OBJ);
 	USER_INITIAL_ENVIRONMENT  = Scheme_GetEnvObj(USER_INITIAL_ENVIRONMENT_OBJ);
 
-	CREATESPEC(Scheme_Special_Define, "define", SPEC_DEFINE);
-	CREATESPEC(Scheme_Special_Lambda, "lambda", SPEC_LAMBDA);
-	CREATESPEC(Scheme_Special_If, "if", SPEC_IF);
-	CREATESPEC(Scheme_Special_Quote, "quote", SPEC_QUOTE);
-	CREATESPEC(Scheme_Special_Cond, "cond", SPEC_COND);
-	CREATESPEC(Scheme_Special_Let, "let", SPEC_LET);
+	CREATESPEC(SPECIAL_DEFINE, "define", SPEC_DEFINE);
+	CREATESPEC(SPECIAL_LAMBDA, "lambda", SPEC_LAMBDA);
+	CREATESPEC(SPECIAL_IF, "if", SPEC_IF);
+	CREATESPEC(SPECIAL_QUOTE, "quote", SPEC_QUOTE);
+	CREATESPEC(SPECIAL_COND, "cond", SPEC_COND);
+	CREATESPEC(SPECIAL_LET, "let", SPEC_LET);
 
-	CREATESYSDEF(__Scheme_cons__, "cons", 2, 0, 0);
-	CREATESYSDEF(__Scheme_car__,  "car", 1, 0, 0);
-	CREATESYSDEF(__Scheme_cdr__,  "cdr", 1, 0, 0);
+	CREATESYSDEFN(__Scheme_cons__, "cons", 2);
+	CREATESYSDEFN(__Scheme_car__,  "car", 1);
+	CREATESYSDEFN(__Scheme_cdr__,  "cdr", 1);
 	CREATESYSDEF(__Scheme_List__, "list", 0, 1, 0);
+	CREATESYSDEFN(__Scheme_SetCar__, "set-car!", 2);
+	CREATESYSDEFN(__Scheme_SetCdr__, "set-cdr!", 2);
 
-	CREATESYSDEF(__Scheme_CallDisplay__, "display", 1, 0, 0);
-	CREATESYSDEF(__Scheme_CallNewline__, "newline", 0, 0, 0);
+	CREATESYSDEFN(__Scheme_CallDisplay__, "display", 1);
+	CREATESYSDEFN(__Scheme_CallNewline__, "newline", 0);
 
 	CREATESYSDEF(__Scheme_CallAdd__, "+", 1, 1, 0);
 	CREATESYSDEF(__Scheme_CallSub__, "-", 1, 1, 0);
@@ -53,58 +71,137 @@ void Scheme_DefineStartupEnv( void ) {
 	CREATESYSDEF(__Scheme_CallAGreaterThan__, ">", 1, 1, 0);
 	CREATESYSDEF(__Scheme_CallAGreaterThanEqual__, ">=", 1, 1, 0);
 
-	CREATESYSDEF(__Scheme_Quotient__,  "quotient", 2, 0, 0);
-	CREATESYSDEF(__Scheme_Modulo,      "modulo", 2, 0, 0);
-	CREATESYSDEF(__Scheme_Remainder__, "remainder", 2, 0, 0);
-
-	CREATESYSDEF(__Pred_eq__,   "eq?", 2, 0, 0);
-	CREATESYSDEF(__Pred_null__, "null?", 1, 0, 0);
-
-	CREATESYSDEF(__Exit__, "exit", 0, 0, 0);
-	CREATESYSDEF(__Scheme_Load__, "load", 1, 0, 0);
+	CREATESYSDEFN(__Flonum_Add__,      "fl+", 2);
+	CREATESYSDEFN(__Flonum_Sub__,      "fl-", 2);
+	CREATESYSDEFN(__Flonum_Mul__,      "fl*", 2);
+	CREATESYSDEFN(__Flonum_LessThan__, "fl<", 2);
+
+	CREATESYSDEFN(__Scheme_Quotient__,  "quotient", 2);
+	CREATESYSDEFN(__Scheme_Modulo,      "modulo", 2);
+	CREATESYSDEFN(__Scheme_Remainder__, "remainder", 2);
+
+	CREATESYSDEFN(__Pred_eq__,   "eq?", 2);
+	CREATESYSDEFN(__Pred_null__, "null?", 1);
+
+	CREATESYSDEFN(__Exit__, "exit", 0);
+	CREATESYSDEFN(__Scheme_Load__, "load", 1);
+	CREATESYSDEFN(__Scheme_CollectCycles__, "collect-cycles", 0);
+	CREATESYSDEFN(__Scheme_Disassemble__, "disassemble", 1);
+	CREATESYSDEFN(__Scheme_ProcedureStats__, "procedure-stats", 1);
+
+	Scheme_InlinePrimitive("+", OP_ADD);
+	Scheme_InlinePrimitive("-", OP_SUB);
+	Scheme_InlinePrimitive("=", OP_NUM_EQ);
+	Scheme_InlinePrimitive("<", OP_LT);
+	Scheme_InlinePrimitive(">", OP_GT);
+	Scheme_InlinePrimitive("cons", OP_CONS);
+	Scheme_InlinePrimitive("car", OP_CAR);
+	Scheme_InlinePrimitive("cdr", OP_CDR);
+	Scheme_InlinePrimitive("null?", OP_NULLP);
+	Scheme_InlinePrimitive("fl+", OP_FL_ADD);
+	Scheme_InlinePrimitive("fl-", OP_FL_SUB);
+	Scheme_InlinePrimitive("fl*", OP_FL_MUL);
+	Scheme_InlinePrimitive("fl<", OP_FL_LT);
 
 	ELSE_SYMBOL = AddSymbol(strdup("else"));
+	--gc_pretenure;
 }
 
 void Scheme_FreeStartupEnv( void ) {
-	Scheme_FreeObject(USER_INITIAL_ENVIRONMENT_OBJ);
-	Scheme_FreeObject(SYSTEM_GLOBAL_ENVIRONMENT_OBJ);
+	USER_INITIAL_ENVIRONMENT_OBJ = SYSTEM_GLOBAL_ENVIRONMENT_OBJ = NULL;
+	USER_INITIAL_ENVIRONMENT = SYSTEM_GLOBAL_ENVIRONMENT = NULL;
+	Scheme_GCFreeAll();
 }
 
+size_t scheme_stack_limit = SCHEME_STACK_LIMIT;
+size_t scheme_stack_bytes = 0;
+
+void * Scheme_AllocStack(size_t size) {
+	void * ptr = NULL;
+	if (scheme_stack_bytes + size <= scheme_stack_limit)
+		ptr = malloc(size);
+	if (!ptr) {
+		Scheme_SetError("stack overflow");
+		return NULL;
+	}
+	scheme_stack_bytes += size;
+	return ptr;
+}
+
+void Scheme_FreeStack(void * ptr, size_t size) {
+	free(ptr);
+	scheme_stack_bytes -= size;
+}
+
+scheme_call_segment * call_segment;
 scheme_call * call_stack;
 scheme_call * call_stack_end;
-void Scheme_InitCallStack(int stack_size) {
-	call_stack = malloc(sizeof(scheme_call) * SCHEME_STACK_SIZE);
-	call_stack_end = call_stack;
+static int call_segment_size;
+
+static scheme_call_segment * Scheme_AllocCallSegment(void) {
+	scheme_call_segment * segment = Scheme_AllocStack(sizeof(scheme_call_segment)
+		+ sizeof(scheme_call) * call_segment_size);
+	if (!segment)
+		return NULL;
+	segment->prev = segment->next = NULL;
+	segment->end = segment->calls + call_segment_size;
+	return segment;
 }
 
-void Scheme_FreeCallStack(void) {
-	if (call_stack) free(call_stack);
+// frees segment and the ones after it
+static void Scheme_FreeCallSegments(scheme_call_segment * segment) {
+	while (segment) {
+		scheme_call_segment * next = segment->next;
+		Scheme_FreeStack(segment, sizeof(scheme_call_segment)
+			+ sizeof(scheme_call) * (segment->end - segment->calls));
+		segment = next;
+	}
 }
 
-int Scheme_PushCallStack(scheme_call call) {
-	//Scheme_DisplayEnv(Scheme_GetEnvObj(call.env));
-	//printf(" %i refs\n", call.env->ref_count);
+static void Scheme_UseCallSegment(scheme_call_segment * segment) {
+	call_segment = segment;
+	call_stack = segment->calls;
+}
 
-	//Scheme_DisplayCallStack();
+int Scheme_InitCallStack(int stack_size) {
+	call_segment_size = stack_size;
+	scheme_call_segment * segment = Scheme_AllocCallSegment();
+	if (!segment)
+		return 0;
+	Scheme_UseCallSegment(segment);
+	call_stack_end = call_stack;
+	return 1;
+}
 
-	// tail call check
-	if (call_stack_end != call_stack) {
-		scheme_call * last_call = call_stack_end - 1;
+void Scheme_FreeCallStack(void) {
+	if (!call_segment)
+		return;
+	while (call_segment->prev)
+		call_segment = call_segment->prev;
+	Scheme_FreeCallSegments(call_segment);
+	call_segment = NULL;
+	call_stack = call_stack_end = NULL;
+}
 
-		int do_tail_call = 0;
-		if (call.is_cfunc_call && last_call->is_cfunc_call)
-			do_tail_call = (call.cfunc == last_call->cfunc);
-		else
-		if (!call.is_cfunc_call && !last_call->is_cfunc_call)
-			do_tail_call = (call.proc == last_call->proc);
+int Scheme_PushCallStack(scheme_call call, char tail) {
+	// a call from tail position replaces the frame making it, whatever it
+	// calls, so the stack stays the same size through any chain of them
+	if (tail && call_stack_end != call_stack) {
+		call_stack_end[-1] = call;
+		return 1;
+	}
 
-		if (do_tail_call) {
-			puts("TAILL CALLING!!!");
-			Scheme_DereferenceObject(&last_call->env);
-			*last_call = call;
-			return 1;
+	if (call_stack_end == call_segment->end) {
+		scheme_call_segment * next = call_segment->next;
+		if (!next) {
+			next = Scheme_AllocCallSegment();
+			if (!next)
+				return -1;
+			next->prev = call_segment;
+			call_segment->next = next;
 		}
+		Scheme_UseCallSegment(next);
+		call_stack_end = call_stack;
 	}
 
 	*call_stack_end = call;
@@ -112,305 +209,103 @@ int Scheme_PushCallStack(scheme_call call) {
 	return 0;
 }
 
-scheme_object * Scheme_PopCallStack(void) {
-	if (call_stack_end == call_stack) {
-		Scheme_SetError("call stack underflow");
-	}
+scheme_call * Scheme_PopCallSegment(void) {
+	// only the segment just left is kept
+	Scheme_FreeCallSegments(call_segment->next);
+	call_segment->next = NULL;
 
-	scheme_object * result = Scheme_CallStack();
-	return result;
+	Scheme_UseCallSegment(call_segment->prev);
+	call_stack_end = call_segment->end;
+	return call_stack_end - 1;
 }
 
-scheme_object * Scheme_CallStack(void) {
-	scheme_call * call = call_stack_end - 1;
-
-tail_call:
-	if (!call->is_cfunc_call) {
-		/* lambda call */
-		scheme_object * return_val = NULL;
-		scheme_lambda * lambda = call->proc;
-
-		int i;
-		for (i = 0; i < lambda->body_count; ++i) {
-			scheme_object * expr = lambda->body[i];
-			scheme_object * body_eval = Scheme_Eval(expr,  call->env);
-			if (i == lambda->body_count-1) {
-				return_val = body_eval;
-				break;
-			} else {
-				Scheme_DereferenceObject(&body_eval);
-			}
-		}
-
-		if (return_val == &DO_TAIL_CALL) {
-			goto tail_call;
-		} else {
-			/*printf("------ ");
-			Scheme_DisplayEnv(Scheme_GetEnvObj(call->env));
-			printf(" %i refs\n", call->env->ref_count);*/
-
-			Scheme_DereferenceObject(&call->env);
-			--call_stack_end;
-			return return_val;
-		}
-	} else {
-		/* cfunc call */
-		scheme_object * result = call->cfunc->func(call->args, call->env, call->arg_count);
-		--call_stack_end;
-		return result;
+void Scheme_UnwindCallStack(scheme_call_segment * segment, scheme_call * end) {
+	if (segment->next) {
+		Scheme_FreeCallSegments(segment->next->next);
+		segment->next->next = NULL;
 	}
-}
-
-char Scheme_CanTailCallLambda(scheme_lambda * lambda) {
-	scheme_call * call;
-	if (call_stack_end == call_stack) return 0;
-	call = call_stack_end-1;
-	return !call->is_cfunc_call && call->proc == lambda;
+	Scheme_UseCallSegment(segment);
+	call_stack_end = end;
 }
 
 void Scheme_DisplayCallStack(void) {
 	if (call_stack_end == call_stack) return;
 	puts("-- STACK TRACE --");
 
+	scheme_call_segment * segment = call_segment;
 	scheme_call * call = call_stack_end-1;
 	while (1) {
-		if (call->is_cfunc_call) {
-			puts("<cfunc>");
+		if (!call->proc) {
+			puts("<top level>");
 		} else {
-			scheme_object temp;
-			temp.type = SCHEME_LAMBDA;
-			temp.payload = call->proc;
-			Scheme_Display(&temp);
+			Scheme_DisplayLambda(Scheme_GetLambda(call->proc));
 			Scheme_Newline();
 		}
 
-		if (call == call_stack)
-			break;
+		if (call == segment->calls) {
+			segment = segment->prev;
+			if (!segment)
+				break;
+			call = segment->end;
+		}
 		--call;
 	}
 }
 
 scheme_object * Scheme_Eval(scheme_object * obj, scheme_object * env) {
-	scheme_object * result;
-
 	if (obj == NULL) return NULL;
 
-	switch (obj->type) {
-	case SCHEME_PAIR: {
-		scheme_pair * pair;
-		scheme_object * apply_result, * node;
-		scheme_object ** array;
-		int length, i;
-
-		pair = Scheme_GetPair(obj);
-
-		if (!pair->cdr)
-			length=0;
-		else
-			length = Scheme_ListLength(pair->cdr);
-
-		scheme_object * application = Scheme_Eval(pair->car, env);
-		if (!application) return NULL;
-
-		char is_special_form = 0;
-		if (application->type == SCHEME_CFUNC) {
-			scheme_cfunc * cfunc = Scheme_GetCFunc(application);
-			is_special_form = cfunc->special_form;
-		}
-
-		array = malloc(length * sizeof(scheme_object *));
-		node = pair->cdr;
-		for (i = 0; i < length; ++i) {
-			scheme_pair * p = Scheme_GetPair(node);
-			/*if (!is_special_form)
-				array[i] = Scheme_Eval(p->car, env);
-			else
-				array[i] = p->car;*/
-			array[i] = p->car;
-
-			node = p->cdr;
-		}
-
-		apply_result = Scheme_Apply(application, array, length, env);
-
-		Scheme_DereferenceObject(&application);
-
-		free(array);
-		result = apply_result;
-		break; }
-	case SCHEME_SYMBOL: {
-		scheme_symbol * sym;
-		scheme_env    * env_pointer = Scheme_GetEnvObj(env);
-		if (!env_pointer) {
-			Scheme_SetError("bad environment");
-			return NULL;
-		}
-		scheme_define * def;
-
-		sym = Scheme_GetSymbol(obj);
-		def = Scheme_GetEnv(env_pointer, sym->sym);
-		if (def == NULL) {
-			Scheme_SetError("unbound variable");
-			return NULL;
-		}
-
-		scheme_object * ref;
-		Scheme_ReferenceObject(&ref, def->object);
-		result = ref;
-		break;
-		}
-	default: {
-		scheme_object * ref;
-		Scheme_ReferenceObject(&ref, obj);
-		result = ref;
-		break; }
-	}
-
-	return result;
-}
-
-scheme_object * Scheme_Apply(scheme_object * func, scheme_object ** args, int arg_count, scheme_object * env) {
-	if (func->type == SCHEME_LAMBDA) {
-		scheme_lambda * lambda = Scheme_GetLambda(func);
-		return Scheme_ApplyLambda(lambda, args, arg_count, env);
-	} else if (func->type == SCHEME_CFUNC) {
-		scheme_cfunc * cfunc = Scheme_GetCFunc(func);
-		if (!cfunc->special_form)
-			return Scheme_ApplyCFunc(cfunc, args, arg_count, env);
-		else
-			return Scheme_ApplyCFuncSpecial(cfunc, args, arg_count, env);
-	} else {
-		Scheme_Display(func);
-		Scheme_Newline();
-		Scheme_SetError("tried to call non-applicable object");
+	GC_PROTECT(env);
+	obj = Scheme_Resolve(obj, env);
+	scheme_object * code = Scheme_Compile(obj, env);
+	if (!code) {
+		GC_UNPROTECT(1);
 		return NULL;
 	}
-}
+	GC_PROTECT(code);
 
-scheme_object * Scheme_ApplyCFunc(scheme_cfunc * cfunc, scheme_object ** args, int arg_count, scheme_object * env) {
-	if (!cfunc) return NULL;
-
-	if (arg_count < cfunc->arg_count) {
-		Scheme_SetError("bad arg count");
-		return NULL;
-	} else if (arg_count > cfunc->arg_count && !cfunc->dot_args) {
-		Scheme_SetError("bad arg count");
-		return NULL;
-	}
-
-	scheme_object * eval_args[arg_count];
-
-	scheme_call cfunc_call;
-	cfunc_call.is_cfunc_call = 1;
-	cfunc_call.cfunc = cfunc;
-	cfunc_call.args = eval_args;
-	cfunc_call.arg_count = arg_count;
-	cfunc_call.env = env;
-
-	Scheme_PushCallStack(cfunc_call);
-
-	int i, j;
-	for (i = 0; i < arg_count; ++i) {
-		eval_args[i] = Scheme_Eval(args[i], env);
-		if (error_str) {
-			for (j = 0; j < i; ++i) {
-				Scheme_DereferenceObject(&eval_args[j]);
-				return NULL;
-			}
-		}
-	}
-
-	scheme_object * result = Scheme_PopCallStack();	
-
-	for (i = 0; i < arg_count; ++i) {
-		Scheme_DereferenceObject(&eval_args[i]);
-	}
+	scheme_object * result = Scheme_Execute(code, env);
 
+	GC_UNPROTECT(2);
 	return result;
 }
 
-scheme_object * Scheme_ApplyCFuncSpecial(scheme_cfunc * cfunc, scheme_object ** args, int arg_count, scheme_object * env) {
-	if (!cfunc) return NULL;
-
-	if (arg_count < cfunc->arg_count) {
-		Scheme_SetError("bad arg count");
-		return NULL;
-	} else if (arg_count > cfunc->arg_count && !cfunc->dot_args) {
-		Scheme_SetError("bad arg count");
-		return NULL;
-	}
-
-	return cfunc->func(args, env, arg_count);
-}
-
-scheme_object * Scheme_ApplyLambda(scheme_lambda * lambda, scheme_object ** args, int arg_count, scheme_object * env) {
-	if (arg_count < lambda->arg_count) {
-		Scheme_SetError("λ call error : too few arguments");
-		return NULL;
-	} else if (!lambda->dot_args && arg_count > lambda->arg_count) {
-		Scheme_SetError("λ call error : too many arguments");
-		return NULL;
-	}
-
-	int i;
-	scheme_object * new_env_obj = Scheme_CreateEnvObj(lambda->closure, lambda->arg_count+1);
-	scheme_env    * new_env = (scheme_env*)new_env_obj->payload;
-
-	scheme_call call;
-	call.is_cfunc_call = 0;
-	call.proc = lambda;
-	call.env = new_env_obj;
-
-	int push_result = (Scheme_PushCallStack(call));
-
-	for (i = 0; i < arg_count; ++i) {
-		symbol * sym;
-		ReferenceSymbol(&sym, lambda->arg_ids[i]);
-
-		scheme_object * arg_val;
-		//Scheme_ReferenceObject(&arg_val, args[i]);
-		arg_val = Scheme_Eval(args[i], env);
-
-		if (error_str) {
-			Scheme_FreeObject(new_env_obj);
-			return NULL;
+void Scheme_DisplayList(scheme_object * obj) {
+	// loops down the cdrs so long lists don't grow the C stack
+	while (!Scheme_IsNull(obj)) {
+		if (Scheme_Type(obj) != SCHEME_PAIR) {
+			Scheme_Display(obj);
+			return;
 		}
 
-		Scheme_DefineEnv(new_env, Scheme_CreateDefine(sym, arg_val));
+		Scheme_Display(Scheme_Car(obj));
+		obj = Scheme_Cdr(obj);
+		if (!Scheme_IsNull(obj))
+			printf(" , ");
 	}
-
-	if (push_result)
-		return &DO_TAIL_CALL;
-	return Scheme_PopCallStack();
 }
 
-void Scheme_DisplayList(scheme_object * obj) {
-	if (!obj) return;
-	if (obj->type != SCHEME_PAIR) {
-		Scheme_Display(obj);
-		return;
-	}
-
-	Scheme_Display(Scheme_Car(obj));
-	scheme_object * cdr = Scheme_Cdr(obj);
-	if (cdr) {
-		printf(" , ");
-		Scheme_DisplayList(Scheme_Cdr(obj));
+void Scheme_DisplayLambda(scheme_lambda * lambda) {
+	int i;
+	scheme_code * code = Scheme_GetCode(lambda->code);
+	printf("λ(");
+	for (i = 0; i < code->arg_count; ++i) {
+		printf("%s", code->arg_ids[i]->str);
+		if (i != code->arg_count-1) putchar(' ');
 	}
+	putchar(')');
 }
 
 void Scheme_Display(scheme_object * obj) {
-	if (obj == NULL || obj->type == SCHEME_NULL) {
-		printf("()");
-		return;
-	}
-
-	scheme_number * num;
+	scheme_number num;
 	scheme_string * str;
 	scheme_symbol * sym;
-	scheme_boolean * boolean;
 
-	switch (obj->type) {
+	switch (Scheme_Type(obj)) {
+	case SCHEME_NULL:
+		printf("()");
+		break;
+
 	case SCHEME_SYMBOL:
 		sym = Scheme_GetSymbol(obj);
 		printf("%s", sym->sym->str);
@@ -422,21 +317,28 @@ void Scheme_Display(scheme_object * obj) {
 		break;
 
 	case SCHEME_BOOLEAN:
-		boolean = Scheme_GetBoolean(obj);
-		printf("#%c", boolean->val ? 't' : 'f');
+		printf("#%c", obj == SCHEME_TRUE_OBJ ? 't' : 'f');
 		break;
 
 	case SCHEME_NUMBER:
-		num = Scheme_GetNumber(obj);
-		switch (num->type) {
+		num = Scheme_GetNumberValue(obj);
+		switch (num.type) {
 		case NUMBER_INTEGER:
-			printf("%lli", num->integer_val);
+			printf("%lli", num.integer_val);
 			break;
 		case NUMBER_RATIONAL:
-			printf("%lli/%lli", num->numerator, num->denominator);
+			printf("%lli/%lli", num.numerator, num.denominator);
 			break;
 		case NUMBER_DOUBLE:
-			printf("%f", num->double_val);
+			printf("%f", num.double_val);
+			break;
+		case NUMBER_BIGINT:
+			Bigint_Display(num.bigint_val);
+			break;
+		case NUMBER_BIGRATIONAL:
+			Bigint_Display(num.big_numerator);
+			putchar('/');
+			Bigint_Display(num.big_denominator);
 			break;
 		}
 		break;
@@ -447,22 +349,9 @@ void Scheme_Display(scheme_object * obj) {
 		printf(") ");
 		break;
 
-	case SCHEME_LAMBDA: {
-		scheme_lambda * lambda = Scheme_GetLambda(obj);
-		int i;
-		printf("λ(");
-		for (i = 0; i < lambda->arg_count; ++i) {
-			printf("%s", lambda->arg_ids[i]->str);
-			if (i != lambda->arg_count-1) putchar(' ');
-		}
-		putchar(')');
-
-		/*for (i = 0; i < lambda->body_count; ++i) {
-			Scheme_Display(lambda->body[i]);
-			if (i != lambda->body_count-1)
-				putchar(' ');
-		}*/
-	} break;
+	case SCHEME_LAMBDA:
+		Scheme_DisplayLambda(Scheme_GetLambda(obj));
+		break;
 
 	case SCHEME_CFUNC:
 		printf("<cfunc>");
@@ -471,6 +360,17 @@ void Scheme_Display(scheme_object * obj) {
 	case SCHEME_ENV:
 		printf("<env>");
 		break;
+
+	case SCHEME_REF:
+		printf("%s", Scheme_GetRef(obj)->sym->str);
+		break;
+
+	case SCHEME_CODE:
+		printf("<code>");
+		break;
+
+	case SCHEME_UNSPECIFIED:
+		break;
 	}
 }
 
@@ -479,16 +379,20 @@ void Scheme_Newline( void ) {
 }
 
 char Scheme_BoolTest(scheme_object * obj) {
-	if (!obj) return 0;
-	if (obj->type == SCHEME_BOOLEAN) {
-		return Scheme_GetBoolean(obj)->val;
-	} else if (obj->type == SCHEME_NUMBER) {
+	if (!obj || obj == SCHEME_FALSE_OBJ) return 0;
+	if (obj == SCHEME_TRUE_OBJ) return 1;
+	if (Scheme_IsFixnum(obj)) return Scheme_FixnumValue(obj) != 0;
+	if (Scheme_IsFlonum(obj)) return Scheme_FlonumValue(obj) != 0.0;
+
+	if (Scheme_Type(obj) == SCHEME_NUMBER) {
 		scheme_number * num = Scheme_GetNumber(obj);
 
 		switch (num->type) {
 		case NUMBER_INTEGER : return num->integer_val != 0;
 		case NUMBER_RATIONAL: return num->numerator   != 0;
 		case NUMBER_DOUBLE  : return num->double_val  != 0.0;
+		case NUMBER_BIGINT  :
+		case NUMBER_BIGRATIONAL: return 1;
 		default: return 0;
 		}
 	} 
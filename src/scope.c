@@ -1,5 +1,7 @@
 #include "scope.h"
 #include "scheme.h"
+#include "slab.h"
+#include "gc.h"
 
 scheme_define Scheme_CreateDefine(symbol * sym, scheme_object * obj) {
 	scheme_define def;
@@ -16,135 +18,161 @@ scheme_define Scheme_CreateDefineString(char * string, scheme_object * obj) {
 void Scheme_FreeDefine(scheme_define * def) {
 	if (!def) return;
 	if (def->sym) DereferenceSymbol(&def->sym);
-	Scheme_DereferenceObject(&def->object);
+	def->object = NULL;
 }
 
+unsigned int scheme_global_epoch = 0;
+
 void Scheme_OverwriteDefine(scheme_define * def, scheme_object * obj) {
-	if (def->object) Scheme_DereferenceObject(&def->object);
+	scheme_object * old = def->object;
+	if (old && old != obj && Scheme_Type(old) == SCHEME_CFUNC && Scheme_GetCFunc(old)->inline_op)
+		++scheme_global_epoch;
 	def->object = obj;
 }
 
-scheme_env Scheme_CreateEnv(scheme_object * parent, int init_size) {
+// slot arrays of lambda sized frames come from the slab,
+// which array the env owns follows from its size alone
+scheme_env Scheme_CreateEnv(scheme_object * parent, int size) {
 	scheme_env env;
-	if (parent) {
-		Scheme_ReferenceObject(&env.parent, parent);
-	} else {
-		env.parent = NULL;
-	}
+	env.parent = parent;
+	env.cells = NULL;
+	env.size = env.count = size;
 
-	env.defs = NULL;
-	Scheme_ResizeEnv(&env, init_size);
-	env.count = 0;
+	if (size == 0)
+		env.slots = NULL;
+	else if (size <= SLAB_FRAME_SLOTS)
+		env.slots = Slab_Alloc(SLAB_FRAME);
+	else
+		env.slots = malloc(size * sizeof(scheme_object *));
+
+	// every slot starts out unbound
+	int i;
+	for (i = 0; i < size; ++i)
+		env.slots[i] = NULL;
 
 	return env;
 }
 
-scheme_env Scheme_CreateEnvWithoutRef(scheme_object * parent, int init_size) {
+scheme_env Scheme_CreateGlobalEnv(scheme_object * parent, int init_size) {
+	int size = 2;
+	while (size < init_size)
+		size <<= 1;
+
 	scheme_env env;
 	env.parent = parent;
-
-	env.defs = NULL;
-	Scheme_ResizeEnv(&env, init_size);
+	env.index = malloc(size * sizeof(int));
+	memset(env.index, -1, size * sizeof(int));
+	env.cells = malloc(size / 2 * sizeof(scheme_define *));
+	env.size = size;
 	env.count = 0;
-
 	return env;
 }
 
 void Scheme_FreeEnv(scheme_env * env) {
-	if (env->defs) {
-		size_t i;
+	if (env->cells) {
+		int i;
 		for (i = 0; i < env->count; ++i) {
-			Scheme_FreeDefine(env->defs + i);
+			Scheme_FreeDefine(env->cells[i]);
+			Slab_Free(SLAB_BINDING, env->cells[i]);
 		}
-		free(env->defs);
+		free(env->cells);
+		free(env->index);
+		env->cells = NULL;
+		env->index = NULL;
+	} else if (env->slots) {
+		if (env->size <= SLAB_FRAME_SLOTS)
+			Slab_Free(SLAB_FRAME, env->slots);
+		else
+			free(env->slots);
+		env->slots = NULL;
 	}
 
-	if (env->parent) {
-		Scheme_DereferenceObject(&env->parent);
-	}
+	env->parent = NULL;
+}
+
+// index entry pointing at the cell holding sym, or the empty one where it would go
+static int Scheme_FindCell(scheme_env * env, symbol * sym) {
+	int mask = env->size - 1;
+	int i = sym->hash & mask;
+	while (env->index[i] != -1 && env->cells[env->index[i]]->sym->str != sym->str)
+		i = (i + 1) & mask;
+	return i;
 }
 
 void Scheme_ResizeEnv(scheme_env * env, int new_size) {
-	env->defs = realloc(env->defs, new_size * sizeof(scheme_define));
+	free(env->index);
+	env->index = malloc(new_size * sizeof(int));
+	memset(env->index, -1, new_size * sizeof(int));
+	env->cells = realloc(env->cells, new_size / 2 * sizeof(scheme_define *));
 	env->size = new_size;
-}
 
-void Scheme_EraseEnv(scheme_env * env, size_t index) {
-	
+	// the cached hashes save rehashing every name
+	int i;
+	for (i = 0; i < env->count; ++i)
+		env->index[Scheme_FindCell(env, env->cells[i]->sym)] = i;
 }
 
-void Scheme_DefineEnv(scheme_env * env, scheme_define def) {
+static scheme_define * Scheme_InsertCell(scheme_env * env, int i, scheme_define def) {
 	// expand size if necessary
-	if (env->count + 1 == env->size)
+	if (env->count + 1 > env->size / 2) {
 		Scheme_ResizeEnv(env, env->size * 2);
-
-	scheme_define * defs = env->defs;
-
-	if (env->count == 0) {
-		defs[0] = def;
-		++env->count;
-		return;
+		i = Scheme_FindCell(env, def.sym);
 	}
 
-	scheme_define * l = defs,
-	              * r = defs + env->count;
-	while (1) {
-		if (r == l) {
-			// move every entry >= l up 1 spot to make
-			// room for new definition
-			scheme_define * move, * end = defs + env->count;
-			for (move = end-1; move >= l; --move) {
-				move[1] = move[0];
-			}
-
-			*l = def;
-			goto done;
-		}
-
-		scheme_define * m = l + (r-l)/2;
+	scheme_define * cell = Slab_Alloc(SLAB_BINDING);
+	*cell = def;
+	env->index[i] = env->count;
+	env->cells[env->count++] = cell;
+	return cell;
+}
 
-		if (m->sym->str == def.sym->str) {
-			DereferenceSymbol(&m->sym);
-			Scheme_OverwriteDefine(m, def.object);
-			m->sym = def.sym;
-			return;
-		} else if (m->sym->str < def.sym->str) {
-			l = m + 1;
-		} else {
-			r = m;
-		}
+void Scheme_DefineEnv(scheme_env * env, scheme_define def) {
+	GC_WRITE_BARRIER(Scheme_PayloadObject(env), def.object);
+
+	int i = Scheme_FindCell(env, def.sym);
+	if (env->index[i] != -1) {
+		scheme_define * m = env->cells[env->index[i]];
+		DereferenceSymbol(&m->sym);
+		Scheme_OverwriteDefine(m, def.object);
+		m->sym = def.sym;
+		return;
 	}
 
-done:
-	++env->count;
+	Scheme_InsertCell(env, i, def);
 }
 
 scheme_define * Scheme_GetEnv(scheme_env * env, symbol * sym) {
-	if (!env) return NULL;
-
-	scheme_define * defs = env->defs;
-	scheme_define * l = defs,
-	              * r = defs + env->count;
-	while (1) {
-		if (r == l) {
-			if (env->parent) {
-				scheme_env * deeper_env = Scheme_GetEnvObj(env->parent);
-				return Scheme_GetEnv(deeper_env, sym);
-			} else {
-				return NULL;
-			}
+	while (env) {
+		// frames have no names, only global environments are searched
+		if (env->cells) {
+			int i = env->index[Scheme_FindCell(env, sym)];
+			if (i != -1 && env->cells[i]->object)
+				return env->cells[i];
 		}
 
-		scheme_define * m = l + (r-l)/2;
+		if (!env->parent)
+			return NULL;
+		env = Scheme_GetEnvObj(env->parent);
+	}
+	return NULL;
+}
 
-		if (m->sym->str == sym->str) {
-			return m;
-		} else if (m->sym->str < sym->str) {
-			l = m + 1;
-		} else {
-			r = m;
-		}
+scheme_define * Scheme_GetGlobalCell(scheme_env * env, symbol * sym) {
+	int i = Scheme_FindCell(env, sym);
+	if (env->index[i] != -1)
+		return env->cells[env->index[i]];
+
+	scheme_object * value = NULL;
+	if (env->parent) {
+		scheme_define * inherited = Scheme_GetEnv(Scheme_GetEnvObj(env->parent), sym);
+		if (inherited)
+			value = inherited->object;
 	}
+
+	GC_WRITE_BARRIER(Scheme_PayloadObject(env), value);
+	symbol * cell_sym;
+	ReferenceSymbol(&cell_sym, sym);
+	return Scheme_InsertCell(env, i, Scheme_CreateDefine(cell_sym, value));
 }
 
 #include <stdio.h>
@@ -152,9 +180,14 @@ void Scheme_DisplayEnv(scheme_env * env) {
 	int i;
 	printf("{ ");
 	for (i = 0; i < env->count; ++i) {
-		scheme_define * def = env->defs + i;
-		printf("%s: ", def->sym->str);
-		Scheme_Display(def->object);
+		if (env->cells) {
+			scheme_define * def = env->cells[i];
+			printf("%s: ", def->sym->str);
+			Scheme_Display(def->object);
+		} else {
+			printf("%i: ", i);
+			Scheme_Display(env->slots[i]);
+		}
 		if (i != env->count-1) putchar(',');
 		putchar(' ');
 	}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "slab.h"
+#include "object.h"
+#include "scope.h"
+#include "symbol.h"
+#include "error.h"
+
+// cells are rounded up so every cell stays pointer aligned
+#define SLAB_ALIGN(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define SLAB_CLASS(name, size) { name, SLAB_ALIGN(size), NULL, NULL, NULL, NULL, 0, 0, 0 }
+
+slab_class slab_classes[SLAB_CLASS_COUNT] = {
+	[SLAB_PAIR]   = SLAB_CLASS("pair",   sizeof(scheme_object) + sizeof(scheme_pair)),
+	[SLAB_NUMBER] = SLAB_CLASS("number", sizeof(scheme_object) + sizeof(scheme_number)),
+	[SLAB_ENV]    = SLAB_CLASS("env",    sizeof(scheme_object) + sizeof(scheme_env)),
+	[SLAB_LAMBDA] = SLAB_CLASS("lambda", sizeof(scheme_object) + sizeof(scheme_lambda)),
+	[SLAB_STRING] = SLAB_CLASS("string", sizeof(scheme_object) + sizeof(scheme_string)),
+	[SLAB_SYMBOL] = SLAB_CLASS("symbol", sizeof(scheme_object) + sizeof(scheme_symbol)),
+	[SLAB_CFUNC]  = SLAB_CLASS("cfunc",  sizeof(scheme_object) + sizeof(scheme_cfunc)),
+	[SLAB_REF]    = SLAB_CLASS("ref",    sizeof(scheme_object) + sizeof(scheme_ref)),
+	[SLAB_CODE]   = SLAB_CLASS("code",   sizeof(scheme_object) + sizeof(scheme_code)),
+	[SLAB_FRAME]  = SLAB_CLASS("frame",  sizeof(scheme_object *) * SLAB_FRAME_SLOTS),
+	[SLAB_SYMTAB] = SLAB_CLASS("symtab", sizeof(symbol)),
+	[SLAB_BINDING] = SLAB_CLASS("binding", sizeof(scheme_define))
+};
+
+slab_page ** slab_dirty_pages = NULL;
+size_t slab_dirty_count = 0;
+static size_t slab_dirty_size = 0;
+
+// the list being walked by Slab_ForEachDirty, swapped with the live one
+static slab_page ** slab_dirty_spare = NULL;
+static size_t slab_dirty_spare_size = 0;
+
+void Slab_FreeAll(void) {
+	int i;
+	for (i = 0; i < SLAB_CLASS_COUNT; ++i) {
+		slab_class * c = slab_classes + i;
+		slab_page * page = c->pages;
+		while (page) {
+			slab_page * next = page->next;
+			free(page);
+			page = next;
+		}
+
+		c->pages = NULL;
+		c->free_list = NULL;
+		c->bump = c->bump_end = NULL;
+		c->page_count = c->live_count = c->peak_count = 0;
+	}
+
+	free(slab_dirty_pages);
+	free(slab_dirty_spare);
+	slab_dirty_pages = slab_dirty_spare = NULL;
+	slab_dirty_count = slab_dirty_size = slab_dirty_spare_size = 0;
+}
+
+static int Slab_NewPage(slab_class * c) {
+	slab_page * page = aligned_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+	if (!page) {
+		Scheme_SetError("Slab_NewPage : malloc() error");
+		return 0;
+	}
+
+	page->next = c->pages;
+	page->class_id = c - slab_classes;
+	page->dirty = 0;
+	memset(page->cards, 0, sizeof(page->cards));
+	c->pages = page;
+	++c->page_count;
+
+	c->bump     = (char *)page + SLAB_ALIGN(sizeof(slab_page));
+	c->bump_end = (char *)page + SLAB_PAGE_SIZE;
+	return 1;
+}
+
+void * Slab_Alloc(int class_id) {
+	slab_class * c = slab_classes + class_id;
+	void * cell;
+
+	if (c->free_list) {
+		cell = c->free_list;
+		c->free_list = c->free_list->next;
+	} else {
+		if (c->bump + c->cell_size > c->bump_end) {
+			if (!Slab_NewPage(c))
+				return NULL;
+		}
+
+		cell = c->bump;
+		c->bump += c->cell_size;
+	}
+
+	if (++c->live_count > c->peak_count)
+		c->peak_count = c->live_count;
+	return cell;
+}
+
+void Slab_Free(int class_id, void * cell) {
+	if (!cell) return;
+
+	slab_class * c = slab_classes + class_id;
+	slab_cell * link = cell;
+	link->next = c->free_list;
+	c->free_list = link;
+	--c->live_count;
+}
+
+void Slab_ForEach(int class_id, void (*func)(void * cell)) {
+	slab_class * c = slab_classes + class_id;
+	slab_page * page;
+
+	for (page = c->pages; page; page = page->next) {
+		char * cell = (char *)page + SLAB_ALIGN(sizeof(slab_page));
+		char * end  = (char *)page + SLAB_PAGE_SIZE;
+
+		// the newest page is only carved up to the bump pointer
+		if (page == c->pages)
+			end = c->bump;
+
+		for (; cell + c->cell_size <= end; cell += c->cell_size)
+			func(cell);
+	}
+}
+
+void Slab_AddDirty(slab_page * page) {
+	if (slab_dirty_count == slab_dirty_size) {
+		slab_dirty_size = slab_dirty_size ? slab_dirty_size * 2 : 64;
+		slab_dirty_pages = realloc(slab_dirty_pages, sizeof(slab_page *) * slab_dirty_size);
+	}
+
+	page->dirty = 1;
+	slab_dirty_pages[slab_dirty_count++] = page;
+}
+
+void Slab_ForEachDirty(void (*func)(void * cell)) {
+	slab_page ** pages = slab_dirty_pages;
+	size_t count = slab_dirty_count, size = slab_dirty_size;
+
+	// pages dirtied again by func go onto a fresh list
+	slab_dirty_pages = slab_dirty_spare;
+	slab_dirty_size  = slab_dirty_spare_size;
+	slab_dirty_count = 0;
+
+	size_t i;
+	for (i = 0; i < count; ++i) {
+		slab_page * page = pages[i];
+		slab_class * c = slab_classes + page->class_id;
+		page->dirty = 0;
+
+		char * first = (char *)page + SLAB_ALIGN(sizeof(slab_page));
+		char * end   = page == c->pages ? c->bump : (char *)page + SLAB_PAGE_SIZE;
+		size_t card;
+
+		for (card = 0; card < SLAB_PAGE_CARDS; ++card) {
+			if (!page->cards[card])
+				continue;
+			page->cards[card] = 0;
+
+			// first cell starting at or after the card's start
+			char * card_start = (char *)page + (card << SLAB_CARD_SHIFT);
+			char * card_end   = card_start + (1 << SLAB_CARD_SHIFT);
+			char * cell = first;
+			if (card_start > first)
+				cell += (card_start - first + c->cell_size - 1) / c->cell_size * c->cell_size;
+
+			for (; cell < card_end && cell + c->cell_size <= end; cell += c->cell_size)
+				func(cell);
+		}
+	}
+
+	slab_dirty_spare = pages;
+	slab_dirty_spare_size = size;
+}
+
+size_t Slab_Capacity(int class_id) {
+	slab_class * c = slab_classes + class_id;
+	size_t per_page = (SLAB_PAGE_SIZE - SLAB_ALIGN(sizeof(slab_page))) / c->cell_size;
+	return per_page * c->page_count;
+}
+
+void Slab_DisplayStats(void) {
+	int i;
+	fprintf(stderr, "-- SLABS --\n");
+	fprintf(stderr, "%-8s %6s %6s %10s %10s %10s %6s\n",
+		"class", "cell", "pages", "live", "peak", "capacity", "occ%");
+	for (i = 0; i < SLAB_CLASS_COUNT; ++i) {
+		slab_class * c = slab_classes + i;
+		size_t capacity = Slab_Capacity(i);
+		double occupancy = capacity ? 100.0 * c->live_count / capacity : 0.0;
+
+		fprintf(stderr, "%-8s %6zu %6zu %10zu %10zu %10zu %6.1f\n", c->name,
+			c->cell_size, c->page_count, c->live_count, c->peak_count,
+			capacity, occupancy);
+	}
+}
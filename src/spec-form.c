@@ -1,277 +1,224 @@
 #include "std.h"
 #include "scheme.h"
-
-scheme_object * Scheme_Special_Define(scheme_object ** objs, scheme_object* env, size_t count) {
-	char definition_type = objs[0]->type;
-
-	// function definition
-	if (definition_type == SCHEME_PAIR) {
-		int len = Scheme_ListLength(objs[0]);
-		int argc = len-1;
-
-		if (len == 0) {
-			Scheme_SetError("(define (func ...) [body]) : malformed syntax");
-			return NULL;
-		}
-
-		scheme_pair * def_list_pair = Scheme_GetPair(objs[0]);
-		if (!def_list_pair->car || def_list_pair->car->type != SCHEME_SYMBOL) {
-			Scheme_SetError("(define (func ...) [body]) : non-symbol given as procedure name");
-			return NULL;
-		}
-
-		symbol * def_sym;
-		ReferenceSymbol(&def_sym, Scheme_GetSymbol(def_list_pair->car)->sym);
-
-		scheme_object ** lambda_args = malloc(sizeof(scheme_object*) * count);
-		int i;
-		lambda_args[0] = def_list_pair->cdr;
-		for (i = 1; i < count; ++i) {
-			lambda_args[i] = objs[i];
-		}
-
-		scheme_object * lambda = Scheme_Special_Lambda(lambda_args, env, count);
-		free(lambda_args);
-
-		scheme_env * env_pointer = Scheme_GetEnvObj(env);
-		if (!env_pointer) {
-			Scheme_SetError("bad environment");
-			return NULL;
-		}
-		Scheme_DefineEnv(env_pointer, Scheme_CreateDefine(def_sym, lambda));
-
-		return Scheme_CreateSymbolFromSymbol(def_sym);
-	} else // variable definition
-	if (definition_type == SCHEME_SYMBOL) {
-		if (count > 2) {
-			Scheme_SetError("(define variable val) : bad arg count");
-			return NULL;
-		}
-
-		scheme_object * val;
-		Scheme_ReferenceObject(&val, objs[1]);
-		//val = Scheme_Eval(objs[1], env);
-		symbol * def_sym;
-		ReferenceSymbol(&def_sym, Scheme_GetSymbol(objs[0])->sym);
-
-		scheme_env    * env_pointer = Scheme_GetEnvObj(env);
-		if (!env_pointer) {
-			Scheme_SetError("bad environment");
-			return NULL;
-		}
-
-		Scheme_DefineEnv(env_pointer, Scheme_CreateDefine(def_sym, val));
-		return Scheme_CreateSymbolFromSymbol(def_sym);
+#include "gc.h"
+
+int Scheme_Special_Define(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	// Scheme_Resolve turns both (define var val) and (define (func ...) [body])
+	// into a reference to the binding followed by the value
+	if (Scheme_Type(objs[0]) != SCHEME_REF) {
+		Scheme_SetError("(define ...) : malformed syntax");
+		return 0;
 	}
 
-	Scheme_SetError("(define ...) : malformed syntax");
-	return NULL;
-}
+	if (count > 2) {
+		Scheme_SetError("(define variable val) : bad arg count");
+		return 0;
+	}
 
-scheme_object * Scheme_Special_Lambda(scheme_object ** objs, scheme_object* env, size_t count) {
-	int i;
-	int argc;
+	if (!Scheme_CompileExpr(objs[1], c, 0))
+		return 0;
 
-	if (!objs[0] || objs[0]->type == SCHEME_NULL) {
-		argc = 0;
-	} else if (objs[0]->type != SCHEME_PAIR) {
-		Scheme_SetError("(lambda (args) ...) : malformed syntax : expected args list");
-		return NULL;
+	// a global's cell belongs to the environment the define runs in,
+	// a local is always defined in the current frame
+	scheme_ref * ref = Scheme_GetRef(objs[0]);
+	if (ref->cell) {
+		Scheme_Emit(c, OP_DEFINE_GLOBAL);
+		Scheme_EmitOperand(c, Scheme_AddCell(c, ref->cell));
 	} else {
-		argc = Scheme_ListLength(objs[0]);
+		Scheme_CompileSetLocal(c, ref);
 	}
 
-	symbol ** def_args = malloc(sizeof(symbol) * argc);
-	if (argc) {
-		scheme_object * pair_i = objs[0];
-		for (i = 0; i < argc; ++i) {
-			char type = pair_i->type;
-			if (type != SCHEME_PAIR) {
-				Scheme_SetError("(define (func ...) [body]) : bad argument list");
-				free(def_args);
-				return NULL;
-			}
-
-			scheme_pair * pair_pair = Scheme_GetPair(pair_i);
-			if (!pair_pair->car) {
-				Scheme_SetError("(define (func ...) [body]) : bad argument list");
-				free(def_args);
-				return NULL;
-			}
-
-			char car_type = pair_pair->car->type;
-			if (car_type != SCHEME_SYMBOL) {
-				Scheme_SetError("(define (func ...) [body]) : non-symbol in argument list");
-				free(def_args);
-				return NULL;
-			}
-	
-			scheme_symbol * arg_sym = Scheme_GetSymbol(pair_pair->car);
-			ReferenceSymbol(&def_args[i], arg_sym->sym);
-			pair_i = pair_pair->cdr;
-		}
-	}
+	// the name is returned every time the define runs
+	Scheme_Emit(c, OP_CONST);
+	Scheme_EmitOperand(c, Scheme_AddConstant(c, Scheme_CreateSymbolFromSymbol(ref->sym)));
+	Scheme_EmitReturn(c, tail);
+	return 1;
+}
 
-	int body_count = count - 1;
-	scheme_object ** body = malloc(sizeof(scheme_object *) * body_count);
-	for (i = 0; i < body_count; ++i) {
-		Scheme_ReferenceObject(&body[i], objs[i+1]);
+int Scheme_Special_Lambda(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	// the frame size and whether it is captured come first in a resolved
+	// lambda, they are only left out when the argument list is malformed
+	if (!Scheme_IsFixnum(objs[0])) {
+		Scheme_SetError("(lambda (args) ...) : malformed syntax : expected args list");
+		return 0;
 	}
+	int frame_size = Scheme_FixnumValue(objs[0]);
+	char captured = objs[1] == SCHEME_TRUE_OBJ;
 
-	scheme_object * closure = env;
-	//Scheme_ReferenceObject(&closure, env);
+	int code = Scheme_CompileLambda(objs[2], frame_size, captured, objs + 3, count - 3, c);
+	if (code < 0)
+		return 0;
 
-	scheme_object * lambda = Scheme_CreateLambda(argc, 0, def_args, body_count, body, closure);
-	return lambda;
+	Scheme_Emit(c, OP_CLOSURE);
+	Scheme_EmitOperand(c, code);
+	Scheme_EmitReturn(c, tail);
+	return 1;
 }
 
-scheme_object * Scheme_Special_If(scheme_object ** objs, scheme_object* env, size_t count) {
-	scheme_object * cond_eval = Scheme_Eval(objs[0], env);
-	char cond = Scheme_BoolTest(cond_eval);
-	Scheme_DereferenceObject(&cond_eval);
-
-	if (cond) {
-		return Scheme_Eval(objs[1], env);
-	} else {
-		return Scheme_Eval(objs[2], env);
-	}
+int Scheme_Special_If(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	if (!Scheme_CompileExpr(objs[0], c, 0))
+		return 0;
+	int else_jump = Scheme_EmitJump(c, OP_JUMP_IF_FALSE);
+	int depth = c->depth;
+
+	// both branches are in tail position if the if is, and then return
+	// by themselves
+	if (!Scheme_CompileExpr(objs[1], c, tail))
+		return 0;
+	int end_jump = tail ? -1 : Scheme_EmitJump(c, OP_JUMP);
+
+	Scheme_PatchJump(c, else_jump);
+	c->depth = depth;
+	if (!Scheme_CompileExpr(objs[2], c, tail))
+		return 0;
+
+	if (end_jump != -1)
+		Scheme_PatchJump(c, end_jump);
+	return 1;
 }
 
-scheme_object * Scheme_Special_Quote(scheme_object ** objs, scheme_object* env, size_t count) {
-	scheme_object * o;
-	Scheme_ReferenceObject(&o, objs[0]);
-	return o;
-
+int Scheme_Special_Quote(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	Scheme_Emit(c, OP_CONST);
+	Scheme_EmitOperand(c, Scheme_AddConstant(c, objs[0]));
+	Scheme_EmitReturn(c, tail);
+	return 1;
 }
 
-scheme_object * Scheme_Special_Cond(scheme_object ** objs, scheme_object* env, size_t count) {
-	size_t i;
+int Scheme_Special_Cond(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	// jumps out of the clauses that are not in tail position
+	int end_jumps[count + 1];
+	int end_count = 0;
+	int depth = c->depth;
 
+	size_t i;
 	for (i = 0; i < count; ++i) {
 		scheme_object * base_obj = objs[i];
-		
-		if (!base_obj || base_obj->type != SCHEME_PAIR) {
+		int clause_count = Scheme_ListLength(base_obj);
+
+		if (Scheme_Type(base_obj) != SCHEME_PAIR || error_str) {
 			Scheme_SetError("(cond (predicate [clauses ...]) ...) : malformed syntax");
-			return NULL;
+			return 0;
 		}
 
 		scheme_pair * base_pair = Scheme_GetPair(base_obj);
-
-		char predicate_bool = 0;
-
 		scheme_object * predicate_expr = base_pair->car;
-		scheme_object * clause_expr    = base_pair->cdr;
-		scheme_object * predicate_val  = NULL;
+		c->depth = depth;
 
 		// check if special 'else' keyword
-		if (!Scheme_IsNull(predicate_expr) && predicate_expr->type == SCHEME_SYMBOL
-			&& Scheme_SymbolEq(Scheme_GetSymbol(predicate_expr)->sym, ELSE_SYMBOL))
-		{
-			predicate_bool = 1;
-		} else {
-			predicate_val = Scheme_Eval(predicate_expr, env);
-
-			if (error_str) {
-				return NULL;
+		int next_jump = -1;
+		char is_else = Scheme_Type(predicate_expr) == SCHEME_SYMBOL
+			&& Scheme_SymbolEq(Scheme_GetSymbol(predicate_expr)->sym, ELSE_SYMBOL);
+
+		if (--clause_count == 0) {
+			// the value of the predicate is the value of the cond
+			if (is_else) {
+				Scheme_Emit(c, OP_CONST);
+				Scheme_EmitOperand(c, Scheme_AddConstant(c, SCHEME_UNSPECIFIED_OBJ));
+			} else {
+				if (!Scheme_CompileExpr(predicate_expr, c, 0))
+					return 0;
+				Scheme_Emit(c, OP_DUP);
+				next_jump = Scheme_EmitJump(c, OP_JUMP_IF_FALSE);
 			}
 
-			predicate_bool = Scheme_BoolTest(predicate_val);
-		}
+			if (tail)
+				Scheme_Emit(c, OP_RETURN);
+			else
+				end_jumps[end_count++] = Scheme_EmitJump(c, OP_JUMP);
 
-		if (!predicate_bool) {
-			Scheme_DereferenceObject(&predicate_val);
+			if (next_jump != -1) {
+				// the false predicate is still on the stack
+				Scheme_PatchJump(c, next_jump);
+				c->depth = depth + 1;
+				Scheme_Emit(c, OP_POP);
+			}
 			continue;
 		}
 
-		if (Scheme_IsNull(clause_expr))
-			return predicate_val;
-		else if (predicate_val)
-			Scheme_DereferenceObject(&predicate_val);
-
-		while (1) {
-			if (clause_expr->type != SCHEME_PAIR) {
-				Scheme_SetError("(cond (predicate [clauses ...]) ...) : malformed syntax");
-				return NULL;
-			}
+		if (!is_else) {
+			if (!Scheme_CompileExpr(predicate_expr, c, 0))
+				return 0;
+			next_jump = Scheme_EmitJump(c, OP_JUMP_IF_FALSE);
+		}
 
+		scheme_object * clauses[clause_count];
+		scheme_object * clause_expr = base_pair->cdr;
+		int j;
+		for (j = 0; j < clause_count; ++j) {
 			scheme_pair * clause_pair = Scheme_GetPair(clause_expr);
-			scheme_object * clause_val = Scheme_Eval(clause_pair->car, env);
-
-			if (Scheme_IsNull(clause_pair->cdr)) {
-				return clause_val;
-			} else {
-				Scheme_DereferenceObject(&clause_val);
-				clause_expr = clause_pair->cdr;
-			}
+			clauses[j] = clause_pair->car;
+			clause_expr = clause_pair->cdr;
 		}
-	}
 
-	return NULL;
-}
+		if (!Scheme_CompileBody(clauses, clause_count, c, tail))
+			return 0;
+		if (!tail)
+			end_jumps[end_count++] = Scheme_EmitJump(c, OP_JUMP);
 
-scheme_object * Scheme_Special_Let(scheme_object ** objs, scheme_object* env, size_t count) {
-	scheme_object * var_list_obj = objs[0];
-
-	if (Scheme_IsNull(var_list_obj)) {
-		Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
-		return NULL;
+		if (next_jump != -1)
+			Scheme_PatchJump(c, next_jump);
 	}
 
-	int var_list_len = Scheme_ListLength(var_list_obj);
+	// no clause matched
+	c->depth = depth;
+	Scheme_Emit(c, OP_CONST);
+	Scheme_EmitOperand(c, Scheme_AddConstant(c, SCHEME_UNSPECIFIED_OBJ));
+	Scheme_EmitReturn(c, tail);
 
-	scheme_object * new_env_obj = Scheme_CreateEnvObj(env, var_list_len);
-	scheme_env    * new_env     = Scheme_GetEnvObj(new_env_obj);
-
-	int i;
-	for (i = 0; i < var_list_len; ++i) {
-		if (var_list_obj->type != SCHEME_PAIR) {
-			Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
-			return NULL;
-		}
+	for (i = 0; i < end_count; ++i)
+		Scheme_PatchJump(c, end_jumps[i]);
+	return 1;
+}
 
+int Scheme_Special_Let(scheme_object ** objs, size_t count, scheme_compiler * c, char tail) {
+	// the frame size and whether it is captured come first in a resolved let
+	if (!Scheme_IsFixnum(objs[0]) || Scheme_IsNull(objs[2])) {
+		Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
+		return 0;
+	}
+	int frame_size = Scheme_FixnumValue(objs[0]);
+	char captured = objs[1] == SCHEME_TRUE_OBJ;
+
+	// the values are evaluated outside the new frame, Scheme_Resolve
+	// has checked the variable list
+	scheme_object * var_list_obj = objs[2];
+	int var_count = 0;
+	while (!Scheme_IsNull(var_list_obj)) {
 		scheme_pair * var_list_pair = Scheme_GetPair(var_list_obj);
-		scheme_object * var_obj = var_list_pair->car;
-		if (Scheme_IsNull(var_obj) || var_obj->type != SCHEME_PAIR) {
-			Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
-			Scheme_DereferenceObject(&new_env_obj);
-			return NULL;
-		}
+		scheme_pair * var_pair = Scheme_GetPair(var_list_pair->car);
+		scheme_object * var_expr = Scheme_GetPair(var_pair->cdr)->car;
 
-		scheme_pair * var_pair = Scheme_GetPair(var_obj);
-
-		scheme_object * var_sym  = var_pair->car,
-		              * var_expr = var_pair->cdr;
+		if (!Scheme_CompileExpr(var_expr, c, 0))
+			return 0;
+		var_list_obj = var_list_pair->cdr;
+		++var_count;
+	}
 
-		if (Scheme_IsNull(var_expr) || var_expr->type != SCHEME_PAIR) {
-			Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
-			Scheme_DereferenceObject(&new_env_obj);
-			return NULL;
+	// the variables take the first slots in order
+	scheme_block block;
+	Scheme_EnterBlock(c, &block, frame_size, captured);
+	if (captured) {
+		Scheme_Emit(c, OP_MAKE_ENV);
+		Scheme_EmitOperand(c, var_count);
+		Scheme_EmitOperand(c, frame_size);
+		Scheme_EmitStack(c, -var_count);
+	} else {
+		int i;
+		for (i = var_count - 1; i >= 0; --i) {
+			Scheme_Emit(c, OP_SET_LOCAL);
+			Scheme_EmitOperand(c, block.base + i);
 		}
-		var_expr = Scheme_GetPair(var_expr)->car;
-
-		if (Scheme_IsNull(var_sym) || var_sym->type != SCHEME_SYMBOL) {
-			Scheme_SetError("(let ((symbol value) ...) [clauses ...]) : malformed syntax");
-			Scheme_DereferenceObject(&new_env_obj);
-			return NULL;
+		// a slot may still hold a value from an earlier frame
+		for (i = var_count; i < frame_size; ++i) {
+			Scheme_Emit(c, OP_UNBIND);
+			Scheme_EmitOperand(c, block.base + i);
 		}
-
-		symbol * sym;
-		scheme_object * val = Scheme_Eval(var_expr, env);
-		ReferenceSymbol(&sym, Scheme_GetSymbol(var_sym)->sym);
-
-		Scheme_DefineEnv(new_env, Scheme_CreateDefine(sym, val));
 	}
 
-	int end = count-1;
-	scheme_object * return_val = NULL;
-	for (i = 1; i < count; ++i) {
-		scheme_object * val = Scheme_Eval(objs[i], new_env_obj);
-		if (i == end)
-			return_val = val;
-		else
-			Scheme_DereferenceObject(&val);
-	}
+	int success = Scheme_CompileBody(objs + 3, count - 3, c, tail);
+	Scheme_LeaveBlock(c);
 
-	Scheme_DereferenceObject(&new_env_obj);
-	return return_val;
+	if (success && captured && !tail)
+		Scheme_Emit(c, OP_POP_ENV);
+	return success;
 }
@@ -1,91 +1,94 @@
 #include "std.h"
 #include "scheme.h"
 #include "parser.h"
+#include "gc.h"
+#include "bigint.h"
+#include "profile.h"
 
-scheme_object * __Exit__(scheme_object ** objs, scheme_object * env, size_t count) {
+#include <limits.h>
+
+scheme_object * __Exit__(void) {
 	SCHEME_INTERPRETER_HALT = 1;
 	return NULL;
 }
 
 scheme_object * __Scheme_List__(scheme_object ** objs, scheme_object * env, size_t count) {
-	if (count == 0) {
-		return Scheme_CreatePairWithoutRef(NULL, NULL);
-	}
+	if (count == 0)
+		return SCHEME_NULL_OBJ;
 
-	scheme_object * base = Scheme_CreatePair(objs[count-1], NULL);
+	scheme_object * base = Scheme_CreatePair(objs[count-1], SCHEME_NULL_OBJ);
+	GC_PROTECT(base);
 
 	int i;
 	for (i = count-2; i >= 0; --i) {
-		scheme_object * car;
-		Scheme_ReferenceObject(&car, objs[i]);
-
-		base = Scheme_CreatePairWithoutRef(car, base);
+		base = Scheme_CreatePair(objs[i], base);
 	}
 
+	GC_UNPROTECT(1);
 	return base;
 }
 
-scheme_object * __Scheme_cons__(scheme_object ** objs, scheme_object * env, size_t count) {
-	return Scheme_CreatePair(objs[0], objs[1]);
+scheme_object * __Scheme_cons__(scheme_object * car, scheme_object * cdr) {
+	return Scheme_CreatePair(car, cdr);
 }
 
-scheme_object * __Scheme_car__(scheme_object ** objs, scheme_object * env, size_t count) {
-	if (!objs[0] || objs[0]->type != SCHEME_PAIR) {
+scheme_object * __Scheme_car__(scheme_object * pair) {
+	if (Scheme_Type(pair) != SCHEME_PAIR) {
 		Scheme_SetError("car on non-pair object");
 		return NULL;
 	}
 
-	scheme_object * car;
-	Scheme_ReferenceObject(&car, Scheme_Car(objs[0]));
-	return car;
+	return Scheme_Car(pair);
 }
 
-scheme_object * __Scheme_cdr__(scheme_object ** objs, scheme_object * env, size_t count) {
-	if (!objs[0] || objs[0]->type != SCHEME_PAIR) {
+scheme_object * __Scheme_cdr__(scheme_object * pair) {
+	if (Scheme_Type(pair) != SCHEME_PAIR) {
 		Scheme_SetError("car on non-pair object");
 		return NULL;
 	}
 
-	scheme_object * cdr;
-	Scheme_ReferenceObject(&cdr, Scheme_Cdr(objs[0]));
-	return cdr;
+	return Scheme_Cdr(pair);
 }
 
-scheme_object * __Pred_eq__(scheme_object ** objs, scheme_object * env, size_t count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-	scheme_boolean * boolean = Scheme_GetBoolean(result);
+scheme_object * __Scheme_SetCar__(scheme_object * pair, scheme_object * obj) {
+	if (Scheme_Type(pair) != SCHEME_PAIR) {
+		Scheme_SetError("set-car! on non-pair object");
+		return NULL;
+	}
 
-	scheme_object * a = objs[0];
-	scheme_object * b = objs[0];
+	Scheme_SetCar(pair, obj);
+	return SCHEME_UNSPECIFIED_OBJ;
+}
 
-	char a_is_sym = a && a->type == SCHEME_SYMBOL;
-	char b_is_sym = b && b->type == SCHEME_SYMBOL;
+scheme_object * __Scheme_SetCdr__(scheme_object * pair, scheme_object * obj) {
+	if (Scheme_Type(pair) != SCHEME_PAIR) {
+		Scheme_SetError("set-cdr! on non-pair object");
+		return NULL;
+	}
 
-	if (a_is_sym != b_is_sym) {
-		boolean->val = 0;
-	} else {
-		if (a_is_sym && b_is_sym) {
-			scheme_symbol * a_sym = Scheme_GetSymbol(a);
-			scheme_symbol * b_sym = Scheme_GetSymbol(b);
-			boolean->val = a_sym->sym->str == b_sym->sym->str;
-		} else {
-			if (a && b)
-				boolean->val = a->payload == b->payload;
-			else
-				boolean->val = 0;
-		}
+	Scheme_SetCdr(pair, obj);
+	return SCHEME_UNSPECIFIED_OBJ;
+}
+
+scheme_object * __Pred_eq__(scheme_object * a, scheme_object * b) {
+	// immediates compare by value, heap objects by identity
+	if (a == b)
+		return SCHEME_TRUE_OBJ;
+
+	char a_is_sym = Scheme_Type(a) == SCHEME_SYMBOL;
+	char b_is_sym = Scheme_Type(b) == SCHEME_SYMBOL;
+
+	if (a_is_sym && b_is_sym) {
+		scheme_symbol * a_sym = Scheme_GetSymbol(a);
+		scheme_symbol * b_sym = Scheme_GetSymbol(b);
+		return Scheme_MakeBoolean(a_sym->sym->str == b_sym->sym->str);
 	}
 
-	return result;
+	return SCHEME_FALSE_OBJ;
 }
 
-scheme_object * __Pred_null__(scheme_object ** objs, scheme_object * env, size_t count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-	scheme_boolean * boolean = Scheme_GetBoolean(result);
-	boolean->val = Scheme_IsNull(objs[0]);
-	return result;
+scheme_object * __Pred_null__(scheme_object * obj) {
+	return Scheme_MakeBoolean(Scheme_IsNull(obj));
 }
 
 void __Math_Complement__(scheme_number * left, scheme_number * right) {
@@ -94,6 +97,18 @@ void __Math_Complement__(scheme_number * left, scheme_number * right) {
 
 	if (ltype == rtype) return;
 
+	// exact numbers of any size are worked on together, a bignum or big
+	// rational goes along with a double as a double
+	if (ltype == NUMBER_BIGINT || ltype == NUMBER_BIGRATIONAL
+	    || rtype == NUMBER_BIGINT || rtype == NUMBER_BIGRATIONAL)
+	{
+		if (ltype != NUMBER_DOUBLE && rtype != NUMBER_DOUBLE)
+			return;
+		__ToDouble__(left);
+		__ToDouble__(right);
+		return;
+	}
+
 	if (ltype == NUMBER_DOUBLE) {
 		if (rtype == NUMBER_INTEGER) {
 			__IntToDouble__(right);
@@ -120,29 +135,96 @@ void __Math_Complement__(scheme_number * left, scheme_number * right) {
 			__IntToRational__(left);	
 }
 
-long long gcd(long long a, long long b) {
-	if (b > a) gcd(b, a);
-	while (b) {
-		long long t = b;
-		b = a % b;
-		a = t;
-	}
-	return a;
+// Stein's binary gcd, shifts and subtractions in place of division
+unsigned long long gcd(unsigned long long a, unsigned long long b) {
+	if (!a || !b)
+		return a | b;
+
+	// the powers of 2 both share, then a stays odd
+	int shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+	do {
+		b >>= __builtin_ctzll(b);
+		if (a > b) {
+			unsigned long long t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	} while (b);
+	return a << shift;
 }
 
-#include <stdio.h>
-void __NormaliseRational__(scheme_number * num) {
-	if (num->type != NUMBER_RATIONAL) return;
-	long long divisor = gcd(num->numerator, num->denominator);
+static unsigned long long __Magnitude__(long long i) {
+	return i < 0 ? 0 - (unsigned long long)i : (unsigned long long)i;
+}
 
-	if (divisor == num->denominator) {
-		long long integer = num->numerator / divisor;
+// num = n / d, both already in lowest terms and d > 0
+static void __Rational_Set__(scheme_number * num, long long n, long long d) {
+	if (d == 1 || n == 0) {
 		num->type = NUMBER_INTEGER;
-		num->integer_val = integer;
+		num->integer_val = n;
+	} else {
+		num->type = NUMBER_RATIONAL;
+		num->numerator = n;
+		num->denominator = d;
+	}
+}
+
+// num + with, or num - with when negate is set, for rationals of long
+// longs. 0 if the result does not fit. with d1 = gcd(b, d) taken out of
+// a/b + c/d first the sum comes out in lowest terms (Knuth 4.5.1), and
+// the products are no bigger than they have to be
+static int __Rational_Add__(scheme_number * num, scheme_number * with, char negate) {
+	long long a = num->numerator, b = num->denominator;
+	long long c = with->numerator, d = with->denominator;
+	long long x, y, n, den;
+	if (negate && __builtin_sub_overflow(0, c, &c))
+		return 0;
+
+	long long d1 = gcd(b, d);
+	if (d1 == 1) {
+		if (__builtin_mul_overflow(a, d, &x) || __builtin_mul_overflow(c, b, &y)
+		    || __builtin_add_overflow(x, y, &n) || __builtin_mul_overflow(b, d, &den))
+			return 0;
 	} else {
-		num->numerator /= divisor;
-		num->denominator /= divisor;
+		// t = a (d / d1) + c (b / d1) only has factors of d1 in common
+		// with b d / d1
+		long long t;
+		if (__builtin_mul_overflow(a, d / d1, &x) || __builtin_mul_overflow(c, b / d1, &y)
+		    || __builtin_add_overflow(x, y, &t))
+			return 0;
+		long long d2 = gcd(__Magnitude__(t), d1);
+		n = t / d2;
+		if (__builtin_mul_overflow(b / d1, d / d2, &den))
+			return 0;
 	}
+
+	__Rational_Set__(num, n, den);
+	return 1;
+}
+
+// num * with, or num / with when invert is set and with is not 0, for
+// rationals of long longs. 0 if the result does not fit. the cross gcds
+// come out of a/b * c/d first, what is left multiplies into lowest terms
+static int __Rational_Mul__(scheme_number * num, scheme_number * with, char invert) {
+	long long a = num->numerator, b = num->denominator;
+	long long c = with->numerator, d = with->denominator;
+	long long n, den;
+	if (invert) {
+		long long t = c;
+		c = d;
+		d = t;
+		if (d < 0 && (__builtin_sub_overflow(0, c, &c) || __builtin_sub_overflow(0, d, &d)))
+			return 0;
+	}
+
+	long long g1 = gcd(__Magnitude__(a), d), g2 = gcd(__Magnitude__(c), b);
+	if (__builtin_mul_overflow(a / g1, c / g2, &n) || __builtin_mul_overflow(b / g2, d / g1, &den))
+		return 0;
+
+	__Rational_Set__(num, n, den);
+	return 1;
 }
 
 void __IntToRational__(scheme_number * num) {
@@ -161,18 +243,38 @@ void __RationalToDouble__(scheme_number * num) {
 	num->double_val = num->numerator / (double)num->denominator;
 }
 
+void __BigintToDouble__(scheme_number * num) {
+	num->type = NUMBER_DOUBLE;
+	num->double_val = Bigint_ToDouble(num->bigint_val);
+}
+
+void __BigRationalToDouble__(scheme_number * num) {
+	double value = Bigint_RatioToDouble(num->big_numerator, num->big_denominator);
+	num->type = NUMBER_DOUBLE;
+	num->double_val = value;
+}
+
+void __ToDouble__(scheme_number * num) {
+	switch (num->type) {
+	case NUMBER_INTEGER    : __IntToDouble__(num);         break;
+	case NUMBER_RATIONAL   : __RationalToDouble__(num);    break;
+	case NUMBER_BIGINT     : __BigintToDouble__(num);      break;
+	case NUMBER_BIGRATIONAL: __BigRationalToDouble__(num); break;
+	}
+}
+
+// the numbers are read where the VM passes them, one at a time as the
+// arithmetic gets to them
 #define __CALL_ARITHMETIC(callname, func, err) \
 scheme_object * callname(scheme_object ** objs, scheme_object * env, size_t count) { \
-	scheme_number nums[count]; \
 	size_t i; \
 	for (i = 0; i < count; ++i) { \
-		if (objs[i]->type != SCHEME_NUMBER) { \
+		if (Scheme_Type(objs[i]) != SCHEME_NUMBER) { \
 			Scheme_SetError(err " expects only number arguments"); \
 			return NULL; \
 		} \
-		nums[i] = *Scheme_GetNumber(objs[i]); \
 	} \
-	return func(nums, count); \
+	return func(objs, count); \
 } 
 
 __CALL_ARITHMETIC(__Scheme_CallAdd__, __Scheme_Add__, "+");
@@ -185,479 +287,392 @@ __CALL_ARITHMETIC(__Scheme_CallALessThanEqual__, __Scheme_Arithmetic_LessThanEqu
 __CALL_ARITHMETIC(__Scheme_CallAGreaterThan__, __Scheme_Arithmetic_GreaterThan__, ">");
 __CALL_ARITHMETIC(__Scheme_CallAGreaterThanEqual__, __Scheme_Arithmetic_GreaterThanEqual__, ">=");
 
-scheme_object * __Scheme_Add__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_NUMBER);
+// two fixnums, by far the most common arguments, skip the numeric tower
+// as long as op (one of the __builtin_*_overflow) gives a long long
+#define __FIXNUM_FAST_PATH(objs, count, op) do { \
+	long long r; \
+	if (count == 2 && Scheme_IsFixnum(objs[0]) && Scheme_IsFixnum(objs[1]) \
+	    && !op(Scheme_FixnumValue(objs[0]), Scheme_FixnumValue(objs[1]), &r)) \
+		return Scheme_CreateInteger(r); \
+} while (0)
+
+// exact numbers never wrap around: integers and rationals of long longs
+// are worked on as they are until a result does not fit, from then on,
+// and for bignums and big rationals, Bigint_* takes over. num then refers
+// to the limbs of acc, which has to be on the GC stack
+#define __EXACT_OP(num, with, fast, bigop, acc) do { \
+	if (!fast(num, with)) { \
+		if (!((acc) = bigop(num, with))) { \
+			GC_UNPROTECT(1); \
+			return NULL; \
+		} \
+		*(num) = Scheme_GetNumberValue(acc); \
+	} \
+} while (0)
+
+// num op with in place for two long longs (op one of the
+// __builtin_*_overflow) or two rationals of them, 0 for anything else or
+// a result that does not fit
+#define __EXACT_FAST_PATH(name, op, rational) \
+static int name(scheme_number * num, scheme_number * with) { \
+	long long r; \
+	if (num->type == NUMBER_INTEGER && with->type == NUMBER_INTEGER) { \
+		if (op(num->integer_val, with->integer_val, &r)) \
+			return 0; \
+		num->integer_val = r; \
+		return 1; \
+	} \
+	return num->type == NUMBER_RATIONAL && with->type == NUMBER_RATIONAL && rational; \
+}
+
+__EXACT_FAST_PATH(__Exact_Add__, __builtin_add_overflow, __Rational_Add__(num, with, 0))
+__EXACT_FAST_PATH(__Exact_Sub__, __builtin_sub_overflow, __Rational_Add__(num, with, 1))
+__EXACT_FAST_PATH(__Exact_Mul__, __builtin_mul_overflow, __Rational_Mul__(num, with, 0))
 
-	scheme_number * r_num = Scheme_GetNumber(result);
-	*r_num = *nums;
+// with is not 0. two integers make a rational, in lowest terms like the rest
+static int __Exact_Div__(scheme_number * num, scheme_number * with) {
+	if (num->type == NUMBER_INTEGER && with->type == NUMBER_INTEGER) {
+		__IntToRational__(num);
+		__IntToRational__(with);
+	}
+	return num->type == NUMBER_RATIONAL && with->type == NUMBER_RATIONAL
+		&& __Rational_Mul__(num, with, 1);
+}
+
+// the result of the arithmetic in num, acc is the bignum or big rational
+// it came to if any
+static scheme_object * __Math_Result__(scheme_number * num, scheme_object * acc) {
+	if ((num->type == NUMBER_BIGINT || num->type == NUMBER_BIGRATIONAL) && acc)
+		return acc;
+	return Scheme_CreateNumber(num);
+}
+
+scheme_object * __Scheme_Add__(scheme_object ** objs, int count) {
+	__FIXNUM_FAST_PATH(objs, count, __builtin_add_overflow);
+
+	scheme_number result = Scheme_GetNumberValue(objs[0]);
+	scheme_number * r_num = &result;
+	scheme_object * acc = NULL;
+	GC_PROTECT(acc);
 
 	int i = 1;
 	while (i != count) {
-		scheme_number * to_add = nums + i;
+		scheme_number operand = Scheme_GetNumberValue(objs[i]);
+		scheme_number * to_add = &operand;
 		__Math_Complement__(r_num, to_add);
 
-		switch (r_num->type) {
-		case NUMBER_INTEGER:
-			r_num->integer_val += to_add->integer_val;
-			break;
-		case NUMBER_DOUBLE:
+		if (r_num->type == NUMBER_DOUBLE)
 			r_num->double_val += to_add->double_val;
-			break;
-		case NUMBER_RATIONAL: {
-			long long topleft  = r_num->numerator * to_add->denominator;
-			long long topright = to_add->numerator * r_num->denominator;
-			long long new_denom = to_add->denominator * r_num->denominator;
-			r_num->numerator = topleft + topright;
-			r_num->denominator = new_denom;
-			break; }
-		}
+		else
+			__EXACT_OP(r_num, to_add, __Exact_Add__, Bigint_Add, acc);
 
 		++i;
 	}
 
-	if (r_num->type == NUMBER_RATIONAL)
-		__NormaliseRational__(r_num);
-	return result;
+	scheme_object * obj = __Math_Result__(r_num, acc);
+	GC_UNPROTECT(1);
+	return obj;
 }
 
-scheme_object * __Scheme_Sub__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_NUMBER);
+scheme_object * __Scheme_Sub__(scheme_object ** objs, int count) {
+	__FIXNUM_FAST_PATH(objs, count, __builtin_sub_overflow);
 
-	scheme_number * r_num = Scheme_GetNumber(result);
-	*r_num = *nums;
+	scheme_number result = Scheme_GetNumberValue(objs[0]);
+	scheme_number * r_num = &result;
 
+	// (- x) negates a double, which 0 - x would turn from -0.0 into 0.0,
+	// and is 0 - x for exact numbers, overflowing into a bignum
 	int i = 1;
+	if (count == 1 && result.type == NUMBER_DOUBLE) {
+		result.double_val = -result.double_val;
+		return Scheme_CreateNumber(&result);
+	}
+	if (count == 1) {
+		result.type = NUMBER_INTEGER;
+		result.integer_val = 0;
+		i = 0;
+	}
+
+	scheme_object * acc = NULL;
+	GC_PROTECT(acc);
 	while (i != count) {
-		scheme_number * to_add = nums + i;
+		scheme_number operand = Scheme_GetNumberValue(objs[i]);
+		scheme_number * to_add = &operand;
 		__Math_Complement__(r_num, to_add);
 
-		switch (r_num->type) {
-		case NUMBER_INTEGER:
-			r_num->integer_val -= to_add->integer_val;
-			break;
-		case NUMBER_DOUBLE:
+		if (r_num->type == NUMBER_DOUBLE)
 			r_num->double_val -= to_add->double_val;
-			break;
-		case NUMBER_RATIONAL: {
-			long long topleft  = r_num->numerator * to_add->denominator;
-			long long topright = to_add->numerator * r_num->denominator;
-			long long new_denom = to_add->denominator * r_num->denominator;
-			r_num->numerator = topleft - topright;
-			r_num->denominator = new_denom;
-			break; }
-		}
+		else
+			__EXACT_OP(r_num, to_add, __Exact_Sub__, Bigint_Sub, acc);
 
 		++i;
 	}
 
-	if (r_num->type == NUMBER_RATIONAL)
-		__NormaliseRational__(r_num);
-	return result;
+	scheme_object * obj = __Math_Result__(r_num, acc);
+	GC_UNPROTECT(1);
+	return obj;
 }
 
-scheme_object * __Scheme_Mul__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_NUMBER);
+scheme_object * __Scheme_Mul__(scheme_object ** objs, int count) {
+	__FIXNUM_FAST_PATH(objs, count, __builtin_mul_overflow);
 
-	scheme_number * r_num = Scheme_GetNumber(result);
-	*r_num = *nums;
+	scheme_number result = Scheme_GetNumberValue(objs[0]);
+	scheme_number * r_num = &result;
+	scheme_object * acc = NULL;
+	GC_PROTECT(acc);
 
 	int i = 1;
 	while (i != count) {
-		scheme_number * to_add = nums + i;
+		scheme_number operand = Scheme_GetNumberValue(objs[i]);
+		scheme_number * to_add = &operand;
 		__Math_Complement__(r_num, to_add);
 
-		switch (r_num->type) {
-		case NUMBER_INTEGER:
-			r_num->integer_val *= to_add->integer_val;
-			break;
-		case NUMBER_DOUBLE:
+		if (r_num->type == NUMBER_DOUBLE)
 			r_num->double_val *= to_add->double_val;
-			break;
-		case NUMBER_RATIONAL:
-			r_num->numerator *= to_add->numerator;
-			r_num->denominator *= to_add->denominator;
-			break;
-		}
+		else
+			__EXACT_OP(r_num, to_add, __Exact_Mul__, Bigint_Mul, acc);
 
 		++i;
 	}
 
-	if (r_num->type == NUMBER_RATIONAL)
-		__NormaliseRational__(r_num);
-	return result;
+	scheme_object * obj = __Math_Result__(r_num, acc);
+	GC_UNPROTECT(1);
+	return obj;
 }
 
-scheme_object * __Scheme_Div__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_NUMBER);
-
-	scheme_number * r_num = Scheme_GetNumber(result);
-	*r_num = *nums;
+scheme_object * __Scheme_Div__(scheme_object ** objs, int count) {
+	scheme_number result = Scheme_GetNumberValue(objs[0]);
+	scheme_number * r_num = &result;
+	scheme_object * acc = NULL;
+	GC_PROTECT(acc);
 
+	// (/ x) is 1 / x
 	int i = 1;
+	if (count == 1) {
+		result.type = NUMBER_INTEGER;
+		result.integer_val = 1;
+		i = 0;
+	}
+
 	while (i != count) {
-		scheme_number * to_add = nums + i;
+		scheme_number operand = Scheme_GetNumberValue(objs[i]);
+		scheme_number * to_add = &operand;
+
+		// an exact 0 is always an integer, and looked for before
+		// __Math_Complement__ can make a rational 0/1 or a double of it
+		if (to_add->type == NUMBER_INTEGER && to_add->integer_val == 0) {
+			Scheme_SetError("division by zero");
+			GC_UNPROTECT(1);
+			return NULL;
+		}
 		__Math_Complement__(r_num, to_add);
 
-		switch (r_num->type) {
-		case NUMBER_INTEGER: {
-			long long numer = r_num->integer_val;
-			r_num->type = NUMBER_RATIONAL;
-			r_num->numerator = numer;
-			r_num->denominator = to_add->integer_val;
-			break; }
-		case NUMBER_DOUBLE:
+		if (r_num->type == NUMBER_DOUBLE)
 			r_num->double_val /= to_add->double_val;
-			break;
-		case NUMBER_RATIONAL:
-			r_num->numerator *= to_add->denominator;
-			r_num->denominator *= to_add->numerator;
-			break;
-		}
+		else
+			__EXACT_OP(r_num, to_add, __Exact_Div__, Bigint_Div, acc);
 
 		++i;
 	}
 
-	if (r_num->type == NUMBER_RATIONAL)
-		__NormaliseRational__(r_num);
-	return result;
+	scheme_object * obj = __Math_Result__(r_num, acc);
+	GC_UNPROTECT(1);
+	return obj;
 }
 
-scheme_object * __Scheme_Arithmetic_Equal__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-
-	char bool_val = 1;
-
-	scheme_number * left    = nums;
-	scheme_number * end_num = nums + count - 1;
-
-	while (left < end_num) {
-		scheme_number * right = left + 1;
-
-		__Math_Complement__(left, right);
-
-		switch (left->type) {
-		case NUMBER_INTEGER:
-			if (left->integer_val != right->integer_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_DOUBLE:
-			if (left->double_val != right->double_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_RATIONAL:
-			if (left->numerator != right->numerator ||
-			    left->denominator != right->denominator)
-			{
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		}
-
-		++left;
+// -1, 0 or 1 as left is less than, equal to or greater than right, 2
+// when a NaN leaves them unordered or big rationals ran out of memory
+static int __Math_Compare__(scheme_number * left, scheme_number * right) {
+	__Math_Complement__(left, right);
+
+	switch (left->type) {
+	case NUMBER_INTEGER:
+		if (right->type == NUMBER_INTEGER)
+			return (left->integer_val > right->integer_val) - (left->integer_val < right->integer_val);
+		return Bigint_Compare(left, right);
+	case NUMBER_BIGINT:
+	case NUMBER_BIGRATIONAL:
+		return Bigint_Compare(left, right);
+	case NUMBER_DOUBLE:
+		if (left->double_val != left->double_val || right->double_val != right->double_val)
+			return 2;
+		return (left->double_val > right->double_val) - (left->double_val < right->double_val);
+	case NUMBER_RATIONAL: {
+		// denominators are positive, a/b < c/d as a d < c b
+		long long l, r;
+		if (right->type != NUMBER_RATIONAL
+		    || __builtin_mul_overflow(left->numerator, right->denominator, &l)
+		    || __builtin_mul_overflow(right->numerator, left->denominator, &r))
+			return Bigint_Compare(left, right);
+		return (l > r) - (l < r); }
 	}
-
-finish:
-	Scheme_GetBoolean(result)->val = bool_val;
-	return result;
+	return 2;
 }
 
-scheme_object * __Scheme_Arithmetic_LessThan__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-
-	char bool_val = 1;
-
-	scheme_number * left    = nums;
-	scheme_number * end_num = nums + count - 1;
-
-	while (left < end_num) {
-		scheme_number * right = left + 1;
-
-		__Math_Complement__(left, right);
-
-		switch (left->type) {
-		case NUMBER_INTEGER:
-			if (left->integer_val >= right->integer_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_DOUBLE:
-			if (left->double_val >= right->double_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_RATIONAL: {
-			long long l = left->numerator * right->denominator;
-			long long r = right->numerator * left->denominator;
-			if (l >= r)
-			{
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-			}
-		}
-
-		++left;
-	}
-
-finish:
-	Scheme_GetBoolean(result)->val = bool_val;
-	return result;
-
+// each argument compared with the next, the numbers are read again each
+// time as __Math_Complement__ may have turned them into doubles
+#define __ARITHMETIC_COMPARISON(name, test) \
+scheme_object * name(scheme_object ** objs, int count) { \
+	int i; \
+	for (i = 1; i < count; ++i) { \
+		scheme_number left = Scheme_GetNumberValue(objs[i - 1]); \
+		scheme_number right = Scheme_GetNumberValue(objs[i]); \
+		int cmp = __Math_Compare__(&left, &right); \
+		if (cmp == 2 || !(cmp test 0)) \
+			return SCHEME_FALSE_OBJ; \
+	} \
+	return SCHEME_TRUE_OBJ; \
 }
 
-scheme_object * __Scheme_Arithmetic_LessThanEqual__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-
-	char bool_val = 1;
-
-	scheme_number * left    = nums;
-	scheme_number * end_num = nums + count - 1;
-
-	while (left < end_num) {
-		scheme_number * right = left + 1;
-
-		__Math_Complement__(left, right);
-
-		switch (left->type) {
-		case NUMBER_INTEGER:
-			if (left->integer_val > right->integer_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_DOUBLE:
-			if (left->double_val > right->double_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_RATIONAL: {
-			long long l = left->numerator * right->denominator;
-			long long r = right->numerator * left->denominator;
-			if (l > r)
-			{
-				bool_val = 0;
-				goto finish;
-			}
-			break; }
-		}
-
-		++left;
+__ARITHMETIC_COMPARISON(__Scheme_Arithmetic_Equal__, ==);
+__ARITHMETIC_COMPARISON(__Scheme_Arithmetic_LessThan__, <);
+__ARITHMETIC_COMPARISON(__Scheme_Arithmetic_LessThanEqual__, <=);
+__ARITHMETIC_COMPARISON(__Scheme_Arithmetic_GreaterThan__, >);
+__ARITHMETIC_COMPARISON(__Scheme_Arithmetic_GreaterThanEqual__, >=);
+
+// the double in obj, 0 if it is not one
+static int __Flonum_Value__(scheme_object * obj, double * val) {
+	if (Scheme_IsFlonum(obj)) {
+		*val = Scheme_FlonumValue(obj);
+		return 1;
 	}
-
-finish:
-	Scheme_GetBoolean(result)->val = bool_val;
-	return result;
+	if (Scheme_Type(obj) != SCHEME_NUMBER || Scheme_IsFixnum(obj))
+		return 0;
+
+	scheme_number * num = Scheme_GetNumber(obj);
+	if (num->type != NUMBER_DOUBLE)
+		return 0;
+	*val = num->double_val;
+	return 1;
 }
 
-scheme_object * __Scheme_Arithmetic_GreaterThan__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-
-	char bool_val = 1;
-
-	scheme_number * left    = nums;
-	scheme_number * end_num = nums + count - 1;
-
-	while (left < end_num) {
-		scheme_number * right = left + 1;
-
-		__Math_Complement__(left, right);
-
-		switch (left->type) {
-		case NUMBER_INTEGER:
-			if (left->integer_val <= right->integer_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_DOUBLE:
-			if (left->double_val <= right->double_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_RATIONAL: {
-			long long l = left->numerator * right->denominator;
-			long long r = right->numerator * left->denominator;
-			if (l <= r)
-			{
-				bool_val = 0;
-				goto finish;
-			}
-			break; }
-		}
-
-		++left;
-	}
-
-finish:
-	Scheme_GetBoolean(result)->val = bool_val;
-	return result;
-
+// arithmetic on doubles only, with none of the numeric tower. the VM runs
+// these inline, they are only called for boxed doubles (see object.h),
+// or for a result out of the flonum range, which is boxed
+#define __FLONUM_OP(name, op, result, err) \
+scheme_object * name(scheme_object * a, scheme_object * b) { \
+	double x, y; \
+	if (!__Flonum_Value__(a, &x) || !__Flonum_Value__(b, &y)) { \
+		Scheme_SetError(err " expects only flonum arguments"); \
+		return NULL; \
+	} \
+	return result(x op y); \
 }
 
-scheme_object * __Scheme_Arithmetic_GreaterThanEqual__(scheme_number * nums, int count) {
-	scheme_object * result;
-	Scheme_AllocateObject(&result, SCHEME_BOOLEAN);
-
-	char bool_val = 1;
-
-	scheme_number * left    = nums;
-	scheme_number * end_num = nums + count - 1;
-
-	while (left < end_num) {
-		scheme_number * right = left + 1;
-
-		__Math_Complement__(left, right);
-
-		switch (left->type) {
-		case NUMBER_INTEGER:
-			if (left->integer_val < right->integer_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_DOUBLE:
-			if (left->double_val < right->double_val) {
-				bool_val = 0;
-				goto finish;
-			}
-			break;
-		case NUMBER_RATIONAL: {
-			long long l = left->numerator * right->denominator;
-			long long r = right->numerator * left->denominator;
-			if (l < r)
-			{
-				bool_val = 0;
-				goto finish;
-			}
-			break; }
-		}
-
-		++left;
-	}
-
-finish:
-	Scheme_GetBoolean(result)->val = bool_val;
-	return result;
+__FLONUM_OP(__Flonum_Add__, +, Scheme_CreateDouble, "fl+");
+__FLONUM_OP(__Flonum_Sub__, -, Scheme_CreateDouble, "fl-");
+__FLONUM_OP(__Flonum_Mul__, *, Scheme_CreateDouble, "fl*");
+__FLONUM_OP(__Flonum_LessThan__, <, Scheme_MakeBoolean, "fl<");
 
+scheme_object * __Scheme_CallDisplay__(scheme_object * obj) {
+	Scheme_Display(obj);
+	return SCHEME_UNSPECIFIED_OBJ;
 }
 
-scheme_object * __Scheme_CallDisplay__(scheme_object ** objs, scheme_object * env, size_t count) {
-	Scheme_Display(objs[0]);
-	return NULL;
-}
-
-scheme_object * __Scheme_CallNewline__(scheme_object ** objs, scheme_object * env, size_t count) {
+scheme_object * __Scheme_CallNewline__(void) {
 	Scheme_Newline();
-	return NULL;
+	return SCHEME_UNSPECIFIED_OBJ;
 }
 
-scheme_object * __Scheme_Quotient__(scheme_object ** objs, scheme_object * env, size_t count) {
-	scheme_object * dividend = objs[0];
-	scheme_object * divisor  = objs[1];
+#define __IS_EXACT_INTEGER(num) ((num).type == NUMBER_INTEGER || (num).type == NUMBER_BIGINT)
 
-	if (Scheme_IsNull(dividend) || Scheme_IsNull(divisor)) {
-		Scheme_SetError("quotient : expects integer arguments");
-		return NULL;
-	}
+// long longs divide in C unless the divisor is 0 or the result does not
+// fit, as LLONG_MIN / -1 does not
+#define __LONG_DIVISION(a, b) ((a).type == NUMBER_INTEGER && (b).type == NUMBER_INTEGER \
+	&& (b).integer_val != 0 && ((b).integer_val != -1 || (a).integer_val != LLONG_MIN))
 
-	if (dividend->type != SCHEME_NUMBER || divisor->type != SCHEME_NUMBER) {
+scheme_object * __Scheme_Quotient__(scheme_object * dividend, scheme_object * divisor) {
+	if (Scheme_Type(dividend) != SCHEME_NUMBER || Scheme_Type(divisor) != SCHEME_NUMBER) {
 		Scheme_SetError("quotient : expects integer arguments");
 		return NULL;
 	}
 
-	scheme_number * a = Scheme_GetNumber(dividend);
-	scheme_number * b = Scheme_GetNumber(divisor);
+	scheme_number a = Scheme_GetNumberValue(dividend);
+	scheme_number b = Scheme_GetNumberValue(divisor);
 
-	if (a->type != NUMBER_INTEGER || b->type != NUMBER_INTEGER) {
+	if (!__IS_EXACT_INTEGER(a) || !__IS_EXACT_INTEGER(b)) {
 		Scheme_SetError("quotient : expects integer arguments");
 		return NULL;
 	}
 
-	long long quotient = a->integer_val / b->integer_val;
-	return Scheme_CreateInteger(quotient);
-}
+	if (__LONG_DIVISION(a, b))
+		return Scheme_CreateInteger(a.integer_val / b.integer_val);
 
-scheme_object * __Scheme_Modulo(scheme_object ** objs, scheme_object * env, size_t count) {
-	scheme_object * dividend = objs[0];
-	scheme_object * divisor  = objs[1];
+	scheme_object * quotient;
+	if (!Bigint_DivMod(&a, &b, &quotient, NULL))
+		return NULL;
+	return quotient;
+}
 
-	if (Scheme_IsNull(dividend) || Scheme_IsNull(divisor)) {
+scheme_object * __Scheme_Modulo(scheme_object * dividend, scheme_object * divisor) {
+	if (Scheme_Type(dividend) != SCHEME_NUMBER || Scheme_Type(divisor) != SCHEME_NUMBER) {
 		Scheme_SetError("modulo : expects integer arguments");
 		return NULL;
 	}
 
-	if (dividend->type != SCHEME_NUMBER || divisor->type != SCHEME_NUMBER) {
+	scheme_number a = Scheme_GetNumberValue(dividend);
+	scheme_number b = Scheme_GetNumberValue(divisor);
+
+	if (!__IS_EXACT_INTEGER(a) || !__IS_EXACT_INTEGER(b)) {
 		Scheme_SetError("modulo : expects integer arguments");
 		return NULL;
 	}
 
-	scheme_number * a = Scheme_GetNumber(dividend);
-	scheme_number * b = Scheme_GetNumber(divisor);
+	// the remainder, moved over to the sign of the divisor
+	if (__LONG_DIVISION(a, b)) {
+		long long modulo = a.integer_val % b.integer_val;
+		if (modulo && (modulo < 0) != (b.integer_val < 0))
+			modulo += b.integer_val;
+		return Scheme_CreateInteger(modulo);
+	}
 
-	if (a->type != NUMBER_INTEGER || b->type != NUMBER_INTEGER) {
-		Scheme_SetError("modulo : expects integer arguments");
+	scheme_object * remainder;
+	if (!Bigint_DivMod(&a, &b, NULL, &remainder))
 		return NULL;
-	}
 
-	long long modulo = a->integer_val % b->integer_val;
-	if (modulo < 0) modulo = -modulo;
-	if (b->integer_val < 0) modulo = -modulo;
-	return Scheme_CreateInteger(modulo);
-}
+	scheme_number r = Scheme_GetNumberValue(remainder);
+	char negative = r.type == NUMBER_BIGINT ? r.bigint_val->negative : r.integer_val < 0;
+	char b_negative = b.type == NUMBER_BIGINT ? b.bigint_val->negative : b.integer_val < 0;
+	if (remainder == Scheme_MakeFixnum(0) || negative == b_negative)
+		return remainder;
 
-scheme_object * __Scheme_Remainder__(scheme_object ** objs, scheme_object * env, size_t count) {
-	scheme_object * dividend = objs[0];
-	scheme_object * divisor  = objs[1];
+	GC_PROTECT(remainder);
+	scheme_object * modulo = Bigint_Add(&r, &b);
+	GC_UNPROTECT(1);
+	return modulo;
+}
 
-	if (Scheme_IsNull(dividend) || Scheme_IsNull(divisor)) {
+scheme_object * __Scheme_Remainder__(scheme_object * dividend, scheme_object * divisor) {
+	if (Scheme_Type(dividend) != SCHEME_NUMBER || Scheme_Type(divisor) != SCHEME_NUMBER) {
 		Scheme_SetError("remainder : expects integer arguments");
 		return NULL;
 	}
 
-	if (dividend->type != SCHEME_NUMBER || divisor->type != SCHEME_NUMBER) {
+	scheme_number a = Scheme_GetNumberValue(dividend);
+	scheme_number b = Scheme_GetNumberValue(divisor);
+
+	if (!__IS_EXACT_INTEGER(a) || !__IS_EXACT_INTEGER(b)) {
 		Scheme_SetError("remainder : expects integer arguments");
 		return NULL;
 	}
 
-	scheme_number * a = Scheme_GetNumber(dividend);
-	scheme_number * b = Scheme_GetNumber(divisor);
+	// C truncates, the remainder has the sign of the dividend
+	if (__LONG_DIVISION(a, b))
+		return Scheme_CreateInteger(a.integer_val % b.integer_val);
 
-	if (a->type != NUMBER_INTEGER || b->type != NUMBER_INTEGER) {
-		Scheme_SetError("remainder : expects integer arguments");
+	scheme_object * remainder;
+	if (!Bigint_DivMod(&a, &b, NULL, &remainder))
 		return NULL;
-	}
-
-	long long remainder = a->integer_val % b->integer_val;
-	if (remainder < 0) remainder = -remainder;
-	if (a->integer_val < 0) remainder = -remainder;
-	return Scheme_CreateInteger(remainder);
+	return remainder;
 }
 
-scheme_object * __Scheme_Load__(scheme_object ** objs, scheme_object * env, size_t count) {
-	if (Scheme_IsNull(objs[0]) || objs[0]->type != SCHEME_STRING) {
+scheme_object * __Scheme_Load__(scheme_object * path) {
+	if (Scheme_Type(path) != SCHEME_STRING) {
 		Scheme_SetError("load expects a string");
 		return NULL;
 	}
 
-	FILE * file = fopen(Scheme_GetString(objs[0])->string, "r");
+	FILE * file = fopen(Scheme_GetString(path)->string, "r");
 	if (!file) {
 		Scheme_SetError("cannot load file");
 		return NULL;
@@ -672,24 +687,48 @@ scheme_object * __Scheme_Load__(scheme_object ** objs, scheme_object * env, size
 	}
 
 	fclose(file);
-	scheme_object * eval_result = NULL;
 	while (!Lexer_EOF(&lex)) {
 		scheme_object * obj = Parser_Parse(&lex);
 		if (!obj) break;
 
-		if (eval_result)
-			Scheme_DereferenceObject(&eval_result);
+		GC_PROTECT(obj);
+		Scheme_Eval(obj, USER_INITIAL_ENVIRONMENT_OBJ);
+		GC_UNPROTECT(1);
 
-		scheme_object * eval_result = Scheme_Eval(obj, USER_INITIAL_ENVIRONMENT_OBJ);
-		Scheme_DereferenceObject(&eval_result);
-		Scheme_DereferenceObject(&obj);
-
-		if (error_str) {
-			eval_result = NULL;
+		if (error_str)
 			break;
-		}
 	}
 
 	Lexer_Free(&lex);
-	return NULL;
+	return SCHEME_UNSPECIFIED_OBJ;
+}
+
+// the tracing collector never needed a separate cycle detector: closures
+// and the environments that hold them are reclaimed like anything else
+// unreachable. this just forces a full collection and reports the bytes
+scheme_object * __Scheme_CollectCycles__(void) {
+	size_t before = gc_stats.freed_bytes;
+	Scheme_GCCollect();
+	return Scheme_CreateInteger(gc_stats.freed_bytes - before);
+}
+
+// prints the bytecode of a compound procedure
+scheme_object * __Scheme_Disassemble__(scheme_object * proc) {
+	if (Scheme_Type(proc) != SCHEME_LAMBDA) {
+		Scheme_SetError("disassemble expects a compound procedure");
+		return NULL;
+	}
+
+	Scheme_Disassemble(Scheme_GetCode(Scheme_GetLambda(proc)->code));
+	return SCHEME_UNSPECIFIED_OBJ;
+}
+
+// the counts, tier and feedback of a compound procedure, see profile.h
+scheme_object * __Scheme_ProcedureStats__(scheme_object * proc) {
+	if (Scheme_Type(proc) != SCHEME_LAMBDA) {
+		Scheme_SetError("procedure-stats expects a compound procedure");
+		return NULL;
+	}
+
+	return Scheme_ProfileStats(Scheme_GetCode(Scheme_GetLambda(proc)->code));
 }
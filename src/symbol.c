@@ -1,13 +1,25 @@
 #include "symbol.h"
+#include "slab.h"
 #include "error.h"
 
 symbol ** sym_table = NULL;
 size_t sym_table_count = 0;
 size_t sym_table_size  = 0;
 
+// 64 bit FNV-1a
+size_t SymbolHash(const char * str) {
+	unsigned long long hash = 14695981039346656037ull;
+	while (*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 1099511628211ull;
+	}
+	return (size_t)hash;
+}
+
 symbol * CreateSymbol(char * str) {
-	symbol * sym = malloc(sizeof(symbol));
+	symbol * sym = Slab_Alloc(SLAB_SYMTAB);
 	sym->str = str;
+	sym->hash = SymbolHash(str);
 	sym->ref_count = 1;
 	return sym;
 }
@@ -18,29 +30,55 @@ void FreeSymbol(symbol * sym) {
 			free(sym->str);
 			sym->str = NULL;
 		}
-		free(sym);
+		Slab_Free(SLAB_SYMTAB, sym);
 	}
 }
 
 int InitSymTable(size_t init_size) {
-	sym_table = malloc(sizeof(symbol*) * init_size);
+	size_t size = 1;
+	while (size < init_size)
+		size <<= 1;
+
+	sym_table = calloc(size, sizeof(symbol*));
 	if (!sym_table) {
 		Scheme_SetError("InitSymTable : malloc() error");
 		return 0;
 	}
 
 	sym_table_count = 0ll;
-	sym_table_size = init_size;
+	sym_table_size = size;
 	return 1;
 }
 
+// first slot holding str, or the empty slot where it would go
+static size_t SymTableProbe(symbol ** table, size_t size, const char * str, size_t hash) {
+	size_t mask = size - 1;
+	size_t i = hash & mask;
+	while (table[i]) {
+		if (table[i]->hash == hash && !strcmp(table[i]->str, str))
+			return i;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
 int ResizeSymTable(size_t new_size) {
-	sym_table = realloc(sym_table, sizeof(symbol*) * new_size);
-	if (!sym_table) {
+	symbol ** new_table = calloc(new_size, sizeof(symbol*));
+	if (!new_table) {
 		Scheme_SetError("ResizeSymTable : realloc() error");
 		return 0;
 	}
 
+	// the cached hashes save rehashing every string
+	size_t i;
+	for (i = 0; i < sym_table_size; ++i) {
+		symbol * sym = sym_table[i];
+		if (sym)
+			new_table[SymTableProbe(new_table, new_size, sym->str, sym->hash)] = sym;
+	}
+
+	free(sym_table);
+	sym_table = new_table;
 	sym_table_size = new_size;
 	return 1;
 }
@@ -49,68 +87,45 @@ void FreeSymTable(void) {
 	if (!sym_table) return;
 
 	size_t i;
-	for (i = 0; i < sym_table_count; ++i) {
+	for (i = 0; i < sym_table_size; ++i) {
 		FreeSymbol(sym_table[i]);
 	}
 
 	free(sym_table);
+	sym_table = NULL;
+	sym_table_count = sym_table_size = 0;
 }
 
 symbol * GetSymbol(const char * str) {
-	size_t i;
-	for (i = 0; i < sym_table_count; ++i) {
-		int comp = strcmp(str, sym_table[i]->str);
-		if (!comp) return sym_table[i];
-	}
-	return NULL;
+	size_t i = SymTableProbe(sym_table, sym_table_size, str, SymbolHash(str));
+	return sym_table[i];
 }
 
 // if str already exists in the symbol table, it
 // returns the already existing symbol and
 // increments its ref_count
 symbol * AddSymbol(char * str) {
+	size_t hash = SymbolHash(str);
+	size_t i = SymTableProbe(sym_table, sym_table_size, str, hash);
+
 	// check if symbol already exists
-	symbol * get = GetSymbol(str);
+	symbol * get = sym_table[i];
 	if (get) {
 		free(str);
 		++get->ref_count;
 		return get;
 	}
 
-	if (sym_table_count + 1 == sym_table_size) {
+	if ((sym_table_count + 1) * 2 > sym_table_size) {
 		if (!ResizeSymTable(sym_table_size * 2))
 			return NULL;
+		i = SymTableProbe(sym_table, sym_table_size, str, hash);
 	}
 
 	symbol * new_sym = CreateSymbol(str);
-
-	symbol ** l = sym_table;
-	symbol ** r = sym_table + sym_table_count;
-
-	// binary insert on sorted sym_table array
-	while (1) {
-		if (r == l) {
-			symbol ** move,
-			       ** end = sym_table + sym_table_count;
-			for (move = end-1; move >= l; --move) {
-				move[1] = move[0];
-			}
-
-			*l = new_sym;
-			++sym_table_count;
-			return *l;
-		}
-
-		symbol ** m = l + (r-l)/2;
-
-		if (m[0]->str < str) {
-			l = m + 1;
-		} else if (m[0]->str > str) {
-			r = m;
-		} else if (str == m[0]->str) { // this shouldn't happen ever
-			return NULL;
-		}
-	}
+	sym_table[i] = new_sym;
+	++sym_table_count;
+	return new_sym;
 }
 
 void ReferenceSymbol(symbol ** pointer, symbol * sym) {
@@ -132,42 +147,48 @@ void DereferenceSymbol(symbol ** sym) {
 void EraseSymTable(size_t index) {
 	if (index == -1) return;
 	FreeSymbol(sym_table[index]);
-
-	size_t i;
-	for (i = index; i < sym_table_count - 1; ++i) {
-		sym_table[i] = sym_table[i+1];
-	}
+	sym_table[index] = NULL;
 	--sym_table_count;
-}
-
-int GetSymTableIndex(symbol * sym) {
-	symbol ** l = sym_table;
-	symbol ** r = sym_table + sym_table_count;
 
+	// close the gap instead of leaving a tombstone: any later entry in
+	// the run whose home slot is not between the hole and itself moves
+	// back into the hole
+	size_t mask = sym_table_size - 1;
+	size_t hole = index, i = index;
 	while (1) {
-		if (r == l) {
-			return -1;
+		i = (i + 1) & mask;
+		symbol * sym = sym_table[i];
+		if (!sym)
+			break;
+
+		size_t home = sym->hash & mask;
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			sym_table[hole] = sym;
+			sym_table[i] = NULL;
+			hole = i;
 		}
+	}
+}
 
-		symbol ** m = l + (r-l)/2;
-
-		if (sym->str > m[0]->str) {
-			l = m + 1;
-		} else if (sym->str < m[0]->str) {
-			r = m;
-		} else if (sym->str == m[0]->str) {
-			return m - sym_table;
-		}
+int GetSymTableIndex(symbol * sym) {
+	size_t mask = sym_table_size - 1;
+	size_t i = sym->hash & mask;
+	while (sym_table[i]) {
+		if (sym_table[i] == sym)
+			return i;
+		i = (i + 1) & mask;
 	}
+	return -1;
 }
 
 #include <stdio.h>
 void DisplaySymbolTable(void) {
 	puts("-----");
 	size_t i;
-	for (i = 0; i < sym_table_count; ++i) {
+	for (i = 0; i < sym_table_size; ++i) {
 		symbol * s = sym_table[i];
-		printf("'%s' address %lli\n", s->str, (long long int)s);
+		if (s)
+			printf("'%s' address %lli\n", s->str, (long long int)s);
 	}
 	puts("-----");
 }
@@ -0,0 +1,1028 @@
+#include "vm.h"
+#include "scheme.h"
+#include "gc.h"
+#include "jit.h"
+#include "profile.h"
+
+const scheme_op_info scheme_ops[OP_COUNT] = {
+	[OP_CONST]         = { "const",         1,  1 },
+	[OP_LOCAL]         = { "local",         1,  1 },
+	[OP_SET_LOCAL]     = { "set-local",     1, -1 },
+	[OP_UNBIND]        = { "unbind",        1,  0 },
+	[OP_ENV]           = { "env",           2,  1 },
+	[OP_SET_ENV]       = { "set-env",       1, -1 },
+	[OP_GLOBAL]        = { "global",        1,  1 },
+	[OP_DEFINE_GLOBAL] = { "define-global", 1, -1 },
+	[OP_POP]           = { "pop",           0, -1 },
+	[OP_DUP]           = { "dup",           0,  1 },
+	[OP_JUMP]          = { "jump",          1,  0 },
+	[OP_JUMP_IF_FALSE] = { "jump-if-false", 1, -1 },
+	[OP_CLOSURE]       = { "closure",       1,  1 },
+	[OP_MAKE_ENV]      = { "make-env",      2,  0 },
+	[OP_POP_ENV]       = { "pop-env",       0,  0 },
+	[OP_CALL]          = { "call",          1,  0 },
+	[OP_TAIL_CALL]     = { "tail-call",     1,  0 },
+	[OP_RETURN]        = { "return",        0, -1 },
+
+	[OP_CALL_JIF]           = { "call/jif",           1, 0 },
+	[OP_CALL_GLOBAL_L]      = { "call-global-l",      2, 1 },
+	[OP_CALL_GLOBAL_L_JIF]  = { "call-global-l/jif",  2, 1 },
+	[OP_CALL_GLOBAL_LL]     = { "call-global-ll",     3, 1 },
+	[OP_CALL_GLOBAL_LL_JIF] = { "call-global-ll/jif", 3, 1 },
+	[OP_CALL_GLOBAL_LK]     = { "call-global-lk",     3, 1 },
+	[OP_CALL_GLOBAL_LK_JIF] = { "call-global-lk/jif", 3, 1 },
+	[OP_CALL_GLOBAL_KL]     = { "call-global-kl",     3, 1 },
+	[OP_CALL_GLOBAL_KL_JIF] = { "call-global-kl/jif", 3, 1 },
+
+	[OP_PRIM0]              = { "prim0",              2,  1 },
+	[OP_PRIM1]              = { "prim1",              2,  0 },
+	[OP_PRIM2]              = { "prim2",              2, -1 },
+	[OP_PRIM3]              = { "prim3",              2, -2 },
+
+	[OP_ADD]                = { "add",                1, -1 },
+	[OP_SUB]                = { "sub",                1, -1 },
+	[OP_NUM_EQ]             = { "num-eq",             1, -1 },
+	[OP_LT]                 = { "lt",                 1, -1 },
+	[OP_GT]                 = { "gt",                 1, -1 },
+	[OP_CONS]               = { "cons",               1, -1 },
+	[OP_CAR]                = { "car",                1,  0 },
+	[OP_CDR]                = { "cdr",                1,  0 },
+	[OP_NULLP]              = { "null?",              1,  0 },
+	[OP_FL_ADD]             = { "fl-add",             1, -1 },
+	[OP_FL_SUB]             = { "fl-sub",             1, -1 },
+	[OP_FL_MUL]             = { "fl-mul",             1, -1 },
+	[OP_FL_LT]              = { "fl-lt",              1, -1 },
+	[OP_NUM_EQ_JIF]         = { "num-eq/jif",         1, -1 },
+	[OP_LT_JIF]             = { "lt/jif",             1, -1 },
+	[OP_GT_JIF]             = { "gt/jif",             1, -1 },
+	[OP_NULLP_JIF]          = { "null?/jif",          1,  0 },
+	[OP_FL_LT_JIF]          = { "fl-lt/jif",          1, -1 },
+};
+
+scheme_stack_segment * vm_segment = NULL;
+scheme_object ** vm_stack = NULL;
+scheme_object ** vm_stack_end = NULL;
+scheme_object ** vm_sp = NULL;
+static int vm_segment_size;
+
+static scheme_stack_segment * Scheme_AllocSegment(int size) {
+	scheme_stack_segment * segment = Scheme_AllocStack(sizeof(scheme_stack_segment)
+		+ sizeof(scheme_object *) * size);
+	if (!segment)
+		return NULL;
+	segment->prev = segment->next = NULL;
+	segment->end = segment->slots + size;
+	segment->top = segment->slots;
+	return segment;
+}
+
+// frees segment and the ones after it
+static void Scheme_FreeSegments(scheme_stack_segment * segment) {
+	while (segment) {
+		scheme_stack_segment * next = segment->next;
+		Scheme_FreeStack(segment, sizeof(scheme_stack_segment)
+			+ sizeof(scheme_object *) * (segment->end - segment->slots));
+		segment = next;
+	}
+}
+
+static void Scheme_UseSegment(scheme_stack_segment * segment) {
+	vm_segment = segment;
+	vm_stack = segment->slots;
+	vm_stack_end = segment->end;
+}
+
+int Scheme_InitVM(int stack_size) {
+	vm_segment_size = stack_size;
+	scheme_stack_segment * segment = Scheme_AllocSegment(stack_size);
+	if (!segment)
+		return 0;
+
+	Scheme_UseSegment(segment);
+	vm_sp = vm_stack;
+	return 1;
+}
+
+void Scheme_FreeVM(void) {
+	if (!vm_segment)
+		return;
+	while (vm_segment->prev)
+		vm_segment = vm_segment->prev;
+	Scheme_FreeSegments(vm_segment);
+	vm_segment = NULL;
+	vm_stack = vm_stack_end = vm_sp = NULL;
+}
+
+// the values below top stay in this segment, count values from from
+// move to the start of the next one, which has room for at least size.
+// returns where they are now, NULL on overflow
+static scheme_object ** Scheme_GrowStack(scheme_object ** top, scheme_object ** from,
+	int count, int size)
+{
+	if (size < vm_segment_size)
+		size = vm_segment_size;
+
+	scheme_stack_segment * segment = vm_segment->next;
+	if (!segment || segment->end - segment->slots < size) {
+		segment = Scheme_AllocSegment(size);
+		if (!segment)
+			return NULL;
+		Scheme_FreeSegments(vm_segment->next);
+		vm_segment->next = segment;
+		segment->prev = vm_segment;
+	}
+	memcpy(segment->slots, from, sizeof(scheme_object *) * count);
+
+	if (top == vm_stack && vm_segment->prev) {
+		// nothing would be left in this one, the next takes its place
+		scheme_stack_segment * empty = vm_segment;
+		segment->prev = empty->prev;
+		empty->prev->next = segment;
+		empty->next = NULL;
+		Scheme_FreeSegments(empty);
+	} else {
+		vm_segment->top = top;
+	}
+
+	Scheme_UseSegment(segment);
+	vm_sp = vm_stack + count;
+	return vm_stack;
+}
+
+// back to the segment before once the frame at the start of this one
+// has returned, the top of the stack is returned
+static scheme_object ** Scheme_ShrinkStack(void) {
+	// only the segment just left is kept
+	Scheme_FreeSegments(vm_segment->next);
+	vm_segment->next = NULL;
+
+	Scheme_UseSegment(vm_segment->prev);
+	return vm_segment->top;
+}
+
+static void Scheme_UnwindStack(scheme_stack_segment * segment, scheme_object ** sp) {
+	if (segment->next) {
+		Scheme_FreeSegments(segment->next->next);
+		segment->next->next = NULL;
+	}
+	Scheme_UseSegment(segment);
+	vm_sp = sp;
+}
+
+// pushes a frame for code at fp, whose arguments are already in place
+static scheme_call * Scheme_EnterFrame(scheme_object * proc, scheme_code * code,
+	scheme_object * env, scheme_object ** fp, char tail)
+{
+	// a tail call's frame takes the place of the one making it
+	scheme_object ** to = tail ? call_stack_end[-1].fp : fp;
+	if (to + code->stack_size > vm_stack_end) {
+		scheme_object ** moved = Scheme_GrowStack(to - 1, fp - 1, code->arg_count + 1,
+			code->stack_size + 1);
+		if (!moved)
+			return NULL;
+		fp = to = moved + 1;
+	}
+
+	scheme_call call;
+	call.proc = proc;
+	call.code = code;
+	call.env = env;
+	call.fp = fp;
+	call.pc = code->ops;
+
+	int replaced = Scheme_PushCallStack(call, tail);
+	if (replaced < 0)
+		return NULL;
+
+	scheme_call * frame = call_stack_end - 1;
+	if (replaced && to != fp) {
+		// the new procedure and arguments go where the old ones were
+		memmove(to - 1, fp - 1, sizeof(scheme_object *) * (code->arg_count + 1));
+		frame->fp = to;
+	}
+
+	scheme_object ** sp = frame->fp + code->arg_count;
+	while (sp < frame->fp + code->frame_size)
+		*sp++ = NULL;
+	vm_sp = sp;
+
+	if (code->captured) {
+		scheme_object * new_env_obj = Scheme_CreateEnvObj(frame->env, code->env_size);
+		if (!new_env_obj)
+			return NULL;
+
+		// a new object needs no write barrier
+		memcpy(Scheme_GetEnvObj(new_env_obj)->slots, frame->fp, sizeof(scheme_object *) * code->arg_count);
+		frame->env = new_env_obj;
+	}
+	return frame;
+}
+
+// calls a primitive with the n arguments at args, n has been checked
+// against its arg_count
+static inline scheme_object * Scheme_CallCFunc(scheme_cfunc * cfunc, scheme_object ** args,
+	scheme_object * env, int n)
+{
+	if (cfunc->func)
+		return cfunc->func(args, env, n);
+
+	switch (n) {
+	case 0:  return cfunc->func0();
+	case 1:  return cfunc->func1(args[0]);
+	case 2:  return cfunc->func2(args[0], args[1]);
+	default: return cfunc->func3(args[0], args[1], args[2]);
+	}
+}
+
+static scheme_object * Scheme_NotApplicable(scheme_object * func) {
+	Scheme_Display(func);
+	Scheme_Newline();
+	Scheme_SetError("tried to call non-applicable object");
+	return NULL;
+}
+
+#ifdef SCHEME_VM_STATS
+unsigned long long vm_op_counts[OP_COUNT];
+unsigned long long vm_pair_counts[OP_COUNT][OP_COUNT];
+
+// pairs only count when the second instruction follows the first in the
+// code, those are the ones a superinstruction could replace
+static const scheme_op * vm_stats_next;
+static scheme_op vm_stats_last;
+
+static inline void Scheme_CountOp(const scheme_op * pc) {
+	scheme_op op = *pc;
+	++vm_op_counts[op];
+	if (pc == vm_stats_next)
+		++vm_pair_counts[vm_stats_last][op];
+	vm_stats_last = op;
+	vm_stats_next = pc + 1 + scheme_ops[op].operands;
+}
+#define VM_COUNT_OP() Scheme_CountOp(pc)
+#else
+#define VM_COUNT_OP() ((void)0)
+#endif
+
+/* Dispatch
+ * with GCC and clang each instruction jumps straight to the next one's
+ * handler through a table of label addresses, giving every handler an
+ * indirect branch of its own to predict. make DISPATCH=switch builds
+ * the portable loop around a switch instead, to compare the two
+ */
+#if defined(__GNUC__) && !defined(SCHEME_VM_SWITCH)
+#define VM_THREADED
+#endif
+
+#ifdef VM_THREADED
+#define VM_DISPATCH_TABLE static const void * const dispatch[OP_COUNT] = { \
+	[OP_CONST] = &&L_OP_CONST, [OP_LOCAL] = &&L_OP_LOCAL, \
+	[OP_SET_LOCAL] = &&L_OP_SET_LOCAL, [OP_UNBIND] = &&L_OP_UNBIND, \
+	[OP_ENV] = &&L_OP_ENV, [OP_SET_ENV] = &&L_OP_SET_ENV, \
+	[OP_GLOBAL] = &&L_OP_GLOBAL, [OP_DEFINE_GLOBAL] = &&L_OP_DEFINE_GLOBAL, \
+	[OP_POP] = &&L_OP_POP, [OP_DUP] = &&L_OP_DUP, \
+	[OP_JUMP] = &&L_OP_JUMP, [OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE, \
+	[OP_CLOSURE] = &&L_OP_CLOSURE, [OP_MAKE_ENV] = &&L_OP_MAKE_ENV, \
+	[OP_POP_ENV] = &&L_OP_POP_ENV, [OP_CALL] = &&L_OP_CALL, \
+	[OP_TAIL_CALL] = &&L_OP_TAIL_CALL, [OP_RETURN] = &&L_OP_RETURN, \
+	[OP_CALL_JIF] = &&L_OP_CALL_JIF, \
+	[OP_CALL_GLOBAL_L] = &&L_OP_CALL_GLOBAL_L, [OP_CALL_GLOBAL_L_JIF] = &&L_OP_CALL_GLOBAL_L_JIF, \
+	[OP_CALL_GLOBAL_LL] = &&L_OP_CALL_GLOBAL_LL, [OP_CALL_GLOBAL_LL_JIF] = &&L_OP_CALL_GLOBAL_LL_JIF, \
+	[OP_CALL_GLOBAL_LK] = &&L_OP_CALL_GLOBAL_LK, [OP_CALL_GLOBAL_LK_JIF] = &&L_OP_CALL_GLOBAL_LK_JIF, \
+	[OP_CALL_GLOBAL_KL] = &&L_OP_CALL_GLOBAL_KL, [OP_CALL_GLOBAL_KL_JIF] = &&L_OP_CALL_GLOBAL_KL_JIF, \
+	[OP_PRIM0] = &&L_OP_PRIM0, [OP_PRIM1] = &&L_OP_PRIM1, \
+	[OP_PRIM2] = &&L_OP_PRIM2, [OP_PRIM3] = &&L_OP_PRIM3, \
+	[OP_ADD] = &&L_OP_ADD, [OP_SUB] = &&L_OP_SUB, \
+	[OP_NUM_EQ] = &&L_OP_NUM_EQ, [OP_LT] = &&L_OP_LT, [OP_GT] = &&L_OP_GT, \
+	[OP_CONS] = &&L_OP_CONS, [OP_CAR] = &&L_OP_CAR, \
+	[OP_CDR] = &&L_OP_CDR, [OP_NULLP] = &&L_OP_NULLP, \
+	[OP_NUM_EQ_JIF] = &&L_OP_NUM_EQ_JIF, [OP_LT_JIF] = &&L_OP_LT_JIF, \
+	[OP_GT_JIF] = &&L_OP_GT_JIF, [OP_NULLP_JIF] = &&L_OP_NULLP_JIF, \
+	[OP_FL_ADD] = &&L_OP_FL_ADD, [OP_FL_SUB] = &&L_OP_FL_SUB, \
+	[OP_FL_MUL] = &&L_OP_FL_MUL, [OP_FL_LT] = &&L_OP_FL_LT, \
+	[OP_FL_LT_JIF] = &&L_OP_FL_LT_JIF, \
+}
+#define VM_NEXT     do { VM_COUNT_OP(); goto *dispatch[*pc++]; } while (0)
+#define VM_SWITCH   VM_NEXT;
+#define VM_CASE(op) L_##op:
+#define VM_DEFAULT  L_DEFAULT: __attribute__((unused));
+#else
+#define VM_DISPATCH_TABLE
+// a jump rather than continue, which would only leave the do { } while (0)
+// of a macro ending in VM_NEXT
+#define VM_NEXT     goto next_op
+#define VM_SWITCH   next_op: switch (VM_COUNT_OP(), *pc++)
+#define VM_CASE(op) case op:
+#define VM_DEFAULT  default:
+#endif
+
+// runs frames until base returns
+static scheme_object * Scheme_Run(scheme_call * base) {
+	scheme_call * call = base;
+	scheme_code * code = call->code;
+	const scheme_op * pc = call->pc;
+	scheme_object ** fp = call->fp;
+	scheme_object ** sp = vm_sp;
+
+	scheme_object * val;
+	scheme_env * frame;
+	int n;
+	char tail, branch;
+
+	// anything that may allocate or run other code needs the stack top
+	#define SAVE_SP() (vm_sp = sp)
+
+	#define VM_PUSH_LOCAL(slot) do { \
+		if (!(val = fp[slot])) goto unbound; \
+		*sp++ = val; \
+	} while (0)
+	#define VM_PUSH_GLOBAL(cell) do { \
+		if (!(val = code->cells[cell]->object)) goto unbound; \
+		*sp++ = val; \
+	} while (0)
+
+	// a primitive's fixed entry point is only used while the global the
+	// compiler found it in still holds it
+	#define VM_PRIM_CHECK(argc) do { \
+		val = code->cells[pc[0]]->object; \
+		if (val != code->consts[pc[1]]) { \
+			n = argc; \
+			goto prim_redefined; \
+		} \
+		pc += 2; \
+		VM_FEEDBACK(Scheme_ArgumentKinds(sp - argc, argc)); \
+		SAVE_SP(); \
+	} while (0)
+	#define VM_PRIM_RESULT(argc) do { \
+		if (!val) \
+			goto error; \
+		sp -= argc; \
+		*sp++ = val; \
+		VM_NEXT; \
+	} while (0)
+
+	// an inlined primitive (see OP_ADD) is given up on for good by code
+	// compiled before one was redefined, pc is left past the cell
+	#define VM_INLINE_GUARD(argc, label) do { \
+		if (code->epoch != scheme_global_epoch) { \
+			n = argc; \
+			goto label; \
+		} \
+		++pc; \
+		SAVE_SP(); \
+	} while (0)
+	#define VM_INLINE_CHECK(argc) VM_INLINE_GUARD(argc, inline_redefined)
+	// a test jumps straight away when branch is set, like a /jif call
+	#define VM_TEST_CHECK(argc)   VM_INLINE_GUARD(argc, test_redefined)
+	#define VM_TEST_RESULT(argc) do { \
+		if (!val) \
+			goto error; \
+		sp -= argc; \
+		if (branch) \
+			pc = Scheme_BoolTest(val) ? pc + 2 : code->ops + pc[1]; \
+		else \
+			*sp++ = val; \
+		VM_NEXT; \
+	} while (0)
+	#define VM_FIXNUMS(a, b) (Scheme_IsFixnum(a) && Scheme_IsFixnum(b))
+
+#ifdef SCHEME_JIT
+	// a frame of compiled code carries on in machine code from pc, up to
+	// the next instruction it hands back (see jit.h)
+	#define VM_JIT_ENTER() do { \
+		if (code->jit) { \
+			SAVE_SP(); \
+			pc = code->jit->func(call, sp, code->jit->entries[pc - code->ops]); \
+			if (!pc) \
+				goto error; \
+			sp = vm_sp; \
+		} \
+	} while (0)
+#else
+	#define VM_JIT_ENTER() ((void)0)
+#endif
+	// a frame of callee has been entered, by a tail call of its own (loop)
+	// or any other call. it is promoted once hot, see profile.h
+	#define VM_PROFILE_ENTER(callee, loop) do { \
+		if (loop) \
+			++(callee)->loops; \
+		else \
+			++(callee)->calls; \
+		if ((callee)->tier == SCHEME_TIER_PROFILED && scheme_tier_threshold >= 0 \
+		    && (callee)->calls + (callee)->loops > (unsigned long long)scheme_tier_threshold) \
+			Scheme_Promote(callee); \
+	} while (0)
+	// the site ending at pc has been given arguments of kinds
+	#define VM_FEEDBACK(kinds) do { \
+		if (code->tier == SCHEME_TIER_PROFILED) \
+			code->feedback[pc - code->ops] |= (kinds); \
+	} while (0)
+	#define VM_FLONUMS(a, b) (Scheme_IsFlonum(a) && Scheme_IsFlonum(b))
+	// a result out of the flonum range is boxed
+	#define VM_FLONUM_OP(a, op, b) Scheme_CreateDouble(Scheme_FlonumValue(a) op Scheme_FlonumValue(b))
+
+	VM_DISPATCH_TABLE;
+	VM_SWITCH {
+		VM_CASE(OP_CONST)
+			*sp++ = code->consts[*pc++];
+			VM_NEXT;
+
+		VM_CASE(OP_LOCAL)
+			val = fp[*pc++];
+			if (!val)
+				goto unbound;
+			*sp++ = val;
+			VM_NEXT;
+
+		VM_CASE(OP_SET_LOCAL)
+			fp[*pc++] = *--sp;
+			VM_NEXT;
+
+		VM_CASE(OP_UNBIND)
+			fp[*pc++] = NULL;
+			VM_NEXT;
+
+		VM_CASE(OP_ENV)
+			frame = (scheme_env *)call->env->payload;
+			for (n = *pc++; n; --n)
+				frame = (scheme_env *)frame->parent->payload;
+			val = frame->slots[*pc++];
+			if (!val)
+				goto unbound;
+			*sp++ = val;
+			VM_NEXT;
+
+		VM_CASE(OP_SET_ENV)
+			val = *--sp;
+			((scheme_env *)call->env->payload)->slots[*pc++] = val;
+			GC_WRITE_BARRIER(call->env, val);
+			VM_NEXT;
+
+		VM_CASE(OP_GLOBAL)
+			val = code->cells[*pc++]->object;
+			if (!val)
+				goto unbound;
+			*sp++ = val;
+			VM_NEXT;
+
+		VM_CASE(OP_DEFINE_GLOBAL)
+			// only top level code defines globals, env is their environment
+			val = *--sp;
+			Scheme_OverwriteDefine(code->cells[*pc++], val);
+			GC_WRITE_BARRIER(call->env, val);
+			VM_NEXT;
+
+		VM_CASE(OP_POP)
+			--sp;
+			VM_NEXT;
+
+		VM_CASE(OP_DUP)
+			val = sp[-1];
+			*sp++ = val;
+			VM_NEXT;
+
+		VM_CASE(OP_JUMP)
+			pc = code->ops + *pc;
+			VM_NEXT;
+
+		VM_CASE(OP_JUMP_IF_FALSE)
+			if (Scheme_BoolTest(*--sp))
+				++pc;
+			else
+				pc = code->ops + *pc;
+			VM_NEXT;
+
+		VM_CASE(OP_CLOSURE)
+			SAVE_SP();
+			val = Scheme_CreateLambda(code->consts[*pc++], call->env);
+			if (!val)
+				goto error;
+			*sp++ = val;
+			VM_NEXT;
+
+		VM_CASE(OP_MAKE_ENV)
+			n = *pc++;
+			SAVE_SP();
+			val = Scheme_CreateEnvObj(call->env, *pc++);
+			if (!val)
+				goto error;
+
+			sp -= n;
+			memcpy(Scheme_GetEnvObj(val)->slots, sp, sizeof(scheme_object *) * n);
+			call->env = val;
+			VM_NEXT;
+
+		VM_CASE(OP_POP_ENV)
+			call->env = ((scheme_env *)call->env->payload)->parent;
+			VM_NEXT;
+
+		VM_CASE(OP_CALL)
+			n = *pc++;
+			tail = branch = 0;
+			goto call;
+
+		VM_CASE(OP_CALL_JIF)
+			n = *pc++;
+			tail = 0;
+			branch = 1;
+			goto call;
+
+		VM_CASE(OP_TAIL_CALL)
+			n = *pc++;
+			tail = 1;
+			branch = 0;
+			goto call;
+
+		// superinstructions for a global called on locals and constants,
+		// laid out on the stack like any other call
+		VM_CASE(OP_CALL_GLOBAL_L_JIF)
+			branch = 1;
+			goto call_global_l;
+		VM_CASE(OP_CALL_GLOBAL_L)
+			branch = 0;
+		call_global_l:
+			VM_PUSH_GLOBAL(pc[0]);
+			VM_PUSH_LOCAL(pc[1]);
+			pc += 2;
+			n = 1;
+			tail = 0;
+			goto call;
+
+		VM_CASE(OP_CALL_GLOBAL_LL_JIF)
+			branch = 1;
+			goto call_global_ll;
+		VM_CASE(OP_CALL_GLOBAL_LL)
+			branch = 0;
+		call_global_ll:
+			VM_PUSH_GLOBAL(pc[0]);
+			VM_PUSH_LOCAL(pc[1]);
+			VM_PUSH_LOCAL(pc[2]);
+			pc += 3;
+			n = 2;
+			tail = 0;
+			goto call;
+
+		VM_CASE(OP_CALL_GLOBAL_LK_JIF)
+			branch = 1;
+			goto call_global_lk;
+		VM_CASE(OP_CALL_GLOBAL_LK)
+			branch = 0;
+		call_global_lk:
+			VM_PUSH_GLOBAL(pc[0]);
+			VM_PUSH_LOCAL(pc[1]);
+			*sp++ = code->consts[pc[2]];
+			pc += 3;
+			n = 2;
+			tail = 0;
+			goto call;
+
+		VM_CASE(OP_CALL_GLOBAL_KL_JIF)
+			branch = 1;
+			goto call_global_kl;
+		VM_CASE(OP_CALL_GLOBAL_KL)
+			branch = 0;
+		call_global_kl:
+			VM_PUSH_GLOBAL(pc[0]);
+			*sp++ = code->consts[pc[1]];
+			VM_PUSH_LOCAL(pc[2]);
+			pc += 3;
+			n = 2;
+			tail = 0;
+			goto call;
+
+		VM_CASE(OP_PRIM0)
+			VM_PRIM_CHECK(0);
+			val = ((scheme_cfunc *)val->payload)->func0();
+			VM_PRIM_RESULT(0);
+
+		VM_CASE(OP_PRIM1)
+			VM_PRIM_CHECK(1);
+			val = ((scheme_cfunc *)val->payload)->func1(sp[-1]);
+			VM_PRIM_RESULT(1);
+
+		VM_CASE(OP_PRIM2)
+			VM_PRIM_CHECK(2);
+			val = ((scheme_cfunc *)val->payload)->func2(sp[-2], sp[-1]);
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_PRIM3)
+			VM_PRIM_CHECK(3);
+			val = ((scheme_cfunc *)val->payload)->func3(sp[-3], sp[-2], sp[-1]);
+			VM_PRIM_RESULT(3);
+
+		VM_CASE(OP_ADD)
+			VM_INLINE_CHECK(2);
+			if (VM_FIXNUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FIXNUMS);
+				// the sum of two fixnums always fits in a long long
+				long long sum = Scheme_FixnumValue(sp[-2]) + Scheme_FixnumValue(sp[-1]);
+				val = Scheme_FixnumFits(sum) ? Scheme_MakeFixnum(sum) : Scheme_CreateInteger(sum);
+			} else if (VM_FLONUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FLONUMS);
+				val = VM_FLONUM_OP(sp[-2], +, sp[-1]);
+			} else {
+				VM_FEEDBACK(Scheme_ArgumentKinds(sp - 2, 2));
+				val = __Scheme_CallAdd__(sp - 2, call->env, 2);
+			}
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_SUB)
+			VM_INLINE_CHECK(2);
+			if (VM_FIXNUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FIXNUMS);
+				long long diff = Scheme_FixnumValue(sp[-2]) - Scheme_FixnumValue(sp[-1]);
+				val = Scheme_FixnumFits(diff) ? Scheme_MakeFixnum(diff) : Scheme_CreateInteger(diff);
+			} else if (VM_FLONUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FLONUMS);
+				val = VM_FLONUM_OP(sp[-2], -, sp[-1]);
+			} else {
+				VM_FEEDBACK(Scheme_ArgumentKinds(sp - 2, 2));
+				val = __Scheme_CallSub__(sp - 2, call->env, 2);
+			}
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_NUM_EQ_JIF)
+			branch = 1;
+			goto num_eq;
+		VM_CASE(OP_NUM_EQ)
+			branch = 0;
+		num_eq:
+			VM_TEST_CHECK(2);
+			if (VM_FIXNUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FIXNUMS);
+				val = Scheme_MakeBoolean(sp[-2] == sp[-1]);
+			} else if (VM_FLONUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FLONUMS);
+				val = Scheme_MakeBoolean(Scheme_FlonumValue(sp[-2]) == Scheme_FlonumValue(sp[-1]));
+			} else {
+				VM_FEEDBACK(Scheme_ArgumentKinds(sp - 2, 2));
+				val = __Scheme_CallAEqual__(sp - 2, call->env, 2);
+			}
+			VM_TEST_RESULT(2);
+
+		VM_CASE(OP_LT_JIF)
+			branch = 1;
+			goto lt;
+		VM_CASE(OP_LT)
+			branch = 0;
+		lt:
+			VM_TEST_CHECK(2);
+			if (VM_FIXNUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FIXNUMS);
+				val = Scheme_MakeBoolean(Scheme_FixnumValue(sp[-2]) < Scheme_FixnumValue(sp[-1]));
+			} else if (VM_FLONUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FLONUMS);
+				val = Scheme_MakeBoolean(Scheme_FlonumValue(sp[-2]) < Scheme_FlonumValue(sp[-1]));
+			} else {
+				VM_FEEDBACK(Scheme_ArgumentKinds(sp - 2, 2));
+				val = __Scheme_CallALessThan__(sp - 2, call->env, 2);
+			}
+			VM_TEST_RESULT(2);
+
+		VM_CASE(OP_GT_JIF)
+			branch = 1;
+			goto gt;
+		VM_CASE(OP_GT)
+			branch = 0;
+		gt:
+			VM_TEST_CHECK(2);
+			if (VM_FIXNUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FIXNUMS);
+				val = Scheme_MakeBoolean(Scheme_FixnumValue(sp[-2]) > Scheme_FixnumValue(sp[-1]));
+			} else if (VM_FLONUMS(sp[-2], sp[-1])) {
+				VM_FEEDBACK(SCHEME_FEEDBACK_FLONUMS);
+				val = Scheme_MakeBoolean(Scheme_FlonumValue(sp[-2]) > Scheme_FlonumValue(sp[-1]));
+			} else {
+				VM_FEEDBACK(Scheme_ArgumentKinds(sp - 2, 2));
+				val = __Scheme_CallAGreaterThan__(sp - 2, call->env, 2);
+			}
+			VM_TEST_RESULT(2);
+
+		VM_CASE(OP_CONS)
+			VM_INLINE_CHECK(2);
+			val = Scheme_CreatePair(sp[-2], sp[-1]);
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_CAR)
+			VM_INLINE_CHECK(1);
+			val = sp[-1];
+			val = Scheme_Type(val) == SCHEME_PAIR ? ((scheme_pair *)val->payload)->car : __Scheme_car__(val);
+			VM_PRIM_RESULT(1);
+
+		VM_CASE(OP_CDR)
+			VM_INLINE_CHECK(1);
+			val = sp[-1];
+			val = Scheme_Type(val) == SCHEME_PAIR ? ((scheme_pair *)val->payload)->cdr : __Scheme_cdr__(val);
+			VM_PRIM_RESULT(1);
+
+		VM_CASE(OP_NULLP_JIF)
+			branch = 1;
+			goto nullp;
+		VM_CASE(OP_NULLP)
+			branch = 0;
+		nullp:
+			VM_TEST_CHECK(1);
+			val = Scheme_MakeBoolean(Scheme_IsNull(sp[-1]));
+			VM_TEST_RESULT(1);
+
+		VM_CASE(OP_FL_ADD)
+			VM_INLINE_CHECK(2);
+			val = VM_FLONUMS(sp[-2], sp[-1]) ? VM_FLONUM_OP(sp[-2], +, sp[-1]) : __Flonum_Add__(sp[-2], sp[-1]);
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_FL_SUB)
+			VM_INLINE_CHECK(2);
+			val = VM_FLONUMS(sp[-2], sp[-1]) ? VM_FLONUM_OP(sp[-2], -, sp[-1]) : __Flonum_Sub__(sp[-2], sp[-1]);
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_FL_MUL)
+			VM_INLINE_CHECK(2);
+			val = VM_FLONUMS(sp[-2], sp[-1]) ? VM_FLONUM_OP(sp[-2], *, sp[-1]) : __Flonum_Mul__(sp[-2], sp[-1]);
+			VM_PRIM_RESULT(2);
+
+		VM_CASE(OP_FL_LT_JIF)
+			branch = 1;
+			goto fl_lt;
+		VM_CASE(OP_FL_LT)
+			branch = 0;
+		fl_lt:
+			VM_TEST_CHECK(2);
+			if (VM_FLONUMS(sp[-2], sp[-1]))
+				val = Scheme_MakeBoolean(Scheme_FlonumValue(sp[-2]) < Scheme_FlonumValue(sp[-1]));
+			else
+				val = __Flonum_LessThan__(sp[-2], sp[-1]);
+			VM_TEST_RESULT(2);
+
+		prim_redefined:
+			pc += 2;
+			branch = 0;
+		redefined:
+			// called like any other procedure, the compiler left room for
+			// it below the arguments
+			if (!val)
+				goto unbound;
+			memmove(sp - n + 1, sp - n, sizeof(scheme_object *) * n);
+			sp[-n] = val;
+			++sp;
+			tail = 0;
+			goto call;
+
+		inline_redefined:
+			branch = 0;
+		test_redefined:
+			val = code->cells[*pc++]->object;
+			goto redefined;
+
+		// n arguments above the procedure. a call fused with the
+		// jump-if-false after it (branch) leaves pc on that jump
+		call: {
+			scheme_object * func = sp[-n-1];
+#ifdef SCHEME_ALLOC_STATS
+			++scheme_call_count;
+#endif
+			VM_FEEDBACK(Scheme_ArgumentKinds(sp - n, n));
+
+			if (Scheme_Type(func) == SCHEME_LAMBDA) {
+				scheme_lambda * lambda = (scheme_lambda *)func->payload;
+				scheme_code * callee = (scheme_code *)lambda->code->payload;
+
+				if (n < callee->arg_count) {
+					Scheme_SetError("λ call error : too few arguments");
+					goto error;
+				} else if (n > callee->arg_count) {
+					Scheme_SetError("λ call error : too many arguments");
+					goto error;
+				}
+
+				// the value comes back to the jump when branch is set
+				call->pc = pc;
+				SAVE_SP();
+				call = Scheme_EnterFrame(func, callee, lambda->closure, sp - n, tail);
+				if (!call)
+					goto error;
+
+				// a tail call of code to itself is a loop
+				VM_PROFILE_ENTER(callee, tail && callee == code);
+				code = callee;
+				pc = code->ops;
+				fp = call->fp;
+				sp = vm_sp;
+				VM_JIT_ENTER();
+				VM_NEXT;
+			}
+
+			if (Scheme_Type(func) != SCHEME_CFUNC) {
+				Scheme_NotApplicable(func);
+				goto error;
+			}
+
+			scheme_cfunc * cfunc = (scheme_cfunc *)func->payload;
+			if (cfunc->special_form) {
+				// only a special form's own name is recognised by the compiler
+				Scheme_SetError("special form used as a procedure");
+				goto error;
+			}
+			if (n < cfunc->arg_count || (n > cfunc->arg_count && !cfunc->dot_args)) {
+				Scheme_SetError("bad arg count");
+				goto error;
+			}
+
+			// the arguments are passed where they are on the stack
+			call->pc = pc;
+			SAVE_SP();
+			val = Scheme_CallCFunc(cfunc, sp - n, call->env, n);
+			if (!val)
+				goto error;
+			sp -= n + 1;
+
+			// a primitive in tail position returns straight away
+			if (tail)
+				goto return_val;
+			if (branch)
+				pc = Scheme_BoolTest(val) ? pc + 2 : code->ops + pc[1];
+			else
+				*sp++ = val;
+			VM_JIT_ENTER();
+			VM_NEXT; }
+
+		VM_CASE(OP_RETURN)
+			val = sp[-1];
+		return_val:
+			// Scheme_Execute puts the stacks back once base returns
+			call_stack_end = call;
+			if (call == base)
+				return val;
+
+			// only a frame moved to a new segment starts one
+			sp = call->fp - 1;
+			if (sp == vm_stack)
+				sp = Scheme_ShrinkStack();
+			call = call == call_stack ? Scheme_PopCallSegment() : call - 1;
+			code = call->code;
+			pc = call->pc;
+			fp = call->fp;
+			*sp++ = val;
+			VM_JIT_ENTER();
+			VM_NEXT;
+
+		VM_DEFAULT
+			Scheme_SetError("bad opcode");
+			goto error;
+	}
+
+	#undef SAVE_SP
+	#undef VM_PUSH_LOCAL
+	#undef VM_PUSH_GLOBAL
+	#undef VM_PRIM_CHECK
+	#undef VM_PRIM_RESULT
+	#undef VM_INLINE_GUARD
+	#undef VM_INLINE_CHECK
+	#undef VM_TEST_CHECK
+	#undef VM_TEST_RESULT
+	#undef VM_FIXNUMS
+	#undef VM_JIT_ENTER
+	#undef VM_PROFILE_ENTER
+	#undef VM_FEEDBACK
+
+unbound:
+	Scheme_SetError("unbound variable");
+error:
+	return NULL;
+}
+
+scheme_object * Scheme_Execute(scheme_object * code_obj, scheme_object * env) {
+	scheme_code * code = Scheme_GetCode(code_obj);
+	if (!code)
+		return NULL;
+
+	// the frames pushed from here on are dropped however the code ends
+	scheme_stack_segment * segment = vm_segment;
+	scheme_object ** sp = vm_sp;
+	scheme_call_segment * calls = call_segment;
+	scheme_call * calls_end = call_stack_end;
+
+	// top level code runs in a frame of its own, below which sits the
+	// code where a call has its procedure
+	scheme_object * val = NULL;
+	if (vm_sp < vm_stack_end || Scheme_GrowStack(vm_sp, vm_sp, 0, 1)) {
+		*vm_sp++ = code_obj;
+		scheme_call * base = Scheme_EnterFrame(NULL, code, env, vm_sp, 0);
+		if (base)
+			val = Scheme_Run(base);
+	}
+
+	Scheme_UnwindCallStack(calls, calls_end);
+	Scheme_UnwindStack(segment, sp);
+	return val;
+}
+
+#ifdef SCHEME_VM_STATS
+void Scheme_DisplayVMStats(void) {
+	unsigned long long total = 0;
+	int i, j;
+	for (i = 0; i < OP_COUNT; ++i)
+		total += vm_op_counts[i];
+	fprintf(stderr, "vm instructions %llu\n", total);
+	if (!total)
+		return;
+
+	for (i = 0; i < OP_COUNT; ++i)
+		if (vm_op_counts[i])
+			fprintf(stderr, "  %-22s %12llu %5.1f%%\n", scheme_ops[i].name,
+				vm_op_counts[i], 100.0 * vm_op_counts[i] / total);
+
+	// the most frequent pairs, picked out one by one and cleared
+	fprintf(stderr, "hottest pairs\n");
+	int count;
+	for (count = 0; count < 12; ++count) {
+		unsigned long long best = 0;
+		int best_i = 0, best_j = 0;
+		for (i = 0; i < OP_COUNT; ++i)
+			for (j = 0; j < OP_COUNT; ++j)
+				if (vm_pair_counts[i][j] > best) {
+					best = vm_pair_counts[i][j];
+					best_i = i;
+					best_j = j;
+				}
+		if (!best)
+			break;
+
+		fprintf(stderr, "  %-22s %-22s %12llu %5.1f%%\n", scheme_ops[best_i].name,
+			scheme_ops[best_j].name, best, 100.0 * best / total);
+		vm_pair_counts[best_i][best_j] = 0;
+	}
+}
+#endif
+
+/* Disassembler */
+
+void Scheme_Disassemble(scheme_code * code) {
+	printf("args %i, frame %i, stack %i", code->arg_count, code->frame_size, code->stack_size);
+	if (code->captured)
+		printf(", captured in %i slots", code->env_size);
+	Scheme_Newline();
+
+	int pc = 0;
+	while (pc < code->op_count) {
+		scheme_op op = code->ops[pc];
+		const scheme_op_info * info = &scheme_ops[op];
+
+		printf("%5i  %-18s", pc, info->name);
+		int i;
+		for (i = 0; i < info->operands; ++i)
+			printf(" %i", code->ops[pc + 1 + i]);
+
+		switch (op) {
+		case OP_CONST:
+			printf("\t; ");
+			Scheme_Display(code->consts[code->ops[pc + 1]]);
+			break;
+		case OP_CLOSURE:
+			printf("\t; const %i", code->ops[pc + 1]);
+			break;
+		case OP_GLOBAL:
+		case OP_DEFINE_GLOBAL:
+		case OP_CALL_GLOBAL_L:
+		case OP_CALL_GLOBAL_LL:
+		case OP_CALL_GLOBAL_LK:
+		case OP_CALL_GLOBAL_KL:
+		case OP_CALL_GLOBAL_L_JIF:
+		case OP_CALL_GLOBAL_LL_JIF:
+		case OP_CALL_GLOBAL_LK_JIF:
+		case OP_CALL_GLOBAL_KL_JIF:
+		case OP_PRIM0:
+		case OP_PRIM1:
+		case OP_PRIM2:
+		case OP_PRIM3:
+		case OP_ADD:
+		case OP_SUB:
+		case OP_NUM_EQ:
+		case OP_LT:
+		case OP_GT:
+		case OP_CONS:
+		case OP_CAR:
+		case OP_CDR:
+		case OP_NULLP:
+		case OP_NUM_EQ_JIF:
+		case OP_LT_JIF:
+		case OP_GT_JIF:
+		case OP_NULLP_JIF:
+		case OP_FL_ADD:
+		case OP_FL_SUB:
+		case OP_FL_MUL:
+		case OP_FL_LT:
+		case OP_FL_LT_JIF:
+			printf("\t; %s", code->cells[code->ops[pc + 1]]->sym->str);
+			break;
+		}
+		Scheme_Newline();
+		pc += 1 + info->operands;
+	}
+
+	int i;
+	for (i = 0; i < code->const_count; ++i) {
+		if (Scheme_Type(code->consts[i]) != SCHEME_CODE)
+			continue;
+		printf("\nconst %i : ", i);
+		Scheme_Disassemble(Scheme_GetCode(code->consts[i]));
+	}
+}
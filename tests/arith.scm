@@ -0,0 +1,85 @@
+; the arithmetic test matrix, run by make check and diffed against
+; arith.expected. every pair of operands below goes through + - * = < >,
+; one line each as
+;   a b : a+b a-b a*b a=b a<b a>b
+; the operands are fixnums at either end of their range on 64 bit,
+; integers just past it and at the ends of a long long, a bignum,
+; rationals and doubles
+
+(define operands
+	(list 0 1 -1
+	      4611686018427387903 -4611686018427387904
+	      4611686018427387904 -4611686018427387905
+	      9223372036854775807 -9223372036854775808
+	      100000000000000000000000000000000
+	      (/ 1 3) (/ -7 2) (/ 9223372036854775807 2)
+	      0.5 -0.0 1.5))
+
+(define (show a b)
+	(display a) (display " ") (display b) (display " :")
+	(display " ") (display (+ a b))
+	(display " ") (display (- a b))
+	(display " ") (display (* a b))
+	(display " ") (display (= a b))
+	(display " ") (display (< a b))
+	(display " ") (display (> a b))
+	(newline))
+
+(define (show-row a bs)
+	(cond ((null? bs) #t)
+	      (else (show a (car bs)) (show-row a (cdr bs)))))
+
+(define (show-all as)
+	(cond ((null? as) #t)
+	      (else (show-row (car as) operands) (show-all (cdr as)))))
+
+(show-all operands)
+
+; fixnum overflow in each direction
+(+ 4611686018427387903 1)
+(- -4611686018427387904 1)
+(* 2147483648 2147483648)
+(* -4611686018427387904 -1)
+(+ 9223372036854775807 1)
+(- -9223372036854775808 1)
+(* 9223372036854775807 9223372036854775807)
+
+; results that come back down into a fixnum
+(- 4611686018427387904 1)
+(+ 9223372036854775807 -9223372036854775807)
+(- 100000000000000000000000000000000 99999999999999999999999999999999)
+
+; bignums as doubles, 10^32 and 2^96
+(+ 0.5 100000000000000000000000000000000)
+(+ 0.5 79228162514264337593543950336)
+
+; unary minus
+(- 5)
+(- -4611686018427387904)
+(- -9223372036854775808)
+(- (/ 1 3))
+(- 0.5)
+(- 0.0)
+(- -0.0)
+
+; division, of one argument too, and an exact 0 as the divisor of any
+; number
+(/ 1 3)
+(/ (/ 1 3) (/ 2 3))
+(/ 1.5 (/ 1 2))
+(/ (/ 1 3) 0)
+(/ 100000000000000000000000000000000 0)
+(/ 1.5 0)
+(/ 1 (- (/ 1 3) (/ 1 3)))
+(/ 1.0 0.0)
+(/ 2)
+(/ 0.5)
+(/ (/ -2 3))
+(/ 100000000000000000000000000000000)
+(/ 0)
+
+; more than two arguments, mixed
+(+ 1 (/ 1 2) 0.25)
+(* 2 (/ 1 3) 3)
+(< 1 (/ 3 2) 2.5 4611686018427387904)
+(= 1 1.0 (/ 2 2))
@@ -0,0 +1,27 @@
+; bench/biglist.scm cut down to a million cells: a list accumulated
+; get-primes style, dropped and built again so the collector sweeps the
+; first, then a structure nested as deep in its cars. a million is well
+; past what the C stack takes if marking, sweeping or displaying a list
+; recurse once per cell
+(define (iter i result)
+	(if (= i 0)
+	    result
+	    (iter (- i 1) (cons i result))))
+(define (len l n)
+	(if (null? l) n (len (cdr l) (+ n 1))))
+(define big (iter 1000000 '()))
+(len big 0)
+(define big '())
+(define big (iter 1000000 '()))
+(len big 0)
+(define big '())
+
+(define (nest i result)
+	(if (= i 0)
+	    result
+	    (nest (- i 1) (cons result i))))
+(define (depth l n)
+	(if (null? l) n (depth (car l) (+ n 1))))
+(define deep (nest 1000000 '()))
+(depth deep 0)
+(define deep '())
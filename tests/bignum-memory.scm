@@ -0,0 +1,7 @@
+; 20000! by repeated multiplication. every step leaves a dead bignum of a
+; few KB behind, the whole run over 100 MB, while what is live at any
+; time stays small. make check runs this under a cap on memory that only
+; holds as long as the collector is told about the limbs (see gc.h)
+
+(define (f n acc) (if (= n 0) acc (f (- n 1) (* acc n))))
+(remainder (f 20000 1) 1000000007)